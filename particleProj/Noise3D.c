@@ -37,24 +37,39 @@
 #define _USE_MATH_DEFINES
 #include <stdlib.h>
 #include <math.h>
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define NOISE_SSE2
+#include <emmintrin.h>
+#endif
+#ifndef PARTICLE_NO_GL
 #include <glad/glad.h>
+#endif
 
 
 #define NOISE_TABLE_MASK   255
 
 #define FLOOR(x)           ((int)(x) - ((x) < 0 && (x) != (int)(x)))
 #define smoothstep(t)      ( t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f ) )
+#define smoothstepDeriv(t) ( 30.0f * t * t * ( t * ( t - 2.0f ) + 1.0f ) )
 #define lerp(t, a, b)      ( a + t * (b - a) )
-#ifdef _WIN32
-#define srandom srand
-#define random rand
-#endif
 
-// lattice gradients 3D noise
-static float   gradientTable[256 * 3];
+//
+// a noise generator owns its permutation and lattice gradients, so several volumes
+// with different seeds can coexist
+//
+// period > 0 wraps the lattice coordinates at period cells (at most 256), which makes
+// the noise tile: a volume sampled over [0, period) in each axis, i.e. generated with
+// frequency == period, repeats seamlessly under GL_REPEAT.
+//
+typedef struct
+{
+   unsigned char perm[256];
+   float         gradients[256 * 3];  // already indexed through perm
+   int           period;
+} NoiseGenerator;
 
-// permTable describes a random permutatin of 8-bit values from 0 to 255.
-static unsigned char permTable[256] =
+// the book's permutation of 8-bit values from 0 to 255, seed 0 uses it as is.
+static const unsigned char bookPermTable[256] =
 {
    0xE1, 0x9B, 0xD2, 0x6C, 0xAF, 0xC7, 0xDD, 0x90, 0xCB, 0x74, 0x46, 0xD5, 0x45, 0x9E, 0x21, 0xFC,
    0x05, 0x52, 0xAD, 0x85, 0xDE, 0x8B, 0xAE, 0x1B, 0x09, 0x47, 0x5A, 0xF6, 0x4B, 0x82, 0x5B, 0xBF,
@@ -74,31 +89,67 @@ static unsigned char permTable[256] =
    0x89, 0xD6, 0x91, 0x5D, 0x5C, 0x64, 0xF5, 0x00, 0xD8, 0xBA, 0x3C, 0x53, 0x69, 0x61, 0xCC, 0x34,
 };
 
-void initNoiseTable()
+// xorshift32, the generator's own random sequence so seeding doesn't touch srand()
+static unsigned int noiseRandom ( unsigned int *state )
+{
+   unsigned int x = *state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *state = x;
+   return x;
+}
+
+// uniform float in [0, 1)
+static float noiseRandomFloat ( unsigned int *state )
+{
+   return ( noiseRandom ( state ) >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+void initNoiseGenerator ( NoiseGenerator *gen, unsigned int seed, int period )
 {
    int            i;
    float          a;
    float          x, y, z, r, theta;
    float          gradients[256 * 3];
-   unsigned int   *p, *psrc;
+   unsigned int   state = seed * 0x9E3779B9u + 0x6A09E667u;
+
+   if ( state == 0 )
+   {
+      state = 1;
+   }
 
-   srandom ( 0 );
+   // seeds other than 0 shuffle the book's permutation (Fisher-Yates)
+   for ( i = 0; i < 256; i++ )
+   {
+      gen->perm[i] = bookPermTable[i];
+   }
+   if ( seed != 0 )
+   {
+      for ( i = 255; i > 0; i-- )
+      {
+         int j = ( int ) ( noiseRandom ( &state ) % ( unsigned int ) ( i + 1 ) );
+         unsigned char t = gen->perm[i];
+         gen->perm[i] = gen->perm[j];
+         gen->perm[j] = t;
+      }
+   }
 
-   // build gradient table for 3D noise
+   // build gradient table for 3D noise, uniformly distributed over the unit sphere
    for ( i = 0; i < 256; i++ )
    {
       /*
       * calculate 1 - 2 * random number
       */
-      a = ( random() % 32768 ) / 32768.0f;
+      a = noiseRandomFloat ( &state );
       z = ( 1.0f - 2.0f * a );
 
       r = sqrtf ( 1.0f - z * z ); // r is radius of circle
 
-      a = ( random() % 32768 ) / 32768.0f;
+      a = noiseRandomFloat ( &state );
       theta = ( 2.0f * ( float ) M_PI * a );
-      x = ( r * cosf ( a ) );
-      y = ( r * sinf ( a ) );
+      x = ( r * cosf ( theta ) );
+      y = ( r * sinf ( theta ) );
 
       gradients[i * 3] = x;
       gradients[i * 3 + 1] = y;
@@ -106,33 +157,58 @@ void initNoiseTable()
    }
 
    // use the index in the permutation table to load the
-   // gradient values from gradients to gradientTable
-   p = ( unsigned int * ) gradientTable;
-   psrc = ( unsigned int * ) gradients;
-
+   // gradient values from gradients to gen->gradients
    for ( i = 0; i < 256; i++ )
    {
-      int indx = permTable[i];
-      p[i * 3] = psrc[indx * 3];
-      p[i * 3 + 1] = psrc[indx * 3 + 1];
-      p[i * 3 + 2] = psrc[indx * 3 + 2];
+      int indx = gen->perm[i];
+      gen->gradients[i * 3] = gradients[indx * 3];
+      gen->gradients[i * 3 + 1] = gradients[indx * 3 + 1];
+      gen->gradients[i * 3 + 2] = gradients[indx * 3 + 2];
    }
+
+   gen->period = period > 256 ? 256 : ( period < 0 ? 0 : period );
+}
+
+// the generator behind noise3D, noise3D_grad, noise3D_grad4 and curlNoise3D
+static NoiseGenerator defaultNoise;
+
+void initNoiseTable()
+{
+   initNoiseGenerator ( &defaultNoise, 0, 0 );
 }
+
+//
+// the gradient vector assigned to lattice point (ix, iy, iz)
+//
+static const float *glatticeGradient ( const NoiseGenerator *gen, int ix, int iy, int iz )
+{
+   int   indx, y, z;
+
+   if ( gen->period > 0 )
+   {
+      ix %= gen->period;
+      iy %= gen->period;
+      iz %= gen->period;
+      ix += ix < 0 ? gen->period : 0;
+      iy += iy < 0 ? gen->period : 0;
+      iz += iz < 0 ? gen->period : 0;
+   }
+
+   z = gen->perm[iz & NOISE_TABLE_MASK];
+   y = gen->perm[ ( iy + z ) & NOISE_TABLE_MASK];
+   indx = ( ix + y ) & NOISE_TABLE_MASK;
+   return &gen->gradients[indx * 3];
+}
+
 //
 // generate the value of gradient noise for a given lattice point
 //
 // (ix, iy, iz) specifies the 3D lattice position
 // (fx, fy, fz) specifies the fractional part
 //
-static float glattice3D ( int ix, int iy, int iz, float fx, float fy, float fz )
+static float glattice3D ( const NoiseGenerator *gen, int ix, int iy, int iz, float fx, float fy, float fz )
 {
-   float *g;
-   int   indx, y, z;
-
-   z = permTable[iz & NOISE_TABLE_MASK];
-   y = permTable[ ( iy + z ) & NOISE_TABLE_MASK];
-   indx = ( ix + y ) & NOISE_TABLE_MASK;
-   g = &gradientTable[indx * 3];
+   const float *g = glatticeGradient ( gen, ix, iy, iz );
 
    return ( g[0] * fx + g[1] * fy + g[2] * fz );
 }
@@ -140,9 +216,9 @@ static float glattice3D ( int ix, int iy, int iz, float fx, float fy, float fz )
 //
 // generate the 3D noise value
 // f describes the input (x, y, z) position for which the noise value needs to be computed
-// noise3D returns the scalar noise value
+// noise3DGen returns the scalar noise value
 //
-float noise3D ( float *f )
+float noise3DGen ( const NoiseGenerator *gen, const float *f )
 {
    int   ix, iy, iz;
    float fx0, fx1, fy0, fy1, fz0, fz1;
@@ -164,83 +240,534 @@ float noise3D ( float *f )
    fz1 = fz0 - 1;
    wz = smoothstep ( fz0 );
 
-   vx0 = glattice3D ( ix, iy, iz, fx0, fy0, fz0 );
-   vx1 = glattice3D ( ix + 1, iy, iz, fx1, fy0, fz0 );
+   vx0 = glattice3D ( gen, ix, iy, iz, fx0, fy0, fz0 );
+   vx1 = glattice3D ( gen, ix + 1, iy, iz, fx1, fy0, fz0 );
    vy0 = lerp ( wx, vx0, vx1 );
-   vx0 = glattice3D ( ix, iy + 1, iz, fx0, fy1, fz0 );
-   vx1 = glattice3D ( ix + 1, iy + 1, iz, fx1, fy1, fz0 );
+   vx0 = glattice3D ( gen, ix, iy + 1, iz, fx0, fy1, fz0 );
+   vx1 = glattice3D ( gen, ix + 1, iy + 1, iz, fx1, fy1, fz0 );
    vy1 = lerp ( wx, vx0, vx1 );
    vz0 = lerp ( wy, vy0, vy1 );
 
-   vx0 = glattice3D ( ix, iy, iz + 1, fx0, fy0, fz1 );
-   vx1 = glattice3D ( ix + 1, iy, iz + 1, fx1, fy0, fz1 );
+   vx0 = glattice3D ( gen, ix, iy, iz + 1, fx0, fy0, fz1 );
+   vx1 = glattice3D ( gen, ix + 1, iy, iz + 1, fx1, fy0, fz1 );
    vy0 = lerp ( wx, vx0, vx1 );
-   vx0 = glattice3D ( ix, iy + 1, iz + 1, fx0, fy1, fz1 );
-   vx1 = glattice3D ( ix + 1, iy + 1, iz + 1, fx1, fy1, fz1 );
+   vx0 = glattice3D ( gen, ix, iy + 1, iz + 1, fx0, fy1, fz1 );
+   vx1 = glattice3D ( gen, ix + 1, iy + 1, iz + 1, fx1, fy1, fz1 );
    vy1 = lerp ( wx, vx0, vx1 );
    vz1 = lerp ( wy, vy0, vy1 );
 
    return lerp ( wz, vz0, vz1 );;
 }
 
-unsigned int Create3DNoiseTexture ( int textureSize, float frequency )
+// lerp along s, then t, of the corners c0 (0, 0), c1 (1, 0), c2 (0, 1), c3 (1, 1)
+static float bilerp ( float s, float t, float c0, float c1, float c2, float c3 )
 {
-   GLuint textureId;
-   GLfloat *texBuf = ( GLfloat * ) malloc ( sizeof ( GLfloat ) * textureSize * textureSize * textureSize ) ;
-   GLubyte *uploadBuf = ( GLubyte * ) malloc ( sizeof ( GLubyte ) * textureSize * textureSize * textureSize ) ;
-   int x, y, z;
-   int index = 0;
+   float v0 = lerp ( s, c0, c1 );
+   float v1 = lerp ( s, c2, c3 );
+   return lerp ( t, v0, v1 );
+}
+
+//
+// generate the 3D noise value and its gradient in one pass
+// f describes the input (x, y, z) position, grad receives (dn/dx, dn/dy, dn/dz)
+//
+// The value is the trilinear blend of the 8 corner values v = g . (f - corner), so its
+// derivative along x is the same blend of the corner gradients' x components plus
+// smoothstepDeriv(fx) times the x differences of the corner values (likewise y and z).
+// This costs the 8 lattice lookups of one noise3D call instead of 4 to 7 calls.
+//
+float noise3DGen_grad ( const NoiseGenerator *gen, const float *f, float *grad )
+{
+   int   ix, iy, iz, i;
+   float fx[2], fy[2], fz[2];
+   float wx, wy, wz;
+   float v[8], gx[8], gy[8], gz[8];
+   float value;
+
+   ix = FLOOR ( f[0] );
+   fx[0] = f[0] - ix;
+   fx[1] = fx[0] - 1;
+   wx = smoothstep ( fx[0] );
+
+   iy = FLOOR ( f[1] );
+   fy[0] = f[1] - iy;
+   fy[1] = fy[0] - 1;
+   wy = smoothstep ( fy[0] );
+
+   iz = FLOOR ( f[2] );
+   fz[0] = f[2] - iz;
+   fz[1] = fz[0] - 1;
+   wz = smoothstep ( fz[0] );
+
+   // corner i is at (ix + (i & 1), iy + ((i >> 1) & 1), iz + (i >> 2))
+   for ( i = 0; i < 8; i++ )
+   {
+      int cx = i & 1, cy = ( i >> 1 ) & 1, cz = i >> 2;
+      const float *g = glatticeGradient ( gen, ix + cx, iy + cy, iz + cz );
+      v[i] = g[0] * fx[cx] + g[1] * fy[cy] + g[2] * fz[cz];
+      gx[i] = g[0];
+      gy[i] = g[1];
+      gz[i] = g[2];
+   }
+
+   value = lerp ( wz, bilerp ( wx, wy, v[0], v[1], v[2], v[3] ), bilerp ( wx, wy, v[4], v[5], v[6], v[7] ) );
+
+   grad[0] = lerp ( wz, bilerp ( wx, wy, gx[0], gx[1], gx[2], gx[3] ), bilerp ( wx, wy, gx[4], gx[5], gx[6], gx[7] ) ) +
+             smoothstepDeriv ( fx[0] ) * bilerp ( wy, wz, v[1] - v[0], v[3] - v[2], v[5] - v[4], v[7] - v[6] );
+   grad[1] = lerp ( wz, bilerp ( wx, wy, gy[0], gy[1], gy[2], gy[3] ), bilerp ( wx, wy, gy[4], gy[5], gy[6], gy[7] ) ) +
+             smoothstepDeriv ( fy[0] ) * bilerp ( wx, wz, v[2] - v[0], v[3] - v[1], v[6] - v[4], v[7] - v[5] );
+   grad[2] = lerp ( wz, bilerp ( wx, wy, gz[0], gz[1], gz[2], gz[3] ), bilerp ( wx, wy, gz[4], gz[5], gz[6], gz[7] ) ) +
+             smoothstepDeriv ( fz[0] ) * bilerp ( wx, wy, v[4] - v[0], v[5] - v[1], v[6] - v[2], v[7] - v[3] );
+
+   return value;
+}
+
+#ifdef NOISE_SSE2
+static __m128 lerp4 ( __m128 t, __m128 a, __m128 b )
+{
+   return _mm_add_ps ( a, _mm_mul_ps ( t, _mm_sub_ps ( b, a ) ) );
+}
+
+static __m128 bilerp4 ( __m128 s, __m128 t, __m128 c0, __m128 c1, __m128 c2, __m128 c3 )
+{
+   return lerp4 ( t, lerp4 ( s, c0, c1 ), lerp4 ( s, c2, c3 ) );
+}
+#endif
+
+//
+// noise3DGen_grad of 4 points at once, x, y and z hold the 4 positions as separate arrays
+// and value, gradX, gradY and gradZ receive the 4 results the same way
+//
+// With SSE2 the arithmetic runs 4 wide and only the permutation table lookups are
+// done per lane, otherwise it falls back to 4 calls of noise3DGen_grad.
+//
+void noise3DGen_grad4 ( const NoiseGenerator *gen, const float *x, const float *y, const float *z,
+                        float *value, float *gradX, float *gradY, float *gradZ )
+{
+#ifdef NOISE_SSE2
+   const __m128 one = _mm_set1_ps ( 1.0f );
+   __m128 p[3], f0[3], f1[3], w[3], dw[3];
+   __m128 v[8], gx[8], gy[8], gz[8];
+   int    cell[3][4];
+   int    a, i, lane;
+
+   p[0] = _mm_loadu_ps ( x );
+   p[1] = _mm_loadu_ps ( y );
+   p[2] = _mm_loadu_ps ( z );
+   for ( a = 0; a < 3; a++ )
+   {
+      // FLOOR: truncate, then step down where truncation rounded up
+      __m128i c = _mm_cvttps_epi32 ( p[a] );
+      __m128  t = _mm_cvtepi32_ps ( c );
+      c = _mm_add_epi32 ( c, _mm_castps_si128 ( _mm_cmpgt_ps ( t, p[a] ) ) );
+      _mm_storeu_si128 ( ( __m128i * ) cell[a], c );
+
+      f0[a] = _mm_sub_ps ( p[a], _mm_cvtepi32_ps ( c ) );
+      f1[a] = _mm_sub_ps ( f0[a], one );
+      t = f0[a];
+      w[a] = _mm_mul_ps ( _mm_mul_ps ( _mm_mul_ps ( t, t ), t ),
+                          _mm_add_ps ( _mm_mul_ps ( t, _mm_sub_ps ( _mm_mul_ps ( t, _mm_set1_ps ( 6.0f ) ), _mm_set1_ps ( 15.0f ) ) ),
+                                       _mm_set1_ps ( 10.0f ) ) );
+      dw[a] = _mm_mul_ps ( _mm_mul_ps ( _mm_set1_ps ( 30.0f ), _mm_mul_ps ( t, t ) ),
+                           _mm_add_ps ( _mm_mul_ps ( t, _mm_sub_ps ( t, _mm_set1_ps ( 2.0f ) ) ), one ) );
+   }
+
+   for ( i = 0; i < 8; i++ )
+   {
+      int   cx = i & 1, cy = ( i >> 1 ) & 1, cz = i >> 2;
+      float g[3][4];
+      for ( lane = 0; lane < 4; lane++ )
+      {
+         const float *gr = glatticeGradient ( gen, cell[0][lane] + cx, cell[1][lane] + cy, cell[2][lane] + cz );
+         g[0][lane] = gr[0];
+         g[1][lane] = gr[1];
+         g[2][lane] = gr[2];
+      }
+      gx[i] = _mm_loadu_ps ( g[0] );
+      gy[i] = _mm_loadu_ps ( g[1] );
+      gz[i] = _mm_loadu_ps ( g[2] );
+      v[i] = _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( gx[i], cx ? f1[0] : f0[0] ),
+                                       _mm_mul_ps ( gy[i], cy ? f1[1] : f0[1] ) ),
+                          _mm_mul_ps ( gz[i], cz ? f1[2] : f0[2] ) );
+   }
+
+   _mm_storeu_ps ( value, lerp4 ( w[2], bilerp4 ( w[0], w[1], v[0], v[1], v[2], v[3] ),
+                                        bilerp4 ( w[0], w[1], v[4], v[5], v[6], v[7] ) ) );
+   _mm_storeu_ps ( gradX, _mm_add_ps (
+      lerp4 ( w[2], bilerp4 ( w[0], w[1], gx[0], gx[1], gx[2], gx[3] ), bilerp4 ( w[0], w[1], gx[4], gx[5], gx[6], gx[7] ) ),
+      _mm_mul_ps ( dw[0], bilerp4 ( w[1], w[2], _mm_sub_ps ( v[1], v[0] ), _mm_sub_ps ( v[3], v[2] ),
+                                                _mm_sub_ps ( v[5], v[4] ), _mm_sub_ps ( v[7], v[6] ) ) ) ) );
+   _mm_storeu_ps ( gradY, _mm_add_ps (
+      lerp4 ( w[2], bilerp4 ( w[0], w[1], gy[0], gy[1], gy[2], gy[3] ), bilerp4 ( w[0], w[1], gy[4], gy[5], gy[6], gy[7] ) ),
+      _mm_mul_ps ( dw[1], bilerp4 ( w[0], w[2], _mm_sub_ps ( v[2], v[0] ), _mm_sub_ps ( v[3], v[1] ),
+                                                _mm_sub_ps ( v[6], v[4] ), _mm_sub_ps ( v[7], v[5] ) ) ) ) );
+   _mm_storeu_ps ( gradZ, _mm_add_ps (
+      lerp4 ( w[2], bilerp4 ( w[0], w[1], gz[0], gz[1], gz[2], gz[3] ), bilerp4 ( w[0], w[1], gz[4], gz[5], gz[6], gz[7] ) ),
+      _mm_mul_ps ( dw[2], bilerp4 ( w[0], w[1], _mm_sub_ps ( v[4], v[0] ), _mm_sub_ps ( v[5], v[1] ),
+                                                _mm_sub_ps ( v[6], v[2] ), _mm_sub_ps ( v[7], v[3] ) ) ) ) );
+#else
+   int lane;
+
+   for ( lane = 0; lane < 4; lane++ )
+   {
+      float pos[3] = { x[lane], y[lane], z[lane] };
+      float grad[3];
+      value[lane] = noise3DGen_grad ( gen, pos, grad );
+      gradX[lane] = grad[0];
+      gradY[lane] = grad[1];
+      gradZ[lane] = grad[2];
+   }
+#endif
+}
+
+//
+// noise3D, noise3D_grad and noise3D_grad4 use the generator set up by initNoiseTable
+//
+float noise3D ( float *f )
+{
+   return noise3DGen ( &defaultNoise, f );
+}
+
+float noise3D_grad ( const float *f, float *grad )
+{
+   return noise3DGen_grad ( &defaultNoise, f, grad );
+}
+
+void noise3D_grad4 ( const float *x, const float *y, const float *z,
+                     float *value, float *gradX, float *gradY, float *gradZ )
+{
+   noise3DGen_grad4 ( &defaultNoise, x, y, z, value, gradX, gradY, gradZ );
+}
+
+//
+// lattice position of voxel (x, y, z) in a volume of textureSize^3 voxels
+//
+static void voxelPosition ( int x, int y, int z, int textureSize, float frequency, float *pos )
+{
+   pos[0] = ( float ) x / ( float ) textureSize * frequency;
+   pos[1] = ( float ) y / ( float ) textureSize * frequency;
+   pos[2] = ( float ) z / ( float ) textureSize * frequency;
+}
+
+//
+// generate the noise volume on the CPU
+// uploadBuf receives textureSize^3 bytes normalized to the [0, 255] range
+//
+// The voxel loops run in parallel over z slices when built with OpenMP,
+// the min/max search stays serial so the result doesn't depend on the thread count.
+//
+void Generate3DNoise ( const NoiseGenerator *gen, int textureSize, float frequency, unsigned char *uploadBuf )
+{
+   float *texBuf = ( float * ) malloc ( sizeof ( float ) * textureSize * textureSize * textureSize ) ;
+   int z;
+   int index;
+   int count = textureSize * textureSize * textureSize;
    float min = 1000;
    float max = -1000;
    float range;
 
-   initNoiseTable();
-
+   #pragma omp parallel for schedule(static)
    for ( z = 0; z < textureSize; z++ )
    {
+      int x, y;
+      float *slice = texBuf + z * textureSize * textureSize;
       for ( y = 0; y < textureSize; y++ )
       {
          for ( x = 0; x < textureSize; x++ )
          {
-            float noiseVal;
-            float pos[3] = { ( float ) x / ( float ) textureSize, ( float ) y / ( float ) textureSize, ( float ) z  / ( float ) textureSize };
-            pos[0] *= frequency;
-            pos[1] *= frequency;
-            pos[2] *= frequency;
-            noiseVal = noise3D ( pos );
-
-            if ( noiseVal < min )
+            float pos[3];
+            voxelPosition ( x, y, z, textureSize, frequency, pos );
+            *slice++ = noise3DGen ( gen, pos );
+         }
+      }
+   }
+
+   for ( index = 0; index < count; index++ )
+   {
+      if ( texBuf[index] < min )
+      {
+         min = texBuf[index];
+      }
+
+      if ( texBuf[index] > max )
+      {
+         max = texBuf[index];
+      }
+   }
+
+   // Normalize to the [0, 1] range
+   range = ( max - min );
+
+   #pragma omp parallel for schedule(static)
+   for ( index = 0; index < count; index++ )
+   {
+      float noiseVal = texBuf[index];
+      noiseVal = ( noiseVal - min ) / range;
+      uploadBuf[index] = ( unsigned char ) ( noiseVal * 255.0f );
+   }
+
+   free ( texBuf );
+}
+
+//
+// curl of the vector potential (noise3D(p), noise3D(p + CURL_OFFSET_Y), noise3D(p + CURL_OFFSET_Z))
+// the three components are decorrelated by offsetting the lookups far apart in the lattice
+//
+#define CURL_OFFSET_Y   31.416f
+#define CURL_OFFSET_Z   -47.853f
+
+static const float curlOffset[3] = { 0.0f, CURL_OFFSET_Y, CURL_OFFSET_Z };
+
+// curl from the gradients g0, g1, g2 of the three potential components
+static void curlFromGradients ( const float *g0, const float *g1, const float *g2, float *curl )
+{
+   curl[0] = g2[1] - g1[2];
+   curl[1] = g0[2] - g2[0];
+   curl[2] = g1[0] - g0[1];
+}
+
+void curlNoise3DGen ( const NoiseGenerator *gen, const float *p, float *curl )
+{
+   float g[3][3];
+   int   c;
+
+   for ( c = 0; c < 3; c++ )
+   {
+      float pos[3] = { p[0] + curlOffset[c], p[1] + curlOffset[c], p[2] + curlOffset[c] };
+      noise3DGen_grad ( gen, pos, g[c] );
+   }
+   curlFromGradients ( g[0], g[1], g[2], curl );
+}
+
+void curlNoise3D ( const float *p, float *curl )
+{
+   curlNoise3DGen ( &defaultNoise, p, curl );
+}
+
+//
+// generate a divergence-free vector volume on the CPU
+// curlBuf receives textureSize^3 RGB triples scaled so the longest vector has length 1
+//
+void Generate3DCurlNoise ( const NoiseGenerator *gen, int textureSize, float frequency, float *curlBuf )
+{
+   int z;
+   int index;
+   int count = textureSize * textureSize * textureSize;
+   float maxLength = 0.0f;
+
+   #pragma omp parallel for schedule(static)
+   for ( z = 0; z < textureSize; z++ )
+   {
+      int x, y;
+      float *slice = curlBuf + z * textureSize * textureSize * 3;
+      for ( y = 0; y < textureSize; y++ )
+      {
+         // 4 voxels of the row at a time through noise3D_grad4
+         for ( x = 0; x + 4 <= textureSize; x += 4 )
+         {
+            float px[3][4], value[4], g[3][3][4];
+            int   c, lane;
+            for ( lane = 0; lane < 4; lane++ )
             {
-               min = noiseVal;
+               float pos[3];
+               voxelPosition ( x + lane, y, z, textureSize, frequency, pos );
+               px[0][lane] = pos[0];
+               px[1][lane] = pos[1];
+               px[2][lane] = pos[2];
             }
-
-            if ( noiseVal > max )
+            for ( c = 0; c < 3; c++ )
+            {
+               float cx[4], cy[4], cz[4];
+               for ( lane = 0; lane < 4; lane++ )
+               {
+                  cx[lane] = px[0][lane] + curlOffset[c];
+                  cy[lane] = px[1][lane] + curlOffset[c];
+                  cz[lane] = px[2][lane] + curlOffset[c];
+               }
+               noise3DGen_grad4 ( gen, cx, cy, cz, value, g[c][0], g[c][1], g[c][2] );
+            }
+            for ( lane = 0; lane < 4; lane++ )
             {
-               max = noiseVal;
+               float g0[3] = { g[0][0][lane], g[0][1][lane], g[0][2][lane] };
+               float g1[3] = { g[1][0][lane], g[1][1][lane], g[1][2][lane] };
+               float g2[3] = { g[2][0][lane], g[2][1][lane], g[2][2][lane] };
+               curlFromGradients ( g0, g1, g2, slice );
+               slice += 3;
             }
+         }
+         for ( ; x < textureSize; x++ )
+         {
+            float pos[3];
+            voxelPosition ( x, y, z, textureSize, frequency, pos );
+            curlNoise3DGen ( gen, pos, slice );
+            slice += 3;
+         }
+      }
+   }
 
-            texBuf[ index++ ] = noiseVal;
+   for ( index = 0; index < count; index++ )
+   {
+      float *c = curlBuf + index * 3;
+      float length = sqrtf ( c[0] * c[0] + c[1] * c[1] + c[2] * c[2] );
+      if ( length > maxLength )
+      {
+         maxLength = length;
+      }
+   }
+
+   if ( maxLength > 0.0f )
+   {
+      #pragma omp parallel for schedule(static)
+      for ( index = 0; index < count * 3; index++ )
+      {
+         curlBuf[index] /= maxLength;
+      }
+   }
+}
+
+//
+// generate a multi-octave (fBm or ridged) volume on the CPU, the octaves are split into
+// 4 bands, band c summed into channel c of rgbaBuf (textureSize^3 RGBA bytes)
+//
+// Octave o samples at frequency * lacunarity^o with amplitude gain^o, ridged octaves
+// use (1 - |n|)^2 instead of n. Every band is normalized to [0, 255] on its own,
+// bandScale[c] and bandBias[c] receive its range and minimum so the fractal is
+//    dot ( texel, bandScale ) + bandBias[0] + bandBias[1] + bandBias[2] + bandBias[3]
+// from one texture fetch, and each band can also be used alone for coarse or fine detail.
+// A periodic generator with frequency == period keeps tiling when lacunarity is an integer.
+// Its octave o wraps at period * lacunarity^o cells, and since the lattice can't wrap at
+// more than 256 the octaves past that are left out (e.g. period 4 and lacunarity 2 keep
+// 7 octaves, period 100 and lacunarity 3 keeps 1).
+//
+#define NOISE_MAX_OCTAVES  16
+
+void Generate3DFractalNoise ( const NoiseGenerator *gen, int textureSize, float frequency,
+                              int octaves, float lacunarity, float gain, int ridged,
+                              unsigned char *rgbaBuf, float *bandScale, float *bandBias )
+{
+   float *texBuf = ( float * ) malloc ( sizeof ( float ) * 4 * textureSize * textureSize * textureSize ) ;
+   NoiseGenerator *octaveGen = ( NoiseGenerator * ) malloc ( sizeof ( NoiseGenerator ) * NOISE_MAX_OCTAVES );
+   float octaveScale[NOISE_MAX_OCTAVES];
+   float octaveAmp[NOISE_MAX_OCTAVES];
+   int   octaveBand[NOISE_MAX_OCTAVES];
+   float min[4] = { 1000, 1000, 1000, 1000 };
+   float max[4] = { -1000, -1000, -1000, -1000 };
+   float range[4];
+   int   count = textureSize * textureSize * textureSize;
+   int   o, c, z, index;
+
+   octaves = octaves < 1 ? 1 : ( octaves > NOISE_MAX_OCTAVES ? NOISE_MAX_OCTAVES : octaves );
+   if ( gen->period > 0 )
+   {
+      float scale = lacunarity;
+      for ( o = 1; o < octaves; o++, scale *= lacunarity )
+      {
+         if ( gen->period * scale + 0.5f > 256.0f )
+         {
+            octaves = o;
+            break;
          }
       }
    }
+   for ( o = 0; o < octaves; o++ )
+   {
+      octaveScale[o] = o == 0 ? 1.0f : octaveScale[o - 1] * lacunarity;
+      octaveAmp[o] = o == 0 ? 1.0f : octaveAmp[o - 1] * gain;
+      octaveBand[o] = octaves <= 4 ? o : o * 4 / octaves;
 
-   // Normalize to the [0, 1] range
-   range = ( max - min );
-   index = 0;
+      // the lattice period grows with the frequency of the octave
+      octaveGen[o] = *gen;
+      if ( gen->period > 0 )
+      {
+         octaveGen[o].period = ( int ) ( gen->period * octaveScale[o] + 0.5f );
+      }
+   }
 
+   #pragma omp parallel for schedule(static)
    for ( z = 0; z < textureSize; z++ )
    {
+      int x, y, i;
+      float *slice = texBuf + z * textureSize * textureSize * 4;
       for ( y = 0; y < textureSize; y++ )
       {
          for ( x = 0; x < textureSize; x++ )
          {
-            float noiseVal = texBuf[index];
-            noiseVal = ( noiseVal - min ) / range;
-            uploadBuf[index++] = ( GLubyte ) ( noiseVal * 255.0f );
+            float pos[3];
+            voxelPosition ( x, y, z, textureSize, frequency, pos );
+            slice[0] = slice[1] = slice[2] = slice[3] = 0.0f;
+            for ( i = 0; i < octaves; i++ )
+            {
+               // whole lattice offsets decorrelate the octaves without breaking the period
+               float offset = ( float ) ( i * 17 );
+               float p[3] = { pos[0] * octaveScale[i] + offset, pos[1] * octaveScale[i] + offset, pos[2] * octaveScale[i] + offset };
+               float n = noise3DGen ( &octaveGen[i], p );
+               if ( ridged )
+               {
+                  n = 1.0f - fabsf ( n );
+                  n *= n;
+               }
+               slice[octaveBand[i]] += n * octaveAmp[i];
+            }
+            slice += 4;
          }
       }
    }
 
+   for ( index = 0; index < count; index++ )
+   {
+      for ( c = 0; c < 4; c++ )
+      {
+         float v = texBuf[index * 4 + c];
+         if ( v < min[c] )
+         {
+            min[c] = v;
+         }
+
+         if ( v > max[c] )
+         {
+            max[c] = v;
+         }
+      }
+   }
+
+   // bands without octaves stay 0
+   for ( c = 0; c < 4; c++ )
+   {
+      range[c] = max[c] - min[c];
+      bandScale[c] = range[c];
+      bandBias[c] = min[c];
+   }
+
+   #pragma omp parallel for schedule(static)
+   for ( index = 0; index < count * 4; index++ )
+   {
+      float r = range[index & 3];
+      float noiseVal = r > 0.0f ? ( texBuf[index] - min[index & 3] ) / r : 0.0f;
+      rgbaBuf[index] = ( unsigned char ) ( noiseVal * 255.0f );
+   }
+
+   free ( octaveGen );
+   free ( texBuf );
+}
+
+#ifndef PARTICLE_NO_GL
+// periodic generators tile, so their volumes repeat instead of mirroring
+static void setNoiseTextureWrap ( const NoiseGenerator *gen )
+{
+   GLint wrap = gen->period > 0 ? GL_REPEAT : GL_MIRRORED_REPEAT;
+
+   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, wrap );
+   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, wrap );
+   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, wrap );
+}
+
+unsigned int Create3DNoiseTexture ( const NoiseGenerator *gen, int textureSize, float frequency )
+{
+   GLuint textureId;
+   GLubyte *uploadBuf = ( GLubyte * ) malloc ( sizeof ( GLubyte ) * textureSize * textureSize * textureSize ) ;
+
+   Generate3DNoise ( gen, textureSize, frequency, uploadBuf );
+
    glGenTextures ( 1, &textureId );
    glBindTexture ( GL_TEXTURE_3D, textureId );
    glTexImage3D ( GL_TEXTURE_3D, 0, GL_R8, textureSize, textureSize, textureSize, 0,
@@ -248,15 +775,57 @@ unsigned int Create3DNoiseTexture ( int textureSize, float frequency )
 
    glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
    glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT );
-   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT );
-   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_MIRRORED_REPEAT );
+   setNoiseTextureWrap ( gen );
 
    glBindTexture ( GL_TEXTURE_3D, 0 );
 
-   free ( texBuf );
    free ( uploadBuf );
 
    return textureId;
 }
+#endif
 
+#ifndef PARTICLE_NO_GL
+// GL_RGB16F volume of Generate3DCurlNoise, maxLength (may be NULL) receives the length of
+// its longest vector as the texture holds it, so nothing has to read the texture back
+unsigned int Create3DCurlNoiseTexture ( const NoiseGenerator *gen, int textureSize, float frequency, float *maxLength )
+{
+   GLuint textureId;
+   int    count = textureSize * textureSize * textureSize;
+   int    index;
+   GLfloat *curlBuf = ( GLfloat * ) malloc ( sizeof ( GLfloat ) * 3 * count ) ;
+
+   Generate3DCurlNoise ( gen, textureSize, frequency, curlBuf );
+
+   if ( maxLength )
+   {
+      float longest = 0.0f;
+      for ( index = 0; index < count; index++ )
+      {
+         float *c = curlBuf + index * 3;
+         float length = sqrtf ( c[0] * c[0] + c[1] * c[1] + c[2] * c[2] );
+         if ( length > longest )
+         {
+            longest = length;
+         }
+      }
+      // a half float rounds each component by up to 2^-11 of itself
+      *maxLength = longest * ( 1.0f + 1.0f / 2048.0f );
+   }
+
+   glGenTextures ( 1, &textureId );
+   glBindTexture ( GL_TEXTURE_3D, textureId );
+   glTexImage3D ( GL_TEXTURE_3D, 0, GL_RGB16F, textureSize, textureSize, textureSize, 0,
+                  GL_RGB, GL_FLOAT, curlBuf );
+
+   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+   glTexParameteri ( GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+   setNoiseTextureWrap ( gen );
+
+   glBindTexture ( GL_TEXTURE_3D, 0 );
+
+   free ( curlBuf );
+
+   return textureId;
+}
+#endif
@@ -0,0 +1,841 @@
+// Benchmark suite for the particle system stages.
+// Every case runs a fixed, seeded workload and the results are written as JSON
+// (same shape as Google Benchmark's --benchmark_format=json) so they can be
+// tracked commit over commit.
+//
+// bench [--filter <substring>] [--json <file>] [--min-time <seconds>] [--quick] [--assets <dir>]
+//       [--baseline <file>]
+//
+// --baseline takes the JSON of an earlier run (another commit, a non-PGO build, ...)
+// and reports each case's median relative to it.
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef PARTICLE_NO_GL
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "shader.h"
+#include "textureRegistry.h"
+#endif
+
+#include "particle.h"
+#include "simInput.h"
+#include "cpuSimulator.h"
+#include "spatialGrid.h"
+#include "depthSort.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "textureCompression.h"
+#include "mipmaps.h"
+#include "Noise3D.c"
+
+// results go here so the optimizer can't drop the work
+static volatile float benchSink;
+
+struct BenchCase {
+    std::string name;
+    double items; // work items per run, for items_per_second
+    std::function<void()> setup;
+    std::function<void()> run;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t iterations;
+    double minNs, medianNs, meanNs;
+    double itemsPerSecond;
+    double baselineNs = 0.0; // 0 when the baseline has no such case
+};
+
+// reads back name -> real_time from a file written by writeJson
+static std::map<std::string, double> readBaseline(const std::string& path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open baseline: " << path << std::endl;
+        return baseline;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find("\"name\": \"");
+        size_t time = line.find("\"real_time\": ");
+        if (name == std::string::npos || time == std::string::npos)
+            continue;
+        name += 9;
+        baseline[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(time + 13));
+    }
+    return baseline;
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// one warmup run, then runs until minTime has passed (at least 3, at most 1000)
+static BenchResult runCase(const BenchCase& c, double minTime)
+{
+    if (c.setup)
+        c.setup();
+    c.run();
+    std::vector<double> times;
+    double total = 0.0;
+    while (times.size() < 3 || (total < minTime * 1e9 && times.size() < 1000)) {
+        auto start = std::chrono::steady_clock::now();
+        c.run();
+        times.push_back(elapsedNs(start));
+        total += times.back();
+    }
+    std::sort(times.begin(), times.end());
+    BenchResult r;
+    r.name = c.name;
+    r.iterations = times.size();
+    r.minNs = times.front();
+    r.medianNs = times[times.size() / 2];
+    r.meanNs = total / times.size();
+    r.itemsPerSecond = c.items / (r.medianNs * 1e-9);
+    return r;
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+#if defined(__clang__)
+    out << "    \"compiler\": \"clang " << __clang_major__ << "." << __clang_minor__ << "\",\n";
+#elif defined(__GNUC__)
+    out << "    \"compiler\": \"gcc " << __GNUC__ << "." << __GNUC_MINOR__ << "\",\n";
+#elif defined(_MSC_VER)
+    out << "    \"compiler\": \"msvc " << _MSC_VER << "\",\n";
+#endif
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"real_time\": " << r.medianNs << ", \"min_time\": " << r.minNs << ", \"mean_time\": " << r.meanNs
+            << ", \"time_unit\": \"ns\", \"items_per_second\": " << r.itemsPerSecond;
+        if (r.baselineNs > 0.0)
+            out << ", \"baseline_time\": " << r.baselineNs << ", \"delta_percent\": " << (r.medianNs / r.baselineNs - 1.0) * 100.0;
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void randomParticles(ParticleStreams& streams, size_t n, float time)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    streams.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        streams.posX[i] = unit(rng) * 2.0f - 1.0f;
+        streams.posY[i] = unit(rng) * 2.0f - 1.0f;
+        streams.velX[i] = unit(rng) * 2.0f - 1.0f;
+        streams.velY[i] = unit(rng) * 1.4f + 1.0f;
+        streams.size[i] = unit(rng) * 20.0f + 60.0f;
+        streams.lifetime[i] = 2.0f;
+        streams.curtime[i] = time - unit(rng) * 2.5f;
+    }
+}
+
+static std::vector<unsigned char> readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char** argv) {
+    std::string filter, jsonPath, baselinePath, assets = ".";
+    double minTime = 0.5;
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--json" && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            minTime = std::stod(argv[++i]);
+        else if (arg == "--quick")
+            quick = true;
+        else if (arg == "--assets" && i + 1 < argc)
+            assets = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc)
+            baselinePath = argv[++i];
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<BenchCase> cases;
+
+    // ------------------------------------------------ noise
+    // the app's generators, see main.cpp
+    static NoiseGenerator emitNoise, curlNoise;
+    initNoiseGenerator(&emitNoise, 0, 0);
+    initNoiseGenerator(&curlNoise, 1, 4);
+
+    static std::vector<unsigned char> volume;
+    for (int size : { 32, 64, 128 }) {
+        cases.push_back({ "noise/texture/" + std::to_string(size), (double)size * size * size,
+            [size]() { volume.resize((size_t)size * size * size); },
+            [size]() { Generate3DNoise(&emitNoise, size, 50.0f, volume.data()); } });
+    }
+
+    const size_t NOISE_POINTS = 1 << 20;
+    cases.push_back({ "noise/noise3D", (double)NOISE_POINTS, []() { initNoiseTable(); },
+        [NOISE_POINTS]() {
+            float sum = 0.0f;
+            for (size_t i = 0; i < NOISE_POINTS; ++i) {
+                float pos[3] = { (i & 127) * 0.37f, ((i >> 7) & 127) * 0.37f, (i >> 14) * 0.37f };
+                sum += noise3D(pos);
+            }
+            benchSink = sum;
+        } });
+
+    // value + gradient, finite differences (value and 6 central difference lookups)
+    // against the analytic noise3D_grad and its 4 wide noise3D_grad4
+    cases.push_back({ "noise/gradient/finite_difference", (double)NOISE_POINTS, []() { initNoiseTable(); },
+        [NOISE_POINTS]() {
+            const float eps = 1e-3f;
+            float sum = 0.0f;
+            for (size_t i = 0; i < NOISE_POINTS; ++i) {
+                float pos[3] = { (i & 127) * 0.37f, ((i >> 7) & 127) * 0.37f, (i >> 14) * 0.37f };
+                float grad[3];
+                for (int a = 0; a < 3; ++a) {
+                    float hi[3] = { pos[0], pos[1], pos[2] }, lo[3] = { pos[0], pos[1], pos[2] };
+                    hi[a] += eps;
+                    lo[a] -= eps;
+                    grad[a] = (noise3D(hi) - noise3D(lo)) / (2.0f * eps);
+                }
+                sum += noise3D(pos) + grad[0] + grad[1] + grad[2];
+            }
+            benchSink = sum;
+        } });
+    cases.push_back({ "noise/gradient/analytic", (double)NOISE_POINTS, []() { initNoiseTable(); },
+        [NOISE_POINTS]() {
+            float sum = 0.0f;
+            for (size_t i = 0; i < NOISE_POINTS; ++i) {
+                float pos[3] = { (i & 127) * 0.37f, ((i >> 7) & 127) * 0.37f, (i >> 14) * 0.37f };
+                float grad[3];
+                sum += noise3D_grad(pos, grad) + grad[0] + grad[1] + grad[2];
+            }
+            benchSink = sum;
+        } });
+    cases.push_back({ "noise/gradient/analytic4", (double)NOISE_POINTS, []() { initNoiseTable(); },
+        [NOISE_POINTS]() {
+            float sum = 0.0f;
+            for (size_t i = 0; i < NOISE_POINTS; i += 4) {
+                float x[4], y[4], z[4], value[4], gx[4], gy[4], gz[4];
+                for (size_t lane = 0; lane < 4; ++lane) {
+                    x[lane] = ((i + lane) & 127) * 0.37f;
+                    y[lane] = (((i + lane) >> 7) & 127) * 0.37f;
+                    z[lane] = ((i + lane) >> 14) * 0.37f;
+                }
+                noise3D_grad4(x, y, z, value, gx, gy, gz);
+                for (size_t lane = 0; lane < 4; ++lane)
+                    sum += value[lane] + gx[lane] + gy[lane] + gz[lane];
+            }
+            benchSink = sum;
+        } });
+
+    static std::vector<float> curlVolume;
+    for (int size : { 32, 64 }) {
+        cases.push_back({ "noise/curl/" + std::to_string(size), (double)size * size * size,
+            [size]() { curlVolume.resize((size_t)size * size * size * 3); },
+            [size]() { Generate3DCurlNoise(&curlNoise, size, 4.0f, curlVolume.data()); } });
+    }
+
+    // 8 octaves baked into the 4 RGBA bands
+    static std::vector<unsigned char> fractalVolume;
+    for (int ridged : { 0, 1 }) {
+        cases.push_back({ std::string("noise/fractal/") + (ridged ? "ridged" : "fbm") + "/64", 64.0 * 64 * 64,
+            []() { fractalVolume.resize((size_t)64 * 64 * 64 * 4); },
+            [ridged]() {
+                float scale[4], bias[4];
+                Generate3DFractalNoise(&curlNoise, 64, 4.0f, 8, 2.0f, 0.5f, ridged, fractalVolume.data(), scale, bias);
+                benchSink = scale[0];
+            } });
+    }
+
+    // ------------------------------------------------ cpu simulation
+    static CpuSimulator sim;
+    static std::vector<glm::vec3> drawOut;
+    auto loadVolumes = []() {
+        if (sim.noise.size == 0) {
+            sim.noise.size = 128;
+            sim.noise.texels.resize(128 * 128 * 128);
+            Generate3DNoise(&emitNoise, 128, 50.0f, sim.noise.texels.data());
+            sim.curl.size = 64;
+            sim.curl.repeat = curlNoise.period > 0;
+            sim.curl.texels.resize(64 * 64 * 64 * 3);
+            Generate3DCurlNoise(&curlNoise, 64, 4.0f, sim.curl.texels.data());
+        }
+    };
+    std::vector<size_t> counts = { 10000, 100000, 1000000, 10000000 };
+    if (quick)
+        counts.pop_back();
+    for (size_t n : counts) {
+        FrameInput input;
+        input.time = 10.0f;
+        cases.push_back({ "sim/integrate/" + std::to_string(n), (double)n,
+            [n, input, loadVolumes]() { loadVolumes(); randomParticles(sim.streams, n, input.time); },
+            [input]() { sim.advect(input, 0.001f); } });
+    }
+
+    static std::vector<Particle> aos;
+    const size_t LAYOUT_COUNT = 1000000;
+    cases.push_back({ "layout/aos_to_soa/" + std::to_string(LAYOUT_COUNT), (double)LAYOUT_COUNT,
+        [LAYOUT_COUNT]() { randomParticles(sim.streams, LAYOUT_COUNT, 10.0f); streamsToParticles(sim.streams, aos); },
+        []() { particlesToStreams(aos, sim.streams); } });
+    cases.push_back({ "layout/soa_to_aos/" + std::to_string(LAYOUT_COUNT), (double)LAYOUT_COUNT,
+        [LAYOUT_COUNT]() { randomParticles(sim.streams, LAYOUT_COUNT, 10.0f); },
+        []() { streamsToParticles(sim.streams, aos); } });
+
+    // the whole headless frame: emit/advect step plus the draw.vert attributes
+    for (size_t n : { (size_t)200, (size_t)100000 }) {
+        static float frameTime;
+        cases.push_back({ "frame/headless/" + std::to_string(n), (double)n,
+            [n, loadVolumes]() {
+                loadVolumes();
+                sim.init(n);
+                frameTime = 0.0f;
+            },
+            []() {
+                FrameInput input;
+                frameTime += 0.001f;
+                input.time = frameTime;
+                sim.step(input);
+                sim.drawAttributes(input, drawOut);
+            } });
+    }
+
+    // collisions against the demo scene padded with colliders away from the emitter,
+    // the broad phase keeps the cost close to the one of the 4 demo colliders
+    for (size_t total : { (size_t)4, (size_t)64, (size_t)4096 }) {
+        static float collideTime;
+        cases.push_back({ "sim/collide/" + std::to_string(total), 100000.0,
+            [total, loadVolumes]() {
+                loadVolumes();
+                if (sim.sdf.size == 0)
+                    bakeDemoSdf(sim.sdf, "");
+                demoColliders(sim.colliders, sim.sdf);
+                for (size_t i = sim.colliders.size(); i < total; ++i)
+                    sim.colliders.push_back(Collider::sphere(glm::vec3(100.0f + (float)i, 0.0f, 0.0f), 0.5f));
+                sim.init(100000);
+                collideTime = 0.0f;
+            },
+            []() {
+                FrameInput input;
+                collideTime += 0.001f;
+                input.time = collideTime;
+                input.collisions = true;
+                sim.step(input);
+            } });
+    }
+
+    // the demo force fields repeated to 4, 16 and 32 fields, evaluated in one pass
+    for (size_t total : { (size_t)4, (size_t)16, (size_t)32 }) {
+        static float fieldTime;
+        cases.push_back({ "sim/fields/" + std::to_string(total), 100000.0,
+            [total, loadVolumes]() {
+                loadVolumes();
+                std::vector<ForceField> demo;
+                demoForceFields(demo);
+                sim.forceFields.clear();
+                for (size_t i = 0; i < total; ++i)
+                    sim.forceFields.push_back(demo[i % demo.size()]);
+                sim.init(100000);
+                fieldTime = 0.0f;
+            },
+            []() {
+                FrameInput input;
+                fieldTime += 0.001f;
+                input.time = fieldTime;
+                input.forceFields = true;
+                sim.step(input);
+            } });
+    }
+
+    // screen space collisions against the rasterized demo mesh, and the rasterization
+    static TriangleMesh depthMesh;
+    static float depthTime;
+    cases.push_back({ "sim/depth/100000", 100000.0,
+        [loadVolumes]() {
+            loadVolumes();
+            demoMesh(depthMesh);
+            sim.depth.resize(DEPTH_WIDTH, DEPTH_HEIGHT, sceneViewProjection());
+            rasterizeDepth(depthMesh, sim.depth);
+            sim.init(100000);
+            depthTime = 0.0f;
+        },
+        []() {
+            FrameInput input;
+            depthTime += 0.001f;
+            input.time = depthTime;
+            input.depthCollision = true;
+            sim.step(input);
+        } });
+    cases.push_back({ "depth/rasterize/torus", (double)DEPTH_WIDTH * DEPTH_HEIGHT,
+        []() {
+            demoMesh(depthMesh);
+            sim.depth.resize(DEPTH_WIDTH, DEPTH_HEIGHT, sceneViewProjection());
+        },
+        []() { rasterizeDepth(depthMesh, sim.depth); } });
+
+    // back to front sort under a perspective camera: from scratch every time, and
+    // incremental while the particles move a frame's worth (0.001 s, the app's step).
+    // An effect's thousand particles stay nearly sorted, a million are too dense for
+    // that and measure the fallback to the radix sort.
+    static DepthSorter depthSorter;
+    static ParticleStreams sortStreams;
+    static glm::mat4 sortCamera;
+    for (size_t n : { (size_t)1000, (size_t)1000000 }) {
+        for (bool incremental : { false, true }) {
+            cases.push_back({ std::string("sort/depth/") + (incremental ? "incremental/" : "full/") + std::to_string(n), (double)n,
+                [n]() {
+                    randomParticles(sortStreams, n, 10.0f);
+                    for (size_t i = 0; i < n; ++i)
+                        sortStreams.posZ[i] = sortStreams.posX[i] * sortStreams.posY[i];
+                    sortCamera = glm::perspective(60.0f, 4.0f / 3.0f, 0.1f, 10.0f) * glm::lookAt(glm::vec3(1.5f, 0.5f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                    depthSorter.reset();
+                    depthSorter.sort(sortStreams, 10.0f, sortCamera);
+                },
+                [incremental, n]() {
+                    if (incremental) {
+                        for (size_t i = 0; i < n; ++i) {
+                            sortStreams.posX[i] += sortStreams.velX[i] * 0.001f;
+                            sortStreams.posY[i] += sortStreams.velY[i] * 0.001f;
+                        }
+                    }
+                    else {
+                        depthSorter.reset();
+                    }
+                    benchSink = (float)depthSorter.sort(sortStreams, 10.0f, sortCamera).size();
+                } });
+        }
+    }
+
+    // SDF bake of a 6k triangle torus, without the cache
+    static TriangleMesh sdfMesh;
+    static SdfVolume sdfVolume;
+    for (int size : { 32, 64 }) {
+        cases.push_back({ "sdf/bake/" + std::to_string(size), (double)size * size * size,
+            []() { makeTorus(sdfMesh, glm::vec3(0.0f), 0.6f, 0.2f, 96, 32); },
+            [size]() { bakeSdf(sdfMesh, size, 0.1f, sdfVolume); } });
+    }
+
+    // ------------------------------------------------ neighbor grid
+    // uniform positions in [-1, 1]^3 with the radius chosen for ~30 neighbors per particle
+    static ParticleStreams gridStreams;
+    static SpatialGrid grid;
+    for (size_t n : { (size_t)100000, (size_t)1000000 }) {
+        float radius = std::cbrt(30.0f * 8.0f * 3.0f / (4.0f * 3.14159265f * (float)n));
+        auto setup = [n, radius]() {
+            std::mt19937 rng(2);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            gridStreams.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                gridStreams.posX[i] = unit(rng);
+                gridStreams.posY[i] = unit(rng);
+                gridStreams.posZ[i] = unit(rng);
+            }
+            grid.build(gridStreams, radius);
+        };
+        cases.push_back({ "grid/build/" + std::to_string(n), (double)n, setup,
+            [radius]() { grid.build(gridStreams, radius); } });
+        cases.push_back({ "grid/query/" + std::to_string(n), (double)n, setup,
+            [radius]() {
+                size_t found = 0;
+                for (uint32_t i : grid.order())
+                    grid.forEachNeighbor(i, radius, [&found](uint32_t, float) { ++found; });
+                benchSink = (float)found;
+            } });
+    }
+
+    // ------------------------------------------------ textures
+    static std::vector<unsigned char> tga;
+    std::string smokePath = assets + "/textures/smoke.tga";
+    cases.push_back({ "texture/decode/smoke.tga", 1.0,
+        [smokePath]() { tga = readFile(smokePath); },
+        []() {
+            int width, height, nrChannels;
+            stbi_set_flip_vertically_on_load(true);
+            unsigned char* data = stbi_load_from_memory(tga.data(), (int)tga.size(), &width, &height, &nrChannels, 0);
+            stbi_image_free(data);
+        } });
+
+    // the block encoder on a 512x512 smooth RGBA gradient with noise, and the load of
+    // the compressed smoke texture against the stb_image decode above
+    static AtlasImage source;
+    static CompressedImage compressed;
+    const int COMPRESS_SIZE = 512;
+    auto compressSetup = [COMPRESS_SIZE]() {
+        std::mt19937 rng(5);
+        std::uniform_int_distribution<int> noise(-8, 8);
+        source.width = source.height = COMPRESS_SIZE;
+        source.rgba.resize((size_t)COMPRESS_SIZE * COMPRESS_SIZE * 4);
+        for (int y = 0; y < COMPRESS_SIZE; ++y) {
+            for (int x = 0; x < COMPRESS_SIZE; ++x) {
+                uint8_t* texel = &source.rgba[((size_t)y * COMPRESS_SIZE + x) * 4];
+                int base[4] = { x / 2, y / 2, (x + y) / 4, 255 - (x ^ y) / 2 };
+                for (int c = 0; c < 4; ++c)
+                    texel[c] = (uint8_t)std::min(255, std::max(0, base[c] + noise(rng)));
+            }
+        }
+    };
+    for (uint32_t format : { COMPRESSED_RGB_BC1, COMPRESSED_RGBA_BC3 }) {
+        cases.push_back({ std::string("texture/compress/") + (format == COMPRESSED_RGB_BC1 ? "bc1/" : "bc3/") + std::to_string(COMPRESS_SIZE),
+            (double)COMPRESS_SIZE * COMPRESS_SIZE, compressSetup,
+            [format]() {
+                compressImage(source, format, compressed);
+                benchSink = (float)compressed.levels[0][0];
+            } });
+    }
+    static std::vector<AtlasImage> mipLevels;
+    for (MipFilter filter : { MIP_BOX, MIP_KAISER }) {
+        cases.push_back({ std::string("texture/mips/") + (filter == MIP_BOX ? "box/" : "kaiser/") + std::to_string(COMPRESS_SIZE),
+            (double)COMPRESS_SIZE * COMPRESS_SIZE, compressSetup,
+            [filter]() {
+                generateMipChain(source, filter, mipLevels);
+                benchSink = (float)mipLevels.back().rgba[0];
+            } });
+    }
+    static std::filesystem::path ktxPath = std::filesystem::temp_directory_path() / "bench_smoke.ktx";
+    cases.push_back({ "texture/load/smoke.ktx", 1.0,
+        [smokePath]() {
+            AtlasImage smoke;
+            if (loadAtlasImage(smokePath, smoke) && compressImage(smoke, COMPRESSED_RGB_BC1, compressed))
+                saveCompressed(ktxPath, compressed);
+        },
+        []() {
+            CompressedImage loaded;
+            loadCompressed(ktxPath, loaded);
+            benchSink = loaded.levels.empty() ? 0.0f : (float)loaded.levels[0][0];
+        } });
+
+    // 1000 sprites of 8 to 64 texels packed into an atlas, with the texel copy
+    static std::vector<AtlasImage> sprites;
+    static TextureAtlas atlas;
+    const size_t SPRITE_COUNT = 1000;
+    cases.push_back({ "atlas/build/" + std::to_string(SPRITE_COUNT), (double)SPRITE_COUNT,
+        [SPRITE_COUNT]() {
+            std::mt19937 rng(4);
+            std::uniform_int_distribution<int> side(8, 64);
+            sprites.resize(SPRITE_COUNT);
+            for (AtlasImage& sprite : sprites) {
+                sprite.width = side(rng);
+                sprite.height = side(rng);
+                sprite.rgba.assign((size_t)sprite.width * sprite.height * 4, 128);
+            }
+        },
+        []() {
+            buildAtlas(sprites, 4096, 2, atlas);
+            benchSink = atlas.rects.back().x;
+        } });
+
+    // 1000 effects read from JSON text against the same effects from a compiled file
+    static std::string effectsJson;
+    static std::vector<EffectDesc> effects;
+    static std::filesystem::path effectsPath = std::filesystem::temp_directory_path() / "bench.effects";
+    const size_t EFFECT_COUNT = 1000;
+    auto effectsSetup = [EFFECT_COUNT]() {
+        std::ostringstream json;
+        json << "[\n";
+        for (size_t i = 0; i < EFFECT_COUNT; ++i) {
+            json << "  { \"name\": \"effect" << i << "\", \"texture\": \"textures/smoke.tga\", \"emissionRate\": 0.3,\n"
+                 << "    \"lifetime\": " << 1.0 + i % 7 * 0.25 << ", \"size\": { \"min\": 60, \"range\": 20 },\n"
+                 << "    \"velocity\": { \"min\": [-1, 1, 0], \"range\": [2, 1.4, 0] }, \"acceleration\": [0, -1, 0],\n"
+                 << "    \"turbulence\": 0.5, \"render\": { \"transparency\": \"weighted\", \"resolutionDivisor\": 2 } }"
+                 << (i + 1 < EFFECT_COUNT ? ",\n" : "\n");
+        }
+        json << "]\n";
+        effectsJson = json.str();
+        effects.clear();
+        parseEffects(effectsJson, "bench", effects);
+        saveCompiledEffects(effectsPath, effects);
+    };
+    cases.push_back({ "effects/parse/" + std::to_string(EFFECT_COUNT), (double)EFFECT_COUNT, effectsSetup,
+        []() {
+            effects.clear();
+            parseEffects(effectsJson, "bench", effects);
+            benchSink = effects.back().block.spawn.x;
+        } });
+    cases.push_back({ "effects/load/" + std::to_string(EFFECT_COUNT), (double)EFFECT_COUNT, effectsSetup,
+        []() {
+            effects.clear();
+            loadCompiledEffects(effectsPath, effects);
+            benchSink = effects.back().block.spawn.x;
+        } });
+
+    // a 6 key size curve at 100000 random ages: the key search against the SIMD
+    // lookup of the baked table
+    static std::vector<float> curtimes, lifetimes, curveOut;
+    static Curve sizeCurve;
+    static CurveTable curveTable;
+    const size_t CURVE_COUNT = 100000;
+    auto curveSetup = [CURVE_COUNT]() {
+        const float ages[6] = { 0.0f, 0.1f, 0.3f, 0.5f, 0.8f, 1.0f }, values[6] = { 0.2f, 1.0f, 1.2f, 0.9f, 0.5f, 0.0f };
+        sizeCurve.count = 6;
+        std::copy(ages, ages + 6, sizeCurve.time);
+        std::copy(values, values + 6, sizeCurve.value);
+        EffectCurves curves;
+        curves.size = sizeCurve;
+        curveTable.bake(curves);
+        std::mt19937 rng(6);
+        std::uniform_real_distribution<float> spawn(0.0f, 2.0f), life(1.0f, 3.0f);
+        curtimes.resize(CURVE_COUNT);
+        lifetimes.resize(CURVE_COUNT);
+        curveOut.resize(CURVE_COUNT);
+        for (size_t i = 0; i < CURVE_COUNT; ++i) {
+            curtimes[i] = spawn(rng);
+            lifetimes[i] = life(rng);
+        }
+    };
+    cases.push_back({ "curves/keys/" + std::to_string(CURVE_COUNT), (double)CURVE_COUNT, curveSetup,
+        [CURVE_COUNT]() {
+            for (size_t i = 0; i < CURVE_COUNT; ++i)
+                curveOut[i] = evaluateCurve(sizeCurve, (2.0f - curtimes[i]) / lifetimes[i]);
+            benchSink = curveOut[CURVE_COUNT / 2];
+        } });
+    cases.push_back({ "curves/lut/" + std::to_string(CURVE_COUNT), (double)CURVE_COUNT, curveSetup,
+        [CURVE_COUNT]() {
+            evaluateCurve(curveTable.size.data(), 2.0f, curtimes.data(), lifetimes.data(), curveOut.data(), CURVE_COUNT);
+            benchSink = curveOut[CURVE_COUNT / 2];
+        } });
+
+    // the same drag, swirl, gravity, integration and late shrink on 100000 particles:
+    // the bytecode VM a chunk of 256 per dispatch, 4 per dispatch, and written in C++
+    static ParticleStreams vmStreams;
+    static ParticleProgram vmProgram;
+    const size_t VM_COUNT = 100000;
+    auto vmSetup = [VM_COUNT]() {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f), span(0.0f, 2.0f);
+        vmStreams.resize(VM_COUNT);
+        for (size_t i = 0; i < VM_COUNT; ++i) {
+            vmStreams.posX[i] = unit(rng); vmStreams.posY[i] = unit(rng); vmStreams.posZ[i] = unit(rng);
+            vmStreams.velX[i] = unit(rng); vmStreams.velY[i] = unit(rng); vmStreams.velZ[i] = unit(rng);
+            vmStreams.size[i] = 60.0f;
+            vmStreams.curtime[i] = span(rng);
+            vmStreams.lifetime[i] = span(rng);
+        }
+        vmProgram.compile("velX = velX - velX * 0.5 * dt + sin(time * 3.0 + posY) * dt;"
+                          "velY = velY - velY * 0.5 * dt - 1.0 * dt;"
+                          "posX = posX + velX * dt; posY = posY + velY * dt; posZ = posZ + velZ * dt;"
+                          "size = mix(size, 0.0, step(0.8, age) * dt)");
+    };
+    for (int chunk : { VM_CHUNK, 4 }) {
+        cases.push_back({ "vm/update/chunk" + std::to_string(chunk) + "/" + std::to_string(VM_COUNT), (double)VM_COUNT, vmSetup,
+            [chunk]() {
+                vmProgram.run(vmStreams, 1.5f, 0.001f, chunk);
+                benchSink = vmStreams.posX[VM_COUNT / 2];
+            } });
+    }
+    cases.push_back({ "vm/native/" + std::to_string(VM_COUNT), (double)VM_COUNT, vmSetup,
+        [VM_COUNT]() {
+            const float time = 1.5f, dt = 0.001f;
+            ParticleStreams& s = vmStreams;
+            #pragma omp parallel for schedule(static)
+            for (int64_t i = 0; i < (int64_t)VM_COUNT; ++i) {
+                float deltaTime = time - s.curtime[i];
+                if (!(deltaTime > 0.0f && deltaTime <= s.lifetime[i]))
+                    continue;
+                s.velX[i] = s.velX[i] - s.velX[i] * 0.5f * dt + std::sin(time * 3.0f + s.posY[i]) * dt;
+                s.velY[i] = s.velY[i] - s.velY[i] * 0.5f * dt - 1.0f * dt;
+                s.posX[i] += s.velX[i] * dt;
+                s.posY[i] += s.velY[i] * dt;
+                s.posZ[i] += s.velZ[i] * dt;
+                float shrink = deltaTime / s.lifetime[i] < 0.8f ? 0.0f : dt;
+                s.size[i] += (0.0f - s.size[i]) * shrink;
+            }
+            benchSink = s.posX[VM_COUNT / 2];
+        } });
+
+#ifndef PARTICLE_NO_GL
+    // ------------------------------------------------ upload / render, needs a (hidden) GL context
+    GLFWwindow* window = nullptr;
+    if (glfwInit()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(800, 600, "bench", NULL, NULL);
+    }
+    if (window) {
+        glfwMakeContextCurrent(window);
+        gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
+    if (window) {
+        static GLuint texture, buffers[2];
+        static std::vector<Particle> upload;
+        const size_t UPLOAD_COUNT = 100000;
+        cases.push_back({ "gl/upload/noise128", 128.0 * 128 * 128,
+            []() {
+                volume.resize(128 * 128 * 128);
+                Generate3DNoise(&emitNoise, 128, 50.0f, volume.data());
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_3D, texture);
+            },
+            []() {
+                glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, 128, 128, 128, 0, GL_RED, GL_UNSIGNED_BYTE, volume.data());
+                glFinish();
+            } });
+        cases.push_back({ "gl/upload/particles/" + std::to_string(UPLOAD_COUNT), (double)UPLOAD_COUNT,
+            [UPLOAD_COUNT]() {
+                randomParticles(sim.streams, UPLOAD_COUNT, 10.0f);
+                streamsToParticles(sim.streams, upload);
+                glGenBuffers(2, buffers);
+                glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+                glBufferData(GL_ARRAY_BUFFER, sizeof(Particle) * UPLOAD_COUNT, NULL, GL_DYNAMIC_COPY);
+            },
+            [UPLOAD_COUNT]() {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Particle) * UPLOAD_COUNT, upload.data());
+                glFinish();
+            } });
+
+        // a second effect asking for a texture that is already resident
+        static TextureRegistry textures(256u << 20, "");
+        cases.push_back({ "gl/texture/acquire/resident", 1.0,
+            [smokePath]() { textures.acquire(smokePath); },
+            [smokePath]() { textures.release(textures.acquire(smokePath)); } });
+
+        // emit + draw of the app's shaders, run from the directory holding them
+        static Shader* emitShader = nullptr;
+        static Shader* drawShader = nullptr;
+        static EffectBuffer effectBuffer;
+        static CurveLut curveLut;
+        static GLuint curveTexture;
+        static GLuint vao;
+        static GLuint frameBuffers[2], frameTexture;
+        static unsigned int src;
+        const unsigned int FRAME_COUNT = 100000;
+        cases.push_back({ "gl/frame/" + std::to_string(FRAME_COUNT), (double)FRAME_COUNT,
+            [FRAME_COUNT]() {
+                const char* feedbackVaryings[] = { "outPos","outVel","outSize","outLifetime","outCurtime" };
+                emitShader = new Shader("emit.vert", "emit.frag", feedbackVaryings, 5);
+                drawShader = new Shader("draw.vert", "draw.frag");
+                effectBuffer.init(std::vector<EffectDesc>(1));
+                EffectBuffer::attach(emitShader->ID);
+                curveLut.add(EffectCurves());
+                curveTexture = uploadCurveLut(curveLut);
+                glGenVertexArrays(1, &vao);
+                glBindVertexArray(vao);
+                std::vector<Particle> initial(FRAME_COUNT);
+                glGenBuffers(2, frameBuffers);
+                for (int i = 0; i < 2; i++) {
+                    glBindBuffer(GL_ARRAY_BUFFER, frameBuffers[i]);
+                    glBufferData(GL_ARRAY_BUFFER, sizeof(Particle) * FRAME_COUNT, initial.data(), GL_DYNAMIC_COPY);
+                }
+                volume.resize(128 * 128 * 128);
+                Generate3DNoise(&emitNoise, 128, 50.0f, volume.data());
+                glGenTextures(1, &frameTexture);
+                glBindTexture(GL_TEXTURE_3D, frameTexture);
+                glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, 128, 128, 128, 0, GL_RED, GL_UNSIGNED_BYTE, volume.data());
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                src = 0;
+            },
+            [FRAME_COUNT]() {
+                static float time = 0.0f;
+                time += 0.001f;
+                auto attributes = [](GLuint vbo) {
+                    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+                    for (int a = 0; a < 5; ++a) {
+                        static const int sizes[5] = { 3, 3, 1, 1, 1 };
+                        static const int offsets[5] = { 0, 3, 6, 7, 8 };
+                        glVertexAttribPointer(a, sizes[a], GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsets[a] * sizeof(float)));
+                        glEnableVertexAttribArray(a);
+                    }
+                };
+                emitShader->use();
+                effectBuffer.bind(0);
+                attributes(frameBuffers[src]);
+                glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, frameBuffers[1 - src]);
+                glEnable(GL_RASTERIZER_DISCARD);
+                emitShader->setFloat("u_time", time);
+                emitShader->setFloat("u_emissionRate", 0.3f);
+                emitShader->setInt("u_particleCount", (int)FRAME_COUNT);
+                emitShader->setFloat("u_deltaTime", 0.001f);
+                emitShader->setVec3("u_acceleration", glm::vec3(0, -1, 0));
+                emitShader->setInt("s_noiseTex", 0);
+                emitShader->setInt("s_curves", 1);
+                emitShader->setFloat("u_speedRow", curveLut.rowCoords(0).y);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, curveTexture);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_3D, frameTexture);
+                glBeginTransformFeedback(GL_POINTS);
+                glDrawArrays(GL_POINTS, 0, FRAME_COUNT);
+                glEndTransformFeedback();
+                glDisable(GL_RASTERIZER_DISCARD);
+                glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+                src = 1 - src;
+
+                glClear(GL_COLOR_BUFFER_BIT);
+                glEnable(GL_PROGRAM_POINT_SIZE);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                drawShader->use();
+                attributes(frameBuffers[src]);
+                drawShader->setFloat("u_time", time);
+                drawShader->setMat4("u_viewProjection", sceneViewProjection());
+                drawShader->setInt("s_curves", 1);
+                drawShader->setVec2("u_curveRows", curveLut.rowCoords(0));
+                glDrawArrays(GL_POINTS, 0, FRAME_COUNT);
+                glFinish();
+            } });
+    }
+    else {
+        std::cerr << "No GL context, skipping the gl/ cases" << std::endl;
+    }
+#endif
+
+    std::map<std::string, double> baseline;
+    if (!baselinePath.empty())
+        baseline = readBaseline(baselinePath);
+
+    std::vector<BenchResult> results;
+    for (const BenchCase& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos)
+            continue;
+        results.push_back(runCase(c, minTime));
+        BenchResult& r = results.back();
+        std::cerr << r.name << ": " << r.medianNs / 1e6 << " ms median, " << r.itemsPerSecond << " items/s ("
+                  << r.iterations << " runs)";
+        auto base = baseline.find(r.name);
+        if (base != baseline.end()) {
+            r.baselineNs = base->second;
+            std::cerr << ", " << std::showpos << (r.medianNs / r.baselineNs - 1.0) * 100.0 << std::noshowpos << "% vs baseline";
+        }
+        std::cerr << std::endl;
+    }
+
+    if (jsonPath.empty()) {
+        writeJson(std::cout, results);
+    }
+    else {
+        std::ofstream out(jsonPath);
+        writeJson(out, results);
+    }
+
+#ifndef PARTICLE_NO_GL
+    if (window)
+        glfwTerminate();
+#endif
+    return 0;
+}
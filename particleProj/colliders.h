@@ -0,0 +1,288 @@
+#ifndef COLLIDERS_H
+#define COLLIDERS_H
+
+#include "simInput.h"
+#include "sdfBaker.h"
+#include "effectDesc.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Scene colliders the particles bounce off (or die on).
+//
+// The scene is a list of Collider. Every frame the ones overlapping the emitter's
+// bounds are culled into an active list of at most MAX_COLLIDERS, so the per particle
+// cost depends on the colliders near the effect, not on the size of the scene. The
+// active list is what emit.vert evaluates (as the Colliders uniform block, see
+// packColliders) and what CpuSimulator evaluates with collideParticle().
+//
+// Colliders are solid: planes are half-spaces below the plane, spheres, boxes,
+// capsules and baked SDF volumes (sdfBaker.h) are filled. A particle that ends a
+// step inside one is moved back to the surface, its normal velocity is reflected
+// scaled by restitution and its tangential velocity scaled by 1 - friction, or it
+// dies when the collider kills on hit.
+
+enum ColliderType {
+    COLLIDER_PLANE = 0,
+    COLLIDER_SPHERE = 1,
+    COLLIDER_BOX = 2,
+    COLLIDER_CAPSULE = 3,
+    COLLIDER_SDF = 4,
+};
+
+// axis aligned box
+struct Bounds {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    bool overlaps(const Bounds& b) const
+    {
+        return min.x <= b.max.x && b.min.x <= max.x &&
+               min.y <= b.max.y && b.min.y <= max.y &&
+               min.z <= b.max.z && b.min.z <= max.z;
+    }
+};
+
+// the same packing as the Collider struct of emit.vert:
+//   plane    shape0 = (normal, offset)                       dot(p, normal) < offset is inside
+//   sphere   shape0 = (center, radius)
+//   box      shape0 = (center, 0),   shape1 = (half extents, 0)
+//   capsule  shape0 = (a, radius),   shape1 = (b, 0)         segment a-b
+//   sdf      shape0 = (origin, extent)                       the volume bound to s_sdfTex,
+//                                                            there's one per scene
+struct Collider {
+    int type = COLLIDER_PLANE;
+    glm::vec4 shape0 = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    glm::vec4 shape1 = glm::vec4(0.0f);
+    float restitution = 0.5f; // share of the normal velocity kept by a bounce
+    float friction = 0.1f;    // share of the tangential velocity lost by a bounce
+    bool kill = false;        // particles touching it die instead of bouncing
+
+    static Collider plane(const glm::vec3& normal, float offset)
+    {
+        Collider c;
+        c.type = COLLIDER_PLANE;
+        c.shape0 = glm::vec4(glm::normalize(normal), offset);
+        return c;
+    }
+
+    static Collider sphere(const glm::vec3& center, float radius)
+    {
+        Collider c;
+        c.type = COLLIDER_SPHERE;
+        c.shape0 = glm::vec4(center, radius);
+        return c;
+    }
+
+    static Collider box(const glm::vec3& center, const glm::vec3& halfExtents)
+    {
+        Collider c;
+        c.type = COLLIDER_BOX;
+        c.shape0 = glm::vec4(center, 0.0f);
+        c.shape1 = glm::vec4(halfExtents, 0.0f);
+        return c;
+    }
+
+    // a zero length capsule is a sphere, the shader would divide by zero
+    static Collider capsule(const glm::vec3& a, const glm::vec3& b, float radius)
+    {
+        if (a == b)
+            return sphere(a, radius);
+        Collider c;
+        c.type = COLLIDER_CAPSULE;
+        c.shape0 = glm::vec4(a, radius);
+        c.shape1 = glm::vec4(b, 0.0f);
+        return c;
+    }
+
+    static Collider sdf(const SdfVolume& volume)
+    {
+        Collider c;
+        c.type = COLLIDER_SDF;
+        c.shape0 = glm::vec4(volume.origin, volume.extent);
+        return c;
+    }
+
+    Collider& response(float bounce, float slide, bool dies = false)
+    {
+        restitution = bounce;
+        friction = slide;
+        kill = dies;
+        return *this;
+    }
+
+    // broad phase test against the emitter bounds, conservative for capsules
+    bool overlaps(const Bounds& b) const
+    {
+        const glm::vec3 p0(shape0), p1(shape1);
+        switch (type) {
+        case COLLIDER_PLANE: {
+            // the lowest corner of the box along the normal is below the plane
+            glm::vec3 center = (b.min + b.max) * 0.5f, extent = (b.max - b.min) * 0.5f;
+            return glm::dot(center, p0) - glm::dot(glm::abs(p0), extent) < shape0.w;
+        }
+        case COLLIDER_SPHERE: {
+            glm::vec3 d = p0 - glm::clamp(p0, b.min, b.max);
+            return glm::dot(d, d) <= shape0.w * shape0.w;
+        }
+        case COLLIDER_BOX:
+            return Bounds{ p0 - p1, p0 + p1 }.overlaps(b);
+        case COLLIDER_SDF:
+            return Bounds{ p0, p0 + shape0.w }.overlaps(b);
+        default:
+            return Bounds{ glm::min(p0, p1) - shape0.w, glm::max(p0, p1) + shape0.w }.overlaps(b);
+        }
+    }
+};
+
+const int MAX_COLLIDERS = 64;
+
+// the Colliders uniform block of emit.vert, std140: three vec4 per collider
+struct ColliderBlock {
+    glm::vec4 colliders[MAX_COLLIDERS * 3];
+};
+
+// fills block with the active colliders, returns the count for u_colliderCount
+inline int packColliders(const std::vector<Collider>& active, ColliderBlock& block)
+{
+    int count = (int)std::min(active.size(), (size_t)MAX_COLLIDERS);
+    for (int i = 0; i < count; ++i) {
+        const Collider& c = active[i];
+        block.colliders[i * 3] = c.shape0;
+        block.colliders[i * 3 + 1] = c.shape1;
+        block.colliders[i * 3 + 2] = glm::vec4((float)c.type, c.restitution, c.friction, c.kill ? 1.0f : 0.0f);
+    }
+    return count;
+}
+
+// broad phase: the scene colliders overlapping bounds, the first MAX_COLLIDERS of them
+inline void cullColliders(const std::vector<Collider>& scene, const Bounds& bounds, std::vector<Collider>& active)
+{
+    active.clear();
+    for (const Collider& c : scene) {
+        if (active.size() == (size_t)MAX_COLLIDERS)
+            break;
+        if (c.overlaps(bounds))
+            active.push_back(c);
+    }
+}
+
+// Everything the emitter's particles can reach. They start at the origin with the
+// effect's velocity, at most its farthest corner of velocityMin + velocityRange, and
+// live its lifetime. A particle accelerates by at most |acceleration| + |turbulence|
+// * maxCurl (the largest curl vector of the volume) + fieldAccel (maxFieldAcceleration()
+// of the force fields, when they're on) and bounces never add speed, so it stays
+// within the ballistic reach of its speed bound, scaled by maxSpeedScale (curveBound()
+// of the effect's speed curve). The separation force is left out, it only spreads
+// the particles of the cloud by a fraction of the neighbor radius.
+inline Bounds emitterBounds(const FrameInput& input, const EffectBlock& effect, float maxSpeedScale, float maxCurl, float dt,
+                            float fieldAccel = 0.0f)
+{
+    glm::vec3 low(effect.velocityMin), high = low + glm::vec3(effect.velocityRange);
+    float speed = glm::length(glm::max(glm::abs(low), glm::abs(high)));
+    float accel = glm::length(input.acceleration) + std::fabs(input.turbulence) * maxCurl + fieldAccel;
+    float t = effect.spawn.x;
+    // explicit Euler moves a step further than the continuous motion
+    float reach = maxSpeedScale * (speed * (t + dt) + 0.5f * accel * t * (t + dt));
+    return Bounds{ glm::vec3(-reach), glm::vec3(reach) };
+}
+
+// largest vector of an RGB curl volume, for emitterBounds()
+inline float maxCurlMagnitude(const float* rgb, size_t texels)
+{
+    float m2 = 0.0f;
+    for (size_t i = 0; i < texels; ++i) {
+        const float* v = rgb + i * 3;
+        m2 = std::max(m2, v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+    return std::sqrt(m2);
+}
+
+// collide() of emit.vert, returns true when the particle hit a kill collider.
+// sdf is the volume of the COLLIDER_SDF colliders.
+inline bool collideParticle(const std::vector<Collider>& active, const SdfVolume& sdf, glm::vec3& pos, glm::vec3& vel)
+{
+    for (const Collider& c : active) {
+        const glm::vec3 p0(c.shape0);
+        glm::vec3 n;
+        float d;
+        if (c.type == COLLIDER_PLANE) {
+            n = p0;
+            d = glm::dot(pos, n) - c.shape0.w;
+        }
+        else if (c.type == COLLIDER_BOX) {
+            // inside the box the nearest face is the one along the largest e
+            glm::vec3 q = pos - p0;
+            glm::vec3 e = glm::abs(q) - glm::vec3(c.shape1);
+            d = std::max(e.x, std::max(e.y, e.z));
+            if (e.x >= e.y && e.x >= e.z)
+                n = glm::vec3(q.x < 0.0f ? -1.0f : 1.0f, 0.0f, 0.0f);
+            else if (e.y >= e.z)
+                n = glm::vec3(0.0f, q.y < 0.0f ? -1.0f : 1.0f, 0.0f);
+            else
+                n = glm::vec3(0.0f, 0.0f, q.z < 0.0f ? -1.0f : 1.0f);
+        }
+        else if (c.type == COLLIDER_SDF) {
+            glm::vec3 g;
+            if (!sdf.sample(pos, d, g))
+                continue;
+            float len = glm::length(g);
+            n = len > 0.0f ? g / len : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        else {
+            // sphere, or a capsule around its closest point on the segment
+            glm::vec3 center = p0;
+            if (c.type == COLLIDER_CAPSULE) {
+                glm::vec3 ab = glm::vec3(c.shape1) - p0;
+                float t = glm::clamp(glm::dot(pos - p0, ab) / glm::dot(ab, ab), 0.0f, 1.0f);
+                center = p0 + t * ab;
+            }
+            glm::vec3 v = pos - center;
+            float len = glm::length(v);
+            d = len - c.shape0.w;
+            n = len > 0.0f ? v / len : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        if (d >= 0.0f)
+            continue;
+        if (c.kill)
+            return true;
+        pos -= d * n;
+        float vn = glm::dot(vel, n);
+        if (vn < 0.0f) {
+            glm::vec3 vt = vel - vn * n;
+            vel = vt * (1.0f - c.friction) - c.restitution * vn * n;
+        }
+    }
+    return false;
+}
+
+// the mesh of the demo scene, a torus, also what the scene depth is rendered from
+inline void demoMesh(TriangleMesh& mesh)
+{
+    makeTorus(mesh, glm::vec3(-0.55f, -0.5f, 0.0f), 0.18f, 0.06f, 48, 16);
+}
+
+// the SDF volume of the demo mesh
+inline void bakeDemoSdf(SdfVolume& volume, const std::filesystem::path& cacheDir)
+{
+    TriangleMesh torus;
+    demoMesh(torus);
+    bakeSdfCached(torus, 64, 0.05f, cacheDir, volume);
+}
+
+// the scene of the app, particleSim replays journals against the same one
+inline void demoColliders(std::vector<Collider>& scene, const SdfVolume& sdf)
+{
+    scene.clear();
+    scene.push_back(Collider::plane(glm::vec3(0.0f, 1.0f, 0.0f), -0.8f).response(0.4f, 0.2f));
+    scene.push_back(Collider::sphere(glm::vec3(0.45f, 0.35f, 0.0f), 0.15f).response(0.7f, 0.05f));
+    scene.push_back(Collider::box(glm::vec3(-0.5f, 0.1f, 0.0f), glm::vec3(0.2f, 0.04f, 0.5f)).response(0.3f, 0.3f));
+    scene.push_back(Collider::capsule(glm::vec3(0.25f, -0.45f, -0.5f), glm::vec3(0.25f, -0.45f, 0.5f), 0.06f).response(0.0f, 0.0f, true));
+    if (sdf.size > 0)
+        scene.push_back(Collider::sdf(sdf).response(0.6f, 0.1f));
+}
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef CPU_SIMULATOR_H
+#define CPU_SIMULATOR_H
+
+#include "particle.h"
+#include "simInput.h"
+#include "spatialGrid.h"
+#include "colliders.h"
+#include "depthCollision.h"
+#include "forceFields.h"
+#include "effectDesc.h"
+#include "particleVm.h"
+#include "volumeSampling.h"
+
+#include <cmath>
+#include <vector>
+
+// CPU copy of the GL_R8 noise volume made by Create3DNoiseTexture, sampled
+// the way the GL samples it (GL_LINEAR, unorm texels). repeat matches the
+// GL_REPEAT wrap of a periodic generator's texture.
+struct NoiseVolume {
+    int size = 0;
+    bool repeat = false;
+    std::vector<unsigned char> texels;
+
+    float sample(const glm::vec3& coord) const
+    {
+        float r;
+        sampleTrilinear<1>(size, repeat, coord, [this](int x, int y, int z, int) {
+            return (float)texels[((size_t)z * size + y) * size + x];
+        }, &r);
+        return r / 255.0f;
+    }
+};
+
+// CPU copy of the RGB16F curl noise volume made by Create3DCurlNoiseTexture.
+// Kept in full float, so it differs from the GPU by the half float rounding.
+struct CurlVolume {
+    int size = 0;
+    bool repeat = false;
+    std::vector<float> texels; // RGB
+
+    glm::vec3 sample(const glm::vec3& coord) const
+    {
+        float rgb[3];
+        sampleTrilinear<3>(size, repeat, coord, [this](int x, int y, int z, int c) {
+            return texels[(((size_t)z * size + y) * size + x) * 3 + c];
+        }, rgb);
+        return glm::vec3(rgb[0], rgb[1], rgb[2]);
+    }
+
+    float maxMagnitude() const
+    {
+        return maxCurlMagnitude(texels.data(), texels.size() / 3);
+    }
+};
+
+// volume coordinate of a particle, matches curlCoord() in emit.vert
+inline glm::vec3 curlCoord(float x, float y, float z, float time)
+{
+    return glm::vec3(x * 0.5f + 0.5f, y * 0.5f + 0.5f, z * 0.5f + 0.5f + time * 0.05f);
+}
+
+// CPU backend, runs emit.vert over a SoA copy of the particle buffer so the
+// simulation can be replayed and compared without a GL context.
+class CpuSimulator
+{
+public:
+    ParticleStreams streams;
+    NoiseVolume noise;
+    CurlVolume curl;
+    SpatialGrid grid;
+    std::vector<Collider> colliders; // the scene, culled every step against the emitter bounds
+    SdfVolume sdf;                   // volume of the COLLIDER_SDF colliders
+    DepthImage depth;                // scene depth for FrameInput::depthCollision
+    std::vector<ForceField> forceFields; // for FrameInput::forceFields
+    EffectBlock effect;              // the Effect block of emit.vert
+    CurveTable curves;               // the effect's size and speed over age, its s_curves rows
+    ParticleProgram update;          // custom logic after the advection, CPU only
+    glm::mat4 viewProjection = sceneViewProjection(); // camera of drawAttributes()
+
+    void init(size_t count)
+    {
+        streams.resize(count);
+        lastTime = 0.0f;
+        curlBound = -1.0f;
+    }
+
+    // emit.vert: dead particles may respawn, live ones are advected
+    void step(const FrameInput& input)
+    {
+        const float dt = input.time - lastTime;
+        lastTime = input.time;
+        const size_t n = streams.count();
+        if (input.separation != 0.0f)
+            separationForces(input);
+        if (input.forceFields)
+            fieldForces(input);
+        activeColliders.clear();
+        if (input.collisions && update.movesParticles()) {
+            // the update's own motion isn't in the emitter's bounds, every collider is
+            // tested (MAX_COLLIDERS is the size of emit.vert's block, not a CPU limit)
+            activeColliders = colliders;
+        }
+        else if (input.collisions) {
+            if (curlBound < 0.0f)
+                curlBound = curl.maxMagnitude();
+            float fieldAccel = input.forceFields ? maxFieldAcceleration(forceFields) : 0.0f;
+            cullColliders(colliders, emitterBounds(input, effect, curves.maxSpeed, curlBound, dt, fieldAccel), activeColliders);
+        }
+        if (curves.constantSpeed)
+            speedScale.clear();
+        else {
+            speedScale.resize(n);
+            evaluateCurve(curves.speed.data(), input.time, streams.curtime.data(), streams.lifetime.data(), speedScale.data(), n);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            float deltaTime = input.time - streams.curtime[i];
+            if (deltaTime > streams.lifetime[i]) {
+                float seed = input.time + (float)input.seed;
+                bool burst = i < input.spawnBurst;
+                if (burst || randomValue(i, input.time, seed) < input.emissionRate)
+                    emitParticle(i, input.time, seed);
+            }
+            else {
+                advectParticle(i, input, dt);
+            }
+        }
+        update.run(streams, input.time, dt);
+    }
+
+    // advection of every particle, the emit-free part of step(), for benchmarking
+    void advect(const FrameInput& input, float dt)
+    {
+        const size_t n = streams.count();
+        for (size_t i = 0; i < n; ++i)
+            advectParticle(i, input, dt);
+    }
+
+    // draw.vert, writes the rendered xy position and point size of every particle
+    void drawAttributes(const FrameInput& input, std::vector<glm::vec3>& out) const
+    {
+        const size_t n = streams.count();
+        out.resize(n);
+        sizeScale.resize(n);
+        evaluateCurve(curves.size.data(), input.time, streams.curtime.data(), streams.lifetime.data(), sizeScale.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            float deltaTime = input.time - streams.curtime[i];
+            if (deltaTime <= streams.lifetime[i]) {
+                glm::vec4 clip = viewProjection * glm::vec4(streams.posX[i], streams.posY[i], streams.posZ[i], 1.0f);
+                out[i] = glm::vec3(clip.x / clip.w, clip.y / clip.w, streams.size[i] * sizeScale[i] / clip.w);
+            }
+            else
+                out[i] = glm::vec3(-1000.0f, -1000.0f, 0.0f);
+        }
+    }
+
+    void snapshot(std::vector<Particle>& out) const
+    {
+        streamsToParticles(streams, out);
+    }
+
+private:
+    float lastTime = 0.0f;
+    float curlBound = -1.0f;
+    std::vector<glm::vec3> neighborForce;
+    std::vector<float> speedScale;           // the speed curve of every particle, empty while it is 1
+    mutable std::vector<float> sizeScale;    // the size curve of every particle, for drawAttributes()
+    std::vector<float> fieldX, fieldY, fieldZ;
+    std::vector<Collider> activeColliders;
+
+    bool alive(size_t i, float time) const
+    {
+        return time - streams.curtime[i] <= streams.lifetime[i];
+    }
+
+    // neighborForce() of emit.vert for every live particle, from the positions at the
+    // start of the step like the GPU reads them from the source buffer
+    void separationForces(const FrameInput& input)
+    {
+        const float r = input.neighborRadius;
+        const int64_t n = (int64_t)streams.count();
+        grid.build(streams, r);
+        neighborForce.assign((size_t)n, glm::vec3(0.0f));
+        #pragma omp parallel for schedule(static)
+        for (int64_t i = 0; i < n; ++i) {
+            if (!alive((size_t)i, input.time))
+                continue;
+            glm::vec3 p(streams.posX[i], streams.posY[i], streams.posZ[i]);
+            glm::vec3 force(0.0f);
+            grid.forEachNeighbor((uint32_t)i, r, [&](uint32_t j, float distanceSquared) {
+                if (distanceSquared == 0.0f || !alive(j, input.time))
+                    return;
+                float d = std::sqrt(distanceSquared);
+                glm::vec3 q(streams.posX[j], streams.posY[j], streams.posZ[j]);
+                force += (1.0f - d / r) / d * (p - q);
+            });
+            neighborForce[(size_t)i] = input.separation * force;
+        }
+    }
+
+    // fieldForce() of emit.vert for every particle, chunk by chunk over the streams
+    // from the positions and velocities at the start of the step
+    void fieldForces(const FrameInput& input)
+    {
+        const int64_t n = (int64_t)streams.count();
+        fieldX.resize((size_t)n);
+        fieldY.resize((size_t)n);
+        fieldZ.resize((size_t)n);
+        const int64_t chunks = (n + FORCE_FIELD_CHUNK - 1) / FORCE_FIELD_CHUNK;
+        #pragma omp parallel for schedule(static)
+        for (int64_t c = 0; c < chunks; ++c) {
+            size_t i = (size_t)(c * FORCE_FIELD_CHUNK);
+            int count = (int)std::min<int64_t>(FORCE_FIELD_CHUNK, n - (int64_t)i);
+            accumulateForceFields(forceFields, input.time, &streams.posX[i], &streams.posY[i], &streams.posZ[i],
+                                  &streams.velX[i], &streams.velY[i], &streams.velZ[i], &fieldX[i], &fieldY[i], &fieldZ[i],
+                                  count, [this](const glm::vec3& coord) { return noise.sample(coord); });
+        }
+    }
+
+    // randomValue() of emit.vert
+    float randomValue(size_t index, float time, float& seed) const
+    {
+        float vertexId = (float)index / (float)streams.count();
+        glm::vec3 texCoord(time, vertexId, seed);
+        seed += 0.1f;
+        return noise.sample(texCoord);
+    }
+
+    void emitParticle(size_t i, float time, float& seed)
+    {
+        streams.velX[i] = effect.velocityMin.x + randomValue(i, time, seed) * effect.velocityRange.x;
+        streams.velY[i] = effect.velocityMin.y + randomValue(i, time, seed) * effect.velocityRange.y;
+        streams.velZ[i] = effect.velocityRange.z != 0.0f ? effect.velocityMin.z + randomValue(i, time, seed) * effect.velocityRange.z : effect.velocityMin.z;
+        streams.posX[i] = 0.0f;
+        streams.posY[i] = 0.0f;
+        streams.posZ[i] = 0.0f;
+        streams.size[i] = effect.spawn.y + randomValue(i, time, seed) * effect.spawn.z;
+        streams.lifetime[i] = effect.spawn.x;
+        streams.curtime[i] = time;
+    }
+
+    void advectParticle(size_t i, const FrameInput& input, float dt)
+    {
+        glm::vec3 force = input.acceleration;
+        if (input.turbulence != 0.0f && curl.size > 0)
+            force += input.turbulence * curl.sample(curlCoord(streams.posX[i], streams.posY[i], streams.posZ[i], input.time));
+        if (input.separation != 0.0f && i < neighborForce.size())
+            force += neighborForce[i];
+        if (input.forceFields && i < fieldX.size())
+            force += glm::vec3(fieldX[i], fieldY[i], fieldZ[i]);
+        streams.velX[i] += force.x * dt;
+        streams.velY[i] += force.y * dt;
+        streams.velZ[i] += force.z * dt;
+        const float speed = i < speedScale.size() ? speedScale[i] : 1.0f;
+        streams.posX[i] += streams.velX[i] * speed * dt;
+        streams.posY[i] += streams.velY[i] * speed * dt;
+        streams.posZ[i] += streams.velZ[i] * speed * dt;
+        if (!activeColliders.empty() || (input.depthCollision && depth.width > 0)) {
+            glm::vec3 pos(streams.posX[i], streams.posY[i], streams.posZ[i]);
+            glm::vec3 vel(streams.velX[i], streams.velY[i], streams.velZ[i]);
+            if (!activeColliders.empty() && collideParticle(activeColliders, sdf, pos, vel))
+                streams.lifetime[i] = -1.0f;
+            if (input.depthCollision && depth.width > 0)
+                collideDepth(depth, pos, vel);
+            streams.posX[i] = pos.x;
+            streams.posY[i] = pos.y;
+            streams.posZ[i] = pos.z;
+            streams.velX[i] = vel.x;
+            streams.velY[i] = vel.y;
+            streams.velZ[i] = vel.z;
+        }
+    }
+};
+
+#endif
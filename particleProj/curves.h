@@ -0,0 +1,237 @@
+#ifndef CURVES_H
+#define CURVES_H
+
+#ifndef PARTICLE_NO_GL
+#include <glad/glad.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Size, speed and color over a particle's normalized age (0 at spawn, 1 at the end
+// of its lifetime), authored as keys in the effect files (effectDesc.h) and baked
+// once into lookup tables, so a particle pays one fetch per attribute instead of a
+// key search:
+//
+//   size   scales the spawn size in draw.vert (the old 1 - age falloff is the default)
+//   speed  scales the velocity in the position step of emit.vert
+//   color  multiplies the sprite in draw.frag and weightedOit.frag
+//
+// The GPU table (CurveLut) is one RGBA16F texture of CURVE_LUT_WIDTH texels per row
+// and two rows per effect: the color gradient, then size and speed in r and g. Texel
+// i is the curves at age i / (CURVE_LUT_WIDTH - 1) and the linear filter interpolates
+// between them, curveU() maps an age onto the texel centers.
+//
+// The CPU backend samples the same points from planar float tables (CurveTable),
+// evaluateCurve() does 4 particles at a time with SSE2.
+
+const int MAX_CURVE_KEYS = 8;
+const int CURVE_LUT_WIDTH = 256;
+
+// piecewise linear, held flat before the first key and after the last; the key
+// times ascend within [0, 1]
+struct Curve {
+    int count = 2;
+    float time[MAX_CURVE_KEYS] = { 0.0f, 1.0f };
+    float value[MAX_CURVE_KEYS] = { 1.0f, 1.0f };
+
+    Curve() = default;
+    Curve(float start, float end)
+    {
+        value[0] = start;
+        value[1] = end;
+    }
+};
+
+struct Gradient {
+    int count = 1;
+    float time[MAX_CURVE_KEYS] = { 0.0f };
+    glm::vec4 color[MAX_CURVE_KEYS] = { glm::vec4(1.0f) };
+};
+
+struct EffectCurves {
+    Curve size = Curve(1.0f, 0.0f);
+    Curve speed;
+    Gradient color;
+};
+
+// the key search the tables replace, bakes them and is the bench's reference
+template <class T>
+inline T evaluateKeys(int count, const float* time, const T* value, float age)
+{
+    if (age <= time[0])
+        return value[0];
+    for (int k = 1; k < count; ++k) {
+        if (age < time[k]) {
+            float span = time[k] - time[k - 1];
+            float f = span > 0.0f ? (age - time[k - 1]) / span : 1.0f;
+            return value[k - 1] + (value[k] - value[k - 1]) * f;
+        }
+    }
+    return value[count - 1];
+}
+
+inline float evaluateCurve(const Curve& curve, float age)
+{
+    return evaluateKeys(curve.count, curve.time, curve.value, age);
+}
+
+inline glm::vec4 evaluateGradient(const Gradient& gradient, float age)
+{
+    return evaluateKeys(gradient.count, gradient.time, gradient.color, age);
+}
+
+// clamped to [0, 1], NaN (a particle that never lived) to 0
+inline float clampAge(float age)
+{
+    return age > 0.0f ? (age < 1.0f ? age : 1.0f) : 0.0f;
+}
+
+inline float curveSampleAge(int i)
+{
+    return (float)i / (float)(CURVE_LUT_WIDTH - 1);
+}
+
+// the texture coordinate of age in a CurveLut row, on the texel centers
+inline float curveU(float age)
+{
+    return (clampAge(age) * (CURVE_LUT_WIDTH - 1) + 0.5f) / CURVE_LUT_WIDTH;
+}
+
+inline bool isConstant(const Curve& curve, float value)
+{
+    for (int k = 0; k < curve.count; ++k) {
+        if (curve.value[k] != value)
+            return false;
+    }
+    return true;
+}
+
+// the largest |value| of the curve, piecewise linear so at one of its keys
+inline float curveBound(const Curve& curve)
+{
+    float bound = 0.0f;
+    for (int k = 0; k < curve.count; ++k)
+        bound = std::max(bound, std::fabs(curve.value[k]));
+    return bound;
+}
+
+// ------------------------------------------------------------------ CPU
+
+// One effect's size and speed curves sampled like a CurveLut row, plus a copy of
+// the last sample so the upper neighbor of the last texel needs no clamp.
+struct CurveTable {
+    std::vector<float> size, speed;
+    bool constantSpeed = true;   // speed is 1 at every age, the step skips the lookups
+    float maxSpeed = 1.0f;       // curveBound() of the speed curve
+
+    CurveTable() { bake(EffectCurves()); }
+
+    void bake(const EffectCurves& curves)
+    {
+        size.resize(CURVE_LUT_WIDTH + 1);
+        speed.resize(CURVE_LUT_WIDTH + 1);
+        for (int i = 0; i < CURVE_LUT_WIDTH; ++i) {
+            size[i] = evaluateCurve(curves.size, curveSampleAge(i));
+            speed[i] = evaluateCurve(curves.speed, curveSampleAge(i));
+        }
+        size[CURVE_LUT_WIDTH] = size[CURVE_LUT_WIDTH - 1];
+        speed[CURVE_LUT_WIDTH] = speed[CURVE_LUT_WIDTH - 1];
+        constantSpeed = isConstant(curves.speed, 1.0f);
+        maxSpeed = curveBound(curves.speed);
+    }
+};
+
+// one sample of a CurveTable column at an age, the scalar form of evaluateCurve()
+inline float sampleCurveTable(const float* table, float age)
+{
+    float x = clampAge(age) * (CURVE_LUT_WIDTH - 1);
+    int i = (int)x;
+    float f = x - (float)i;
+    return table[i] + (table[i + 1] - table[i]) * f;
+}
+
+// out[i] = the table at the age of particle i, (time - curtime[i]) / lifetime[i].
+// An expired particle reads the last sample, a killed one (lifetime -1) the first.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+inline void evaluateCurve(const float* table, float time, const float* curtime, const float* lifetime,
+                          float* out, size_t count)
+{
+    const __m128 t = _mm_set1_ps(time), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps((float)(CURVE_LUT_WIDTH - 1));
+    const size_t whole = count / 4 * 4;
+    for (size_t i = 0; i < whole; i += 4) {
+        __m128 age = _mm_div_ps(_mm_sub_ps(t, _mm_loadu_ps(curtime + i)), _mm_loadu_ps(lifetime + i));
+        // maxps returns its second operand for a NaN, so a NaN age reads 0 like clampAge()
+        __m128 x = _mm_mul_ps(_mm_min_ps(_mm_max_ps(age, zero), one), scale);
+        __m128i index = _mm_cvttps_epi32(x);
+        __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(index));
+        // SSE2 has no gather, the 8 texels are scalar loads
+        alignas(16) int k[4];
+        _mm_store_si128((__m128i*)k, index);
+        __m128 a = _mm_setr_ps(table[k[0]], table[k[1]], table[k[2]], table[k[3]]);
+        __m128 b = _mm_setr_ps(table[k[0] + 1], table[k[1] + 1], table[k[2] + 1], table[k[3] + 1]);
+        _mm_storeu_ps(out + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f)));
+    }
+    for (size_t i = whole; i < count; ++i)
+        out[i] = sampleCurveTable(table, (time - curtime[i]) / lifetime[i]);
+}
+#else
+inline void evaluateCurve(const float* table, float time, const float* curtime, const float* lifetime,
+                          float* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i] = sampleCurveTable(table, (time - curtime[i]) / lifetime[i]);
+}
+#endif
+
+// ------------------------------------------------------------------ GPU
+
+// the rows of every effect's curves, effect e at rows 2e (color) and 2e + 1 (size, speed)
+struct CurveLut {
+    std::vector<glm::vec4> texels;
+
+    int rows() const { return (int)(texels.size() / CURVE_LUT_WIDTH); }
+
+    void add(const EffectCurves& curves)
+    {
+        size_t first = texels.size();
+        texels.resize(first + 2 * CURVE_LUT_WIDTH);
+        glm::vec4* color = &texels[first];
+        glm::vec4* scalars = color + CURVE_LUT_WIDTH;
+        for (int i = 0; i < CURVE_LUT_WIDTH; ++i) {
+            float age = curveSampleAge(i);
+            color[i] = evaluateGradient(curves.color, age);
+            scalars[i] = glm::vec4(evaluateCurve(curves.size, age), evaluateCurve(curves.speed, age), 0.0f, 0.0f);
+        }
+    }
+
+    // the v coordinates of effect's color and size/speed rows
+    glm::vec2 rowCoords(size_t effect) const
+    {
+        float height = (float)rows();
+        return glm::vec2((2.0f * effect + 0.5f) / height, (2.0f * effect + 1.5f) / height);
+    }
+};
+
+#ifndef PARTICLE_NO_GL
+inline GLuint uploadCurveLut(const CurveLut& lut)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, CURVE_LUT_WIDTH, lut.rows(), 0, GL_RGBA, GL_FLOAT, lut.texels.data());
+    return texture;
+}
+#endif
+
+#endif
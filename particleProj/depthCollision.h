@@ -0,0 +1,188 @@
+#ifndef DEPTH_COLLISION_H
+#define DEPTH_COLLISION_H
+
+#include "sdfBaker.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Collision against the scene's depth buffer, the screen space alternative to the
+// world colliders: the cost is a few depth texel fetches per particle whatever the
+// scene holds, but only surfaces visible to the camera exist.
+//
+// A particle that ends a step behind the depth buffer, by less than DEPTH_THICKNESS,
+// is moved forward onto the surface along its view ray. The surface normal comes
+// from the world positions of the neighboring depth texels (central differences,
+// or the flatter side on each axis where the other one crosses a silhouette) and the
+// velocity bounces off it like it does off the colliders of colliders.h.
+//
+// collideDepth() is depthCollide() of emit.vert. The app renders the scene depth
+// with SceneDepthPass (sceneDepth.h), the CPU backend rasterizes the same mesh with
+// rasterizeDepth().
+
+// the app's window, the scene depth has its resolution
+const int DEPTH_WIDTH = 800;
+const int DEPTH_HEIGHT = 600;
+
+const float DEPTH_THICKNESS = 0.1f;  // how far behind a surface a particle still collides with it
+const float DEPTH_RESTITUTION = 0.5f;
+const float DEPTH_FRICTION = 0.1f;
+
+// Camera of draw.vert and of the scene depth. Looks down -z at the unit square, so
+// the particles land where the old position.xy mapping put them.
+inline glm::mat4 sceneViewProjection()
+{
+    return glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -10.0f, 10.0f);
+}
+
+// window space depth in [0, 1], row 0 at the bottom like the GL's
+struct DepthImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> depth;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::mat4 inverseViewProjection = glm::mat4(1.0f);
+
+    void resize(int w, int h, const glm::mat4& camera)
+    {
+        width = w;
+        height = h;
+        depth.assign((size_t)w * h, 1.0f);
+        viewProjection = camera;
+        inverseViewProjection = glm::inverse(camera);
+    }
+
+    // texelFetch with the coordinate clamped to the image
+    float fetch(int x, int y) const
+    {
+        x = std::min(width - 1, std::max(0, x));
+        y = std::min(height - 1, std::max(0, y));
+        return depth[(size_t)y * width + x];
+    }
+
+    // world position of the center of texel (x, y) at depth d
+    glm::vec3 unproject(int x, int y, float d) const
+    {
+        glm::vec4 ndc(((float)x + 0.5f) / (float)width * 2.0f - 1.0f, ((float)y + 0.5f) / (float)height * 2.0f - 1.0f, d * 2.0f - 1.0f, 1.0f);
+        glm::vec4 world = inverseViewProjection * ndc;
+        return glm::vec3(world) / world.w;
+    }
+};
+
+// Depth of the triangles of mesh seen through image.viewProjection, GL_LESS, sampled
+// at the texel centers. Triangles crossing the camera plane are skipped, there is no
+// clipping. Rows are OpenMP parallel.
+inline void rasterizeDepth(const TriangleMesh& mesh, DepthImage& image)
+{
+    struct ScreenTriangle {
+        glm::vec3 v[3]; // window x, y and depth
+        float minY, maxY;
+    };
+    std::vector<ScreenTriangle> screen;
+    screen.reserve(mesh.triangleCount());
+    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+        ScreenTriangle s;
+        bool visible = true;
+        for (int k = 0; k < 3; ++k) {
+            glm::vec4 clip = image.viewProjection * glm::vec4(mesh.vertices[mesh.indices[t * 3 + k]], 1.0f);
+            if (clip.w <= 0.0f) {
+                visible = false;
+                break;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            s.v[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * image.width, (ndc.y * 0.5f + 0.5f) * image.height, ndc.z * 0.5f + 0.5f);
+        }
+        if (!visible)
+            continue;
+        s.minY = std::min(s.v[0].y, std::min(s.v[1].y, s.v[2].y));
+        s.maxY = std::max(s.v[0].y, std::max(s.v[1].y, s.v[2].y));
+        screen.push_back(s);
+    }
+
+    std::fill(image.depth.begin(), image.depth.end(), 1.0f);
+    #pragma omp parallel for schedule(dynamic, 8)
+    for (int y = 0; y < image.height; ++y) {
+        float py = (float)y + 0.5f;
+        float* row = &image.depth[(size_t)y * image.width];
+        for (const ScreenTriangle& s : screen) {
+            if (py < s.minY || py > s.maxY)
+                continue;
+            const glm::vec3 &a = s.v[0], &b = s.v[1], &c = s.v[2];
+            float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+            if (area == 0.0f || a.z < 0.0f || b.z < 0.0f || c.z < 0.0f || a.z > 1.0f || b.z > 1.0f || c.z > 1.0f)
+                continue;
+            int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+            int x1 = std::min(image.width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+            for (int x = x0; x <= x1; ++x) {
+                float px = (float)x + 0.5f;
+                float wa = ((b.x - px) * (c.y - py) - (c.x - px) * (b.y - py)) / area;
+                float wb = ((c.x - px) * (a.y - py) - (a.x - px) * (c.y - py)) / area;
+                float wc = 1.0f - wa - wb;
+                if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+                    continue;
+                float z = wa * a.z + wb * b.z + wc * c.z;
+                if (z < row[x])
+                    row[x] = z;
+            }
+        }
+    }
+}
+
+// the neighbor difference of texel (x, y) along (dx, dy). A side twice as steep as the
+// other is taken for a different surface and left out. Central otherwise: picking the
+// flatter side on smooth surfaces would flip on ridges with the last bit of the depth.
+inline glm::vec3 depthDifference(const DepthImage& image, int x, int y, int dx, int dy, float d, const glm::vec3& center)
+{
+    float forward = image.fetch(x + dx, y + dy), backward = image.fetch(x - dx, y - dy);
+    float df = std::fabs(forward - d), db = std::fabs(d - backward);
+    if (df > 2.0f * db)
+        return center - image.unproject(x - dx, y - dy, backward);
+    if (db > 2.0f * df)
+        return image.unproject(x + dx, y + dy, forward) - center;
+    return (image.unproject(x + dx, y + dy, forward) - image.unproject(x - dx, y - dy, backward)) * 0.5f;
+}
+
+// depthCollide() of emit.vert
+inline void collideDepth(const DepthImage& image, glm::vec3& pos, glm::vec3& vel)
+{
+    glm::vec4 clip = image.viewProjection * glm::vec4(pos, 1.0f);
+    if (clip.w <= 0.0f)
+        return;
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    if (std::fabs(ndc.x) >= 1.0f || std::fabs(ndc.y) >= 1.0f)
+        return;
+    int x = (int)((ndc.x * 0.5f + 0.5f) * (float)image.width);
+    int y = (int)((ndc.y * 0.5f + 0.5f) * (float)image.height);
+    float d = image.fetch(x, y);
+    float particleDepth = ndc.z * 0.5f + 0.5f;
+    if (d >= 1.0f || particleDepth <= d)
+        return;
+    glm::vec3 center = image.unproject(x, y, d);
+    if (glm::length(pos - center) > DEPTH_THICKNESS)
+        return;
+
+    glm::vec3 n = glm::cross(depthDifference(image, x, y, 1, 0, d, center), depthDifference(image, x, y, 0, 1, d, center));
+    float len = glm::length(n);
+    if (len > 0.0f) {
+        n /= len;
+    }
+    else {
+        // toward the camera
+        n = glm::normalize(image.unproject(x, y, 0.0f) - image.unproject(x, y, 1.0f));
+    }
+
+    // onto the surface along the view ray
+    glm::vec4 surface = image.inverseViewProjection * glm::vec4(ndc.x, ndc.y, d * 2.0f - 1.0f, 1.0f);
+    pos = glm::vec3(surface) / surface.w;
+    float vn = glm::dot(vel, n);
+    if (vn < 0.0f) {
+        glm::vec3 vt = vel - vn * n;
+        vel = vt * (1.0f - DEPTH_FRICTION) - DEPTH_RESTITUTION * vn * n;
+    }
+}
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef DEPTH_SORT_H
+#define DEPTH_SORT_H
+
+#include "particle.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Back to front order of the live particles for the alpha blended draw.
+//
+// Keys are the window depth of every particle mapped to an unsigned integer so the
+// farthest particle has the smallest key, see backToFrontKey(); sortKeys.comp makes
+// the same keys for the GPU sort (gpuDepthSort.h).
+//
+// DepthSorter is incremental: the particles move little between frames, so last
+// frame's order of the particles still alive is nearly sorted and an insertion sort
+// fixes it in about one pass. The particles born since are radix sorted on their own
+// and merged in. When the survivors moved too much (a camera cut, or particles too
+// dense for their speed) the insertion sort gives up after a budget of moves,
+// everything is radix sorted and the next few frames don't try again.
+//
+//   sorter.sort(streams, time, viewProjection);
+//   upload(sorter.order());   // element buffer of the draw, sorter.order().size() indices
+
+// unsigned integer with the order of the float
+inline uint32_t orderedFloatBits(float f)
+{
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u & 0x80000000u ? ~u : u | 0x80000000u;
+}
+
+// the farthest first: window depth grows away from the camera
+inline uint32_t backToFrontKey(float depth)
+{
+    return ~orderedFloatBits(depth);
+}
+
+// window depth of p seen through viewProjection, the z/w of the clip position
+inline float windowDepth(const glm::mat4& viewProjection, float x, float y, float z)
+{
+    float cz = viewProjection[0][2] * x + viewProjection[1][2] * y + viewProjection[2][2] * z + viewProjection[3][2];
+    float cw = viewProjection[0][3] * x + viewProjection[1][3] * y + viewProjection[2][3] * z + viewProjection[3][3];
+    return cz / cw;
+}
+
+// LSD radix sort of (keys, values) by key, 8 bits per pass, stable. Passes whose
+// digit is the same for every key are skipped. Chunks of the input count their own
+// histograms and scatter in parallel, like SpatialGrid's counting sort.
+class RadixSorter
+{
+public:
+    void sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values)
+    {
+        const int64_t n = (int64_t)keys.size();
+        if (n < 2)
+            return;
+        int chunks = 1;
+#ifdef _OPENMP
+        chunks = std::min(omp_get_max_threads(), MAX_CHUNKS);
+#endif
+        chunks = (int)std::max<int64_t>(1, std::min<int64_t>(chunks, n / 16384));
+        keyScratch.resize((size_t)n);
+        valueScratch.resize((size_t)n);
+        histogram.resize((size_t)chunks * 256);
+
+        for (int shift = 0; shift < 32; shift += 8) {
+            std::fill(histogram.begin(), histogram.end(), 0u);
+            #pragma omp parallel for schedule(static, 1)
+            for (int c = 0; c < chunks; ++c) {
+                uint32_t* counts = &histogram[(size_t)c * 256];
+                for (int64_t i = n * c / chunks; i < n * (c + 1) / chunks; ++i)
+                    counts[(keys[i] >> shift) & 0xFF]++;
+            }
+            // one digit for everything, nothing to move
+            uint32_t first = (keys[0] >> shift) & 0xFF, sameDigit = 0;
+            for (int c = 0; c < chunks; ++c)
+                sameDigit += histogram[(size_t)c * 256 + first];
+            if (sameDigit == (uint32_t)n)
+                continue;
+
+            uint32_t offset = 0;
+            for (int d = 0; d < 256; ++d) {
+                for (int c = 0; c < chunks; ++c) {
+                    uint32_t& h = histogram[(size_t)c * 256 + d];
+                    uint32_t cnt = h;
+                    h = offset;
+                    offset += cnt;
+                }
+            }
+            #pragma omp parallel for schedule(static, 1)
+            for (int c = 0; c < chunks; ++c) {
+                uint32_t* next = &histogram[(size_t)c * 256];
+                for (int64_t i = n * c / chunks; i < n * (c + 1) / chunks; ++i) {
+                    uint32_t k = next[(keys[i] >> shift) & 0xFF]++;
+                    keyScratch[k] = keys[i];
+                    valueScratch[k] = values[i];
+                }
+            }
+            keys.swap(keyScratch);
+            values.swap(valueScratch);
+        }
+    }
+
+private:
+    static const int MAX_CHUNKS = 8;
+    std::vector<uint32_t> keyScratch, valueScratch, histogram;
+};
+
+class DepthSorter
+{
+public:
+    // sorts the particles alive at time back to front, returns order()
+    const std::vector<uint32_t>& sort(const ParticleStreams& streams, float time, const glm::mat4& viewProjection)
+    {
+        const int64_t n = (int64_t)streams.count();
+        if (state.size() != (size_t)n) {
+            state.assign((size_t)n, DEAD_PARTICLE);
+            birth.assign((size_t)n, 0.0f);
+            sorted.clear();
+        }
+        keyOf.resize((size_t)n);
+        // One sequential pass over the particles so the walk of last frame's order
+        // only gathers the key and the state. A survivor was in last frame's order and
+        // has not died and been emitted again since (it starts over at the emitter).
+        #pragma omp parallel for schedule(static)
+        for (int64_t i = 0; i < n; ++i) {
+            bool alive = time - streams.curtime[i] <= streams.lifetime[i];
+            if (alive) {
+                keyOf[i] = backToFrontKey(windowDepth(viewProjection, streams.posX[i], streams.posY[i], streams.posZ[i]));
+                state[i] = state[i] != DEAD_PARTICLE && streams.curtime[i] == birth[i] ? SURVIVOR : BORN;
+            }
+            else {
+                keyOf[i] = DEAD_KEY;
+                state[i] = DEAD_PARTICLE;
+            }
+            birth[i] = streams.curtime[i];
+        }
+
+        incremental = false;
+        if (retryIn > 0) {
+            --retryIn;
+        }
+        else if (!sorted.empty()) {
+            incremental = sortIncremental();
+            // the particles move too fast for their density, don't pay for the
+            // failed insertion sort again every frame
+            if (!incremental)
+                retryIn = RETRY_FRAMES;
+        }
+        if (!incremental)
+            sortFull();
+        return sorted;
+    }
+
+    // indices of the live particles, farthest first
+    const std::vector<uint32_t>& order() const { return sorted; }
+
+    // whether the last sort() reused the previous order or had to radix sort everything
+    bool wasIncremental() const { return incremental; }
+
+    // forgets the previous order, the next sort() starts from scratch
+    void reset()
+    {
+        sorted.clear();
+        retryIn = 0;
+    }
+
+private:
+    static const uint32_t DEAD_KEY = 0xFFFFFFFFu;
+    enum : uint8_t { DEAD_PARTICLE, SURVIVOR, BORN };
+    static const int RETRY_FRAMES = 16;
+
+    std::vector<uint32_t> keyOf;
+    std::vector<uint8_t> state;
+    std::vector<float> birth; // curtime of the particle when it was last sorted
+    std::vector<uint32_t> sorted;
+    std::vector<uint32_t> sortedKeys, survivorKeys, survivors, bornKeys, born;
+    RadixSorter radix;
+    bool incremental = false;
+    int retryIn = 0;
+
+    // last frame's order fixed up by an insertion sort, false (and sorted untouched)
+    // when that takes more than about one move per particle
+    bool sortIncremental()
+    {
+        survivorKeys.clear();
+        survivors.clear();
+        for (uint32_t i : sorted) {
+            if (state[i] == SURVIVOR) {
+                survivorKeys.push_back(keyOf[i]);
+                survivors.push_back(i);
+            }
+        }
+        if (!insertionSort(survivorKeys, survivors, survivors.size() + 64))
+            return false;
+
+        bornKeys.clear();
+        born.clear();
+        for (size_t i = 0; i < state.size(); ++i) {
+            if (state[i] == BORN) {
+                bornKeys.push_back(keyOf[i]);
+                born.push_back((uint32_t)i);
+            }
+        }
+        radix.sort(bornKeys, born);
+
+        // merge, survivors first on equal keys
+        sorted.resize(survivors.size() + born.size());
+        size_t a = 0, b = 0, k = 0;
+        while (a < survivors.size() && b < born.size())
+            sorted[k++] = bornKeys[b] < survivorKeys[a] ? born[b++] : survivors[a++];
+        while (a < survivors.size())
+            sorted[k++] = survivors[a++];
+        while (b < born.size())
+            sorted[k++] = born[b++];
+        return true;
+    }
+
+    // radix sort of every live particle
+    void sortFull()
+    {
+        sortedKeys.clear();
+        sorted.clear();
+        for (size_t i = 0; i < keyOf.size(); ++i) {
+            if (keyOf[i] != DEAD_KEY) {
+                sortedKeys.push_back(keyOf[i]);
+                sorted.push_back((uint32_t)i);
+            }
+        }
+        radix.sort(sortedKeys, sorted);
+    }
+
+    // insertion sort that gives up after budget element moves, returns false then
+    // (the arrays hold a permutation of the input either way)
+    static bool insertionSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, size_t budget)
+    {
+        size_t moves = 0;
+        for (size_t i = 1; i < keys.size(); ++i) {
+            uint32_t key = keys[i], value = values[i];
+            size_t j = i;
+            while (j > 0 && keys[j - 1] > key) {
+                keys[j] = keys[j - 1];
+                values[j] = values[j - 1];
+                --j;
+            }
+            keys[j] = key;
+            values[j] = value;
+            moves += i - j;
+            if (moves > budget)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -6,21 +6,49 @@ layout (location = 3) in float aLifetime;
 layout (location = 4) in float aCurtime;
 
 uniform float u_time;
-uniform vec3 u_acceleration; 
+uniform mat4 u_viewProjection;   // sceneViewProjection(), see depthCollision.h
+uniform float u_pointScale;      // 1 / the resolution divisor of the target (lowResParticles.h)
+uniform vec4 u_atlasRects[64];   // uv rects of the effect's atlas, MAX_ATLAS_RECTS of textureAtlas.h
+uniform int u_firstFrame;        // the effect's flipbook, see EffectRender
+uniform int u_frameCount;
+uniform int u_variantCount;
+uniform int u_blendFrames;
+uniform sampler2D s_curves;      // the effects' curves over age, see CurveLut in curves.h
+uniform vec2 u_curveRows;        // v of the effect's color row and its size/speed row
+#define CURVE_LUT_WIDTH 256
+
+// the flipbook frame of the particle's age and the next one, frameBlend of the way to it
+flat out vec4 frameRect;
+flat out vec4 nextFrameRect;
+out float frameBlend;
+// the color gradient at the particle's age
+out vec4 curveColor;
 
 void main()
 {            
     float deltaTime = u_time - aCurtime;                          
     if ( deltaTime <= aLifetime )                                 
     {                                                              
-        vec3 velocity = aVel + deltaTime * u_acceleration;    
-        vec3 position = aPos + deltaTime * velocity;          
-        gl_Position = vec4( position.xy,0.0,1.0 );                   
-        gl_PointSize = aSize * ( 1.0 - deltaTime / aLifetime );   
+        // aPos is integrated by emit.vert every frame
+        gl_Position = u_viewProjection * vec4( aPos, 1.0 );
+        float age = clamp( deltaTime / aLifetime, 0.0, 1.0 );
+        float curveU = ( age * float( CURVE_LUT_WIDTH - 1 ) + 0.5 ) / float( CURVE_LUT_WIDTH );
+        curveColor = textureLod( s_curves, vec2( curveU, u_curveRows.x ), 0.0 );
+        gl_PointSize = aSize * textureLod( s_curves, vec2( curveU, u_curveRows.y ), 0.0 ).r / gl_Position.w * u_pointScale;
+
+        // the frames play once over the lifetime, the variant is fixed per particle
+        // (gl_VertexID is the particle's index in the sorted draw too)
+        float frame = age * float( u_frameCount );
+        int current = min( int( frame ), u_frameCount - 1 );
+        int base = u_firstFrame + ( gl_VertexID % u_variantCount ) * u_frameCount;
+        frameRect = u_atlasRects[ base + current ];
+        nextFrameRect = u_atlasRects[ base + min( current + 1, u_frameCount - 1 ) ];
+        frameBlend = u_blendFrames != 0 ? frame - float( current ) : 0.0;
     }                                                              
     else                                                           
     {                                                              
         gl_Position = vec4( -1000, -1000, 0, 0 );                   
         gl_PointSize = 0.0;    
+        curveColor = vec4( 0.0 );
     }
 }
\ No newline at end of file
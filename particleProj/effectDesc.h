@@ -0,0 +1,424 @@
+#ifndef EFFECT_DESC_H
+#define EFFECT_DESC_H
+
+#ifndef PARTICLE_NO_GL
+#include <glad/glad.h>
+#endif
+
+#include "curves.h"
+#include "effectRender.h"
+#include "json.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Effects described by data files instead of constants in emit.vert and main.cpp.
+//
+// An effect file (effects/demo.json) holds one effect object or an array of them:
+//
+//   {
+//     "name": "smoke",
+//     "texture": "textures/smoke.tga",
+//     "emissionRate": 0.3,                  // FrameInput::emissionRate
+//     "lifetime": 2.0,
+//     "size": { "min": 60, "range": 20 },   // pixels, uniformly in [min, min + range]
+//     "velocity": { "min": [-1, 1, 0], "range": [2, 1.4, 0] },
+//     "acceleration": [0, -1, 0],           // FrameInput::acceleration
+//     "turbulence": 0.5,                    // FrameInput::turbulence
+//     "curves": { "size": [[0, 1], [1, 0]],  // [age, value] keys over the normalized age
+//                 "speed": [[0, 1], [1, 1]],
+//                 "color": [[0, [1, 1, 1, 1]], [1, [1, 1, 1, 1]]] },
+//     "update": "velX = velX + sin(time + posY) * dt",   // CPU backend only, particleVm.h
+//     "render": { "transparency": "weighted", "resolutionDivisor": 2, "softness": 0.1,
+//                 "firstFrame": 0, "frameCount": 1, "variantCount": 1, "blendFrames": true }
+//   }
+//
+// Every key is optional, the defaults are the demo's smoke. Each effect becomes one
+// flat EffectDesc; its spawn ranges are the std140 EffectBlock of emit.vert's Effect
+// block, so every effect shares the one emit program and only binds its range of
+// one uniform buffer (EffectBuffer).
+//
+// particleEffects compiles effect files into the binary form (.effects): a header
+// and the EffectDesc records as they are in memory, loaded with one read however
+// many effects there are. loadEffects() takes the compiled file beside a JSON file
+// while it is newer than the JSON.
+
+// std140 layout of the Effect block of emit.vert. A range is min + random * range,
+// the order emit.vert has always computed the spawn values in.
+struct EffectBlock {
+    glm::vec4 spawn = glm::vec4(2.0f, 60.0f, 20.0f, 0.0f);          // lifetime, size min, size range
+    glm::vec4 velocityMin = glm::vec4(-1.0f, 1.0f, 0.0f, 0.0f);
+    glm::vec4 velocityRange = glm::vec4(2.0f, 1.4f, 0.0f, 0.0f);    // a 0 z range draws no random z
+};
+
+const int EFFECT_NAME_SIZE = 32;
+const int EFFECT_PATH_SIZE = 128;
+const int EFFECT_UPDATE_SIZE = 256;
+
+// trivially copyable, the compiled form is an array of them
+struct EffectDesc {
+    EffectBlock block;
+    char name[EFFECT_NAME_SIZE] = "smoke";
+    char texture[EFFECT_PATH_SIZE] = "textures/smoke.tga";
+    float emissionRate = 0.3f;
+    glm::vec3 acceleration = glm::vec3(0.0f, -1.0f, 0.0f);
+    float turbulence = 0.5f;
+    EffectRender render;
+    EffectCurves curves;
+    char update[EFFECT_UPDATE_SIZE] = "";   // ParticleProgram source, a list of statements joined by ';'
+};
+
+inline const EffectDesc* findEffect(const std::vector<EffectDesc>& effects, const std::string& name)
+{
+    for (const EffectDesc& e : effects) {
+        if (name == e.name)
+            return &e;
+    }
+    return nullptr;
+}
+
+// ------------------------------------------------------------------ JSON
+
+// reads one effect object into desc, source names the file in the messages
+inline bool readEffect(const JsonValue& object, const std::string& source, EffectDesc& desc)
+{
+    if (object.type != JsonValue::OBJECT) {
+        std::cout << source << ": an effect must be an object" << std::endl;
+        return false;
+    }
+    bool ok = true;
+    auto complain = [&](const std::string& key, const char* what) {
+        std::cout << source << ": \"" << key << "\" " << what << std::endl;
+        ok = false;
+    };
+    auto number = [&](const std::string& key, const JsonValue& v, float& out) {
+        if (v.type == JsonValue::NUMBER)
+            out = (float)v.number;
+        else
+            complain(key, "must be a number");
+    };
+    auto integer = [&](const std::string& key, const JsonValue& v, int& out) {
+        if (v.type == JsonValue::NUMBER && v.number == (double)(int)v.number)
+            out = (int)v.number;
+        else
+            complain(key, "must be an integer");
+    };
+    auto vec3 = [&](const std::string& key, const JsonValue& v, glm::vec4& out) {
+        if (v.type != JsonValue::ARRAY || v.items.size() != 3) {
+            complain(key, "must be an array of 3 numbers");
+            return;
+        }
+        for (int i = 0; i < 3; ++i)
+            number(key, v.items[i], out[i]);
+    };
+    auto text = [&](const std::string& key, const JsonValue& v, char* out, size_t size) {
+        if (v.type != JsonValue::STRING)
+            complain(key, "must be a string");
+        else if (v.string.size() >= size)
+            complain(key, "is too long");
+        else
+            std::memcpy(out, v.string.c_str(), v.string.size() + 1);
+    };
+    // a min/range pair of numbers or of vec3s
+    auto range = [&](const std::string& key, const JsonValue& v, auto&& read) {
+        if (v.type != JsonValue::OBJECT) {
+            complain(key, "must be { \"min\": ..., \"range\": ... }");
+            return;
+        }
+        for (const auto& m : v.members) {
+            if (m.first == "min" || m.first == "range")
+                read(key + "." + m.first, m.second, m.first == "min");
+            else
+                complain(key + "." + m.first, "is not an effect key");
+        }
+    };
+    // [[age, value], ...] with 1 to MAX_CURVE_KEYS ascending ages in [0, 1]
+    auto keys = [&](const std::string& key, const JsonValue& v, int& count, float* time, auto&& value) {
+        if (v.type != JsonValue::ARRAY || v.items.empty() || v.items.size() > (size_t)MAX_CURVE_KEYS) {
+            complain(key, "must be an array of 1 to 8 [age, value] keys");
+            return;
+        }
+        for (size_t k = 0; k < v.items.size(); ++k) {
+            const JsonValue& item = v.items[k];
+            if (item.type != JsonValue::ARRAY || item.items.size() != 2) {
+                complain(key, "keys must be [age, value]");
+                return;
+            }
+            number(key, item.items[0], time[k]);
+            if (time[k] < 0.0f || time[k] > 1.0f || (k > 0 && time[k] < time[k - 1]))
+                complain(key, "ages must ascend within [0, 1]");
+            value(item.items[1], (int)k);
+        }
+        count = (int)v.items.size();
+    };
+
+    for (const auto& member : object.members) {
+        const std::string& key = member.first;
+        const JsonValue& v = member.second;
+        if (key == "name") {
+            text(key, v, desc.name, sizeof(desc.name));
+        }
+        else if (key == "texture") {
+            text(key, v, desc.texture, sizeof(desc.texture));
+        }
+        else if (key == "update") {
+            // one string, or an array of statements
+            JsonValue joined = v;
+            if (v.type == JsonValue::ARRAY) {
+                joined = JsonValue();
+                joined.type = JsonValue::STRING;
+                for (const JsonValue& statement : v.items) {
+                    if (statement.type != JsonValue::STRING)
+                        joined.type = JsonValue::NUL;
+                    else
+                        joined.string += (joined.string.empty() ? "" : "; ") + statement.string;
+                }
+            }
+            text(key, joined, desc.update, sizeof(desc.update));
+        }
+        else if (key == "emissionRate") {
+            number(key, v, desc.emissionRate);
+        }
+        else if (key == "lifetime") {
+            number(key, v, desc.block.spawn.x);
+        }
+        else if (key == "size") {
+            range(key, v, [&](const std::string& k, const JsonValue& x, bool isMin) {
+                number(k, x, isMin ? desc.block.spawn.y : desc.block.spawn.z);
+            });
+        }
+        else if (key == "velocity") {
+            range(key, v, [&](const std::string& k, const JsonValue& x, bool isMin) {
+                vec3(k, x, isMin ? desc.block.velocityMin : desc.block.velocityRange);
+            });
+        }
+        else if (key == "acceleration") {
+            glm::vec4 a(desc.acceleration, 0.0f);
+            vec3(key, v, a);
+            desc.acceleration = glm::vec3(a);
+        }
+        else if (key == "turbulence") {
+            number(key, v, desc.turbulence);
+        }
+        else if (key == "curves" && v.type == JsonValue::OBJECT) {
+            for (const auto& c : v.members) {
+                const std::string ckey = "curves." + c.first;
+                if (c.first == "size" || c.first == "speed") {
+                    Curve& curve = c.first == "size" ? desc.curves.size : desc.curves.speed;
+                    keys(ckey, c.second, curve.count, curve.time, [&](const JsonValue& x, int k) {
+                        number(ckey, x, curve.value[k]);
+                    });
+                }
+                else if (c.first == "color") {
+                    Gradient& gradient = desc.curves.color;
+                    keys(ckey, c.second, gradient.count, gradient.time, [&](const JsonValue& x, int k) {
+                        if (x.type != JsonValue::ARRAY || x.items.size() != 4) {
+                            complain(ckey, "colors must be arrays of 4 numbers");
+                            return;
+                        }
+                        for (int i = 0; i < 4; ++i)
+                            number(ckey, x.items[i], gradient.color[k][i]);
+                    });
+                }
+                else {
+                    complain(ckey, "is not an effect key");
+                }
+            }
+        }
+        else if (key == "render" && v.type == JsonValue::OBJECT) {
+            for (const auto& r : v.members) {
+                const std::string rkey = "render." + r.first;
+                if (r.first == "transparency") {
+                    const std::string& mode = r.second.string;
+                    if (r.second.type == JsonValue::STRING && mode == "blended")
+                        desc.render.transparency = TRANSPARENCY_BLENDED;
+                    else if (r.second.type == JsonValue::STRING && mode == "sorted")
+                        desc.render.transparency = TRANSPARENCY_SORTED;
+                    else if (r.second.type == JsonValue::STRING && mode == "weighted")
+                        desc.render.transparency = TRANSPARENCY_WEIGHTED;
+                    else
+                        complain(rkey, "must be \"blended\", \"sorted\" or \"weighted\"");
+                }
+                else if (r.first == "resolutionDivisor") {
+                    integer(rkey, r.second, desc.render.resolutionDivisor);
+                    if (desc.render.resolutionDivisor != 1 && desc.render.resolutionDivisor != 2 && desc.render.resolutionDivisor != 4)
+                        complain(rkey, "must be 1, 2 or 4");
+                }
+                else if (r.first == "softness") {
+                    number(rkey, r.second, desc.render.softness);
+                }
+                else if (r.first == "firstFrame") {
+                    integer(rkey, r.second, desc.render.firstFrame);
+                }
+                else if (r.first == "frameCount") {
+                    integer(rkey, r.second, desc.render.frameCount);
+                }
+                else if (r.first == "variantCount") {
+                    integer(rkey, r.second, desc.render.variantCount);
+                }
+                else if (r.first == "blendFrames") {
+                    if (r.second.type == JsonValue::BOOLEAN)
+                        desc.render.blendFrames = r.second.boolean;
+                    else
+                        complain(rkey, "must be true or false");
+                }
+                else {
+                    complain(rkey, "is not an effect key");
+                }
+            }
+        }
+        else {
+            complain(key, key == "render" || key == "curves" ? "must be an object" : "is not an effect key");
+        }
+    }
+    return ok;
+}
+
+// the effects of a JSON document, appended to effects
+inline bool parseEffects(const std::string& json, const std::string& source, std::vector<EffectDesc>& effects)
+{
+    JsonReader reader;
+    JsonValue root;
+    if (!reader.parse(json, root)) {
+        std::cout << source << ": " << reader.error() << std::endl;
+        return false;
+    }
+    if (root.type != JsonValue::ARRAY) {
+        effects.emplace_back();
+        return readEffect(root, source, effects.back());
+    }
+    for (const JsonValue& item : root.items) {
+        effects.emplace_back();
+        if (!readEffect(item, source, effects.back()))
+            return false;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------------ compiled form
+
+const uint32_t EFFECTS_MAGIC = 0x58464550; // "PEFX"
+const uint32_t EFFECTS_VERSION = 3;
+
+inline bool saveCompiledEffects(const std::filesystem::path& path, const std::vector<EffectDesc>& effects)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open compiled effects for writing: " << path.string() << std::endl;
+        return false;
+    }
+    // the record size guards against a file from a build with another EffectDesc
+    uint32_t header[4] = { EFFECTS_MAGIC, EFFECTS_VERSION, (uint32_t)sizeof(EffectDesc), (uint32_t)effects.size() };
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)effects.data(), (std::streamsize)(effects.size() * sizeof(EffectDesc)));
+    return (bool)out;
+}
+
+inline bool loadCompiledEffects(const std::filesystem::path& path, std::vector<EffectDesc>& effects)
+{
+    std::ifstream in(path, std::ios::binary);
+    uint32_t header[4] = {};
+    in.read((char*)header, sizeof(header));
+    if (!in || header[0] != EFFECTS_MAGIC || header[1] != EFFECTS_VERSION || header[2] != sizeof(EffectDesc)) {
+        std::cout << "Invalid or outdated compiled effects: " << path.string() << std::endl;
+        return false;
+    }
+    size_t first = effects.size();
+    effects.resize(first + header[3]);
+    in.read((char*)(effects.data() + first), (std::streamsize)(header[3] * sizeof(EffectDesc)));
+    if (!in) {
+        std::cout << "Truncated compiled effects: " << path.string() << std::endl;
+        effects.resize(first);
+        return false;
+    }
+    return true;
+}
+
+inline std::filesystem::path compiledEffectsPath(const std::filesystem::path& jsonPath)
+{
+    std::filesystem::path compiled = jsonPath;
+    return compiled.replace_extension(".effects");
+}
+
+// the effects of a .json or .effects file; for a .json file, its compiled
+// .effects while that is at least as new
+inline bool loadEffects(const std::filesystem::path& path, std::vector<EffectDesc>& effects)
+{
+    if (path.extension() == ".effects")
+        return loadCompiledEffects(path, effects);
+
+    std::error_code error;
+    std::filesystem::path compiled = compiledEffectsPath(path);
+    auto jsonTime = std::filesystem::last_write_time(path, error);
+    if (error) {
+        std::cout << "Failed to open effects: " << path.string() << std::endl;
+        return false;
+    }
+    auto compiledTime = std::filesystem::last_write_time(compiled, error);
+    if (!error && compiledTime >= jsonTime && loadCompiledEffects(compiled, effects))
+        return true;
+
+    std::ifstream in(path);
+    std::stringstream json;
+    json << in.rdbuf();
+    return parseEffects(json.str(), path.string(), effects);
+}
+
+#ifndef PARTICLE_NO_GL
+// The EffectBlocks of a set of effects in one uniform buffer, each at an offset the
+// GL can bind; bind() points the Effect block (binding EFFECT_BLOCK_BINDING) at one.
+const GLuint EFFECT_BLOCK_BINDING = 2;
+
+class EffectBuffer
+{
+public:
+    void init(const std::vector<EffectDesc>& effects)
+    {
+        release();
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(EffectBlock) + (size_t)alignment - 1) / (size_t)alignment * (size_t)alignment;
+        std::vector<uint8_t> data(stride * effects.size());
+        for (size_t i = 0; i < effects.size(); ++i)
+            std::memcpy(&data[i * stride], &effects[i].block, sizeof(EffectBlock));
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)data.size(), data.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // program's Effect block reads from EFFECT_BLOCK_BINDING
+    static void attach(GLuint program)
+    {
+        GLuint index = glGetUniformBlockIndex(program, "Effect");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, EFFECT_BLOCK_BINDING);
+    }
+
+    void bind(size_t effect) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, EFFECT_BLOCK_BINDING, ubo, (GLintptr)(effect * stride), sizeof(EffectBlock));
+    }
+
+    void release()
+    {
+        if (ubo)
+            glDeleteBuffers(1, &ubo);
+        ubo = 0;
+    }
+
+private:
+    GLuint ubo = 0;
+    size_t stride = 0;
+};
+#endif
+
+#endif
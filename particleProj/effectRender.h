@@ -0,0 +1,35 @@
+#ifndef EFFECT_RENDER_H
+#define EFFECT_RENDER_H
+
+// How an effect's particles are drawn, chosen per effect: the cost of each mode
+// depends on how many particles the effect has and how much their overlaps show.
+// The effect files set it (the "render" object, effectDesc.h).
+
+enum EffectTransparency {
+    TRANSPARENCY_BLENDED = 0,  // alpha blended in buffer order, the order is wrong where particles overlap
+    TRANSPARENCY_SORTED = 1,   // alpha blended back to front (depthSort.h, gpuDepthSort.h), exact
+    TRANSPARENCY_WEIGHTED = 2, // weighted blended OIT (weightedOit.h), no sort, approximate
+};
+
+struct EffectRender {
+    int transparency = TRANSPARENCY_BLENDED;
+    int resolutionDivisor = 1; // 1, 2 or 4: drawn at full, half or quarter resolution (lowResParticles.h)
+    float softness = 0.0f;     // distance over which the particles fade into the scene depth, 0 for hard edges
+
+    // flipbook in the effect's atlas (textureAtlas.h): variantCount flipbooks of
+    // frameCount consecutive rects from firstFrame, each particle plays one of them
+    // once over its lifetime
+    int firstFrame = 0;
+    int frameCount = 1;
+    int variantCount = 1;
+    bool blendFrames = true;   // crossfade into the next frame by the age within the frame
+};
+
+// whether the flipbook of effect is inside an atlas of rectCount rects
+inline bool flipbookFits(const EffectRender& effect, size_t rectCount)
+{
+    return effect.firstFrame >= 0 && effect.frameCount > 0 && effect.variantCount > 0 &&
+           (size_t)effect.firstFrame + (size_t)effect.frameCount * effect.variantCount <= rectCount;
+}
+
+#endif
@@ -13,28 +13,320 @@ out float outLifetime;
 out float outCurtime;
 
 uniform float u_time;
+uniform float u_deltaTime;
 uniform sampler3D s_noiseTex;
+uniform sampler3D s_curlTex;
 uniform float u_emissionRate;    
+uniform float u_seed;
+uniform int u_spawnBurst;
+uniform int u_particleCount;
+uniform vec3 u_acceleration;
+uniform float u_turbulence;
+uniform float u_separation;
+uniform float u_neighborRadius;
+
+// neighbor grid of the source buffer, see gpuGrid.h
+uniform usamplerBuffer s_gridStarts;    // first particle of every bucket, then the particle count
+uniform samplerBuffer s_gridParticles;  // cell ordered copy of the particles, 9 floats each
+uniform float u_gridInvCellSize;
+uniform int u_gridBucketBits;
+
+// scene colliders overlapping the emitter, see colliders.h for the packing
+#define MAX_COLLIDERS 64
+struct Collider
+{
+   vec4 shape0;
+   vec4 shape1;
+   vec4 response;   // type, restitution, friction, kill
+};
+layout (std140) uniform Colliders
+{
+   Collider u_colliders[MAX_COLLIDERS];
+};
+uniform int u_colliderCount;
+uniform sampler3D s_sdfTex;   // RGBA32F gradient and signed distance of the COLLIDER_SDF colliders
+
+// force fields of the scene, see forceFields.h for the packing
+#define MAX_FORCE_FIELDS 32
+struct ForceField
+{
+   vec4 shape0;
+   vec4 shape1;
+   vec4 params;   // type, strength, radius
+};
+layout (std140) uniform ForceFields
+{
+   ForceField u_forceFields[MAX_FORCE_FIELDS];
+};
+uniform int u_forceFieldCount;
+
+// the effect's spawn ranges, see EffectBlock in effectDesc.h
+layout (std140) uniform Effect
+{
+   vec4 u_spawn;           // lifetime, size min, size range
+   vec4 u_velocityMin;
+   vec4 u_velocityRange;   // a 0 z range draws no random z
+};
+
+// the effect's speed over age, the g of its size/speed row (CurveLut in curves.h)
+uniform sampler2D s_curves;
+uniform float u_speedRow;
+#define CURVE_LUT_WIDTH 256
+
+// scene depth collision, see depthCollision.h
+uniform int u_depthCollision;
+uniform sampler2D s_sceneDepth;
+uniform mat4 u_viewProjection;
+uniform mat4 u_inverseViewProjection;
+uniform float u_depthThickness;
+uniform vec2 u_depthResponse;   // restitution, friction
 
 float randomValue( inout float seed )                              
 {                                                                  
-   float vertexId = float( gl_VertexID ) / float( 200 ); 
+   float vertexId = float( gl_VertexID ) / float( u_particleCount ); 
    vec3 texCoord = vec3( u_time, vertexId, seed );                 
    seed += 0.1;                                                    
    return texture( s_noiseTex, texCoord ).r;                       
 }    
 
+// position -> curl volume coordinate, scrolled in z over time so the flow evolves
+vec3 curlCoord( vec3 pos )
+{
+   return vec3( pos.xy * 0.5 + 0.5, pos.z * 0.5 + 0.5 + u_time * 0.05 );
+}
+
+// SpatialGrid::bucket()
+uint gridBucket( ivec3 cell )
+{
+   uint h = ( uint( cell.y ) & 0xFFFFu ) | ( uint( cell.z ) << 16 );
+   h ^= h >> 16;
+   h *= 0x7FEB352Du;
+   h ^= h >> 15;
+   h *= 0x846CA68Bu;
+   h ^= h >> 16;
+   uint rowBucket = u_gridBucketBits == 0 ? 0u : h >> ( 32 - u_gridBucketBits );
+   return ( rowBucket + uint( cell.x ) ) & ( ( 1u << u_gridBucketBits ) - 1u );
+}
+
+// repulsion from the live particles within u_neighborRadius, falls off linearly with distance
+vec3 neighborForce( vec3 pos )
+{
+   vec3 force = vec3( 0.0 );
+   ivec3 c0 = ivec3( floor( ( pos - u_neighborRadius ) * u_gridInvCellSize ) );
+   ivec3 c1 = ivec3( floor( ( pos + u_neighborRadius ) * u_gridInvCellSize ) );
+   for( int z = c0.z; z <= c1.z; ++z )
+   for( int y = c0.y; y <= c1.y; ++y )
+   for( int x = c0.x; x <= c1.x; ++x )
+   {
+      ivec3 cell = ivec3( x, y, z );
+      int bucket = int( gridBucket( cell ) );
+      int end = int( texelFetch( s_gridStarts, bucket + 1 ).r );
+      for( int k = int( texelFetch( s_gridStarts, bucket ).r ); k < end; ++k )
+      {
+         vec3 q = vec3( texelFetch( s_gridParticles, k * 9 ).r,
+                        texelFetch( s_gridParticles, k * 9 + 1 ).r,
+                        texelFetch( s_gridParticles, k * 9 + 2 ).r );
+         // buckets are shared by cells, skip the other cells' particles
+         if( ivec3( floor( q * u_gridInvCellSize ) ) != cell )
+            continue;
+         float lifetime = texelFetch( s_gridParticles, k * 9 + 7 ).r;
+         float curtime = texelFetch( s_gridParticles, k * 9 + 8 ).r;
+         vec3 d = pos - q;
+         float d2 = dot( d, d );
+         if( d2 == 0.0 || d2 > u_neighborRadius * u_neighborRadius || u_time - curtime > lifetime )
+            continue;
+         float dist = sqrt( d2 );
+         force += ( 1.0 - dist / u_neighborRadius ) / dist * d;
+      }
+   }
+   return u_separation * force;
+}
+
+// moves pos out of the colliders it ended up in and bounces vel off them,
+// returns true when a kill collider was hit
+bool collide( inout vec3 pos, inout vec3 vel )
+{
+   for( int i = 0; i < u_colliderCount; ++i )
+   {
+      Collider c = u_colliders[i];
+      int type = int( c.response.x );
+      vec3 n;
+      float d;
+      if( type == 0 )
+      {
+         n = c.shape0.xyz;
+         d = dot( pos, n ) - c.shape0.w;
+      }
+      else if( type == 2 )
+      {
+         // inside the box the nearest face is the one along the largest e
+         vec3 q = pos - c.shape0.xyz;
+         vec3 e = abs( q ) - c.shape1.xyz;
+         d = max( e.x, max( e.y, e.z ) );
+         if( e.x >= e.y && e.x >= e.z )
+            n = vec3( q.x < 0.0 ? -1.0 : 1.0, 0.0, 0.0 );
+         else if( e.y >= e.z )
+            n = vec3( 0.0, q.y < 0.0 ? -1.0 : 1.0, 0.0 );
+         else
+            n = vec3( 0.0, 0.0, q.z < 0.0 ? -1.0 : 1.0 );
+      }
+      else if( type == 4 )
+      {
+         // baked volume, one fetch gives the distance and its gradient
+         vec3 coord = ( pos - c.shape0.xyz ) / c.shape0.w;
+         if( any( lessThan( coord, vec3( 0.0 ) ) ) || any( greaterThan( coord, vec3( 1.0 ) ) ) )
+            continue;
+         vec4 g = texture( s_sdfTex, coord );
+         float len = length( g.rgb );
+         d = g.a;
+         n = len > 0.0 ? g.rgb / len : vec3( 0.0, 1.0, 0.0 );
+      }
+      else
+      {
+         // sphere, or a capsule around its closest point on the segment
+         vec3 center = c.shape0.xyz;
+         if( type == 3 )
+         {
+            vec3 ab = c.shape1.xyz - c.shape0.xyz;
+            float t = clamp( dot( pos - c.shape0.xyz, ab ) / dot( ab, ab ), 0.0, 1.0 );
+            center = c.shape0.xyz + t * ab;
+         }
+         vec3 v = pos - center;
+         float len = length( v );
+         d = len - c.shape0.w;
+         n = len > 0.0 ? v / len : vec3( 0.0, 1.0, 0.0 );
+      }
+      if( d >= 0.0 )
+         continue;
+      if( c.response.w != 0.0 )
+         return true;
+      pos -= d * n;
+      float vn = dot( vel, n );
+      if( vn < 0.0 )
+      {
+         vec3 vt = vel - vn * n;
+         vel = vt * ( 1.0 - c.response.z ) - c.response.y * vn * n;
+      }
+   }
+   return false;
+}
+
+// sum of the force fields in one loop, accumulateForceFields() on the CPU
+vec3 fieldForce( vec3 p, vec3 v )
+{
+   vec3 force = vec3( 0.0 );
+   for( int k = 0; k < u_forceFieldCount; ++k )
+   {
+      ForceField f = u_forceFields[k];
+      int type = int( f.params.x );
+      float s = f.params.y;
+      float invRadius = 1.0 / f.params.z;
+      if( type == 0 )
+      {
+         // attractor
+         vec3 r = f.shape0.xyz - p;
+         float d = length( r );
+         float w = max( 1.0 - d * invRadius, 0.0 );
+         force += r * ( d > 0.0 ? s * w / d : 0.0 );
+      }
+      else if( type == 1 )
+      {
+         // vortex, swirls around the axis and pulls toward it
+         vec3 axis = f.shape1.xyz;
+         vec3 q = p - f.shape0.xyz;
+         vec3 r = q - dot( q, axis ) * axis;
+         float d = length( r );
+         float w = max( 1.0 - d * invRadius, 0.0 );
+         force += ( s * cross( axis, r ) - f.shape1.w * r ) * ( d > 0.0 ? w / d : 0.0 );
+      }
+      else if( type == 2 )
+      {
+         // drag
+         force += -s * v;
+      }
+      else
+      {
+         // wind, the gust scrolls through the emission noise
+         float gust = 1.0 + f.shape1.x * ( texture( s_noiseTex, p * f.shape1.z + vec3( u_time * f.shape1.y ) ).r * 2.0 - 1.0 );
+         force += s * ( f.shape0.xyz * gust - v );
+      }
+   }
+   return force;
+}
+
+float sceneDepth( ivec2 texel )
+{
+   ivec2 size = textureSize( s_sceneDepth, 0 );
+   return texelFetch( s_sceneDepth, clamp( texel, ivec2( 0 ), size - 1 ), 0 ).r;
+}
+
+// world position of the center of a depth texel
+vec3 unprojectTexel( ivec2 texel, float depth )
+{
+   vec2 size = vec2( textureSize( s_sceneDepth, 0 ) );
+   vec4 world = u_inverseViewProjection * vec4( ( vec2( texel ) + 0.5 ) / size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0 );
+   return world.xyz / world.w;
+}
+
+// central neighbor difference, one sided where the other side is a different surface
+vec3 depthDifference( ivec2 texel, ivec2 offset, float depth, vec3 center )
+{
+   float forward = sceneDepth( texel + offset );
+   float backward = sceneDepth( texel - offset );
+   float df = abs( forward - depth );
+   float db = abs( depth - backward );
+   if( df > 2.0 * db )
+      return center - unprojectTexel( texel - offset, backward );
+   if( db > 2.0 * df )
+      return unprojectTexel( texel + offset, forward ) - center;
+   return ( unprojectTexel( texel + offset, forward ) - unprojectTexel( texel - offset, backward ) ) * 0.5;
+}
+
+// moves a particle that went just behind the depth buffer onto the surface and
+// bounces it off the normal reconstructed from the neighboring depth texels
+void depthCollide( inout vec3 pos, inout vec3 vel )
+{
+   vec4 clip = u_viewProjection * vec4( pos, 1.0 );
+   if( clip.w <= 0.0 )
+      return;
+   vec3 ndc = clip.xyz / clip.w;
+   if( abs( ndc.x ) >= 1.0 || abs( ndc.y ) >= 1.0 )
+      return;
+   ivec2 texel = ivec2( ( ndc.xy * 0.5 + 0.5 ) * vec2( textureSize( s_sceneDepth, 0 ) ) );
+   float depth = sceneDepth( texel );
+   if( depth >= 1.0 || ndc.z * 0.5 + 0.5 <= depth )
+      return;
+   vec3 center = unprojectTexel( texel, depth );
+   if( length( pos - center ) > u_depthThickness )
+      return;
+
+   vec3 n = cross( depthDifference( texel, ivec2( 1, 0 ), depth, center ),
+                   depthDifference( texel, ivec2( 0, 1 ), depth, center ) );
+   float len = length( n );
+   n = len > 0.0 ? n / len : normalize( unprojectTexel( texel, 0.0 ) - unprojectTexel( texel, 1.0 ) );
+
+   vec4 surface = u_inverseViewProjection * vec4( ndc.xy, depth * 2.0 - 1.0, 1.0 );
+   pos = surface.xyz / surface.w;
+   float vn = dot( vel, n );
+   if( vn < 0.0 )
+   {
+      vec3 vt = vel - vn * n;
+      vel = vt * ( 1.0 - u_depthResponse.y ) - u_depthResponse.x * vn * n;
+   }
+}
+
 void main()
 {
-    float seed = u_time;  
+    float seed = u_time + u_seed;  
     float deltaTime = u_time - aCurtime;
-    float lifetime = aCurtime - u_time;  
-    if(lifetime <= 0.0 && randomValue(seed) < u_emissionRate){
-        outVel = vec3(randomValue(seed) * 2.0 - 1.0,    
-                       randomValue(seed) * 1.4 + 1.0,0);   
+    bool burst = gl_VertexID < u_spawnBurst;
+    if(deltaTime > aLifetime && (burst || randomValue(seed) < u_emissionRate)){
+        outVel.x = u_velocityMin.x + randomValue(seed) * u_velocityRange.x;
+        outVel.y = u_velocityMin.y + randomValue(seed) * u_velocityRange.y;
+        outVel.z = u_velocityRange.z != 0.0 ? u_velocityMin.z + randomValue(seed) * u_velocityRange.z : u_velocityMin.z;
         outPos = vec3(0,0,0);
-        outSize = randomValue(seed) * 20.0 + 60.0;  
-        outLifetime = 2.0;   
+        outSize = u_spawn.y + randomValue(seed) * u_spawn.z;
+        outLifetime = u_spawn.x;
         outCurtime = u_time;                                     
     } 
     else{
@@ -43,6 +335,26 @@ void main()
         outSize = aSize;   
         outLifetime = aLifetime;
         outCurtime = aCurtime;
+        if(deltaTime <= aLifetime){
+            // advection: gravity, the precomputed curl noise turbulence, the neighbor
+            // separation and the force fields
+            vec3 force = u_acceleration;
+            if(u_turbulence != 0.0)
+                force += u_turbulence * texture( s_curlTex, curlCoord( aPos ) ).rgb;
+            if(u_separation != 0.0)
+                force += neighborForce( aPos );
+            if(u_forceFieldCount > 0)
+                force += fieldForce( aPos, aVel );
+            outVel += force * u_deltaTime;
+            float age = clamp( deltaTime / aLifetime, 0.0, 1.0 );
+            float speed = textureLod( s_curves, vec2( ( age * float( CURVE_LUT_WIDTH - 1 ) + 0.5 ) / float( CURVE_LUT_WIDTH ), u_speedRow ), 0.0 ).g;
+            outPos += outVel * speed * u_deltaTime;
+            // a killed particle reads as expired, draw.vert hides it and it may respawn
+            if(u_colliderCount > 0 && collide( outPos, outVel ))
+                outLifetime = -1.0;
+            if(u_depthCollision != 0)
+                depthCollide( outPos, outVel );
+        }
     }
     
-}
\ No newline at end of file
+}
@@ -0,0 +1,277 @@
+#ifndef FORCE_FIELDS_H
+#define FORCE_FIELDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Force fields added to the acceleration of the integrated step.
+//
+// The fields of the scene go to emit.vert as one uniform block (ForceFields, see
+// packForceFields) and fieldForce() sums them in a single loop per particle, so any
+// number of fields costs one pass. The CPU backend evaluates the same sum with
+// accumulateForceFields() over the SoA particle streams: particles are taken in
+// chunks that stay in L1, every field runs over the whole chunk 4 particles at a
+// time (SSE2, see FieldLanes) and the chunk's force is summed in field order like
+// the shader sums it.
+//
+//   attractor  pulls toward a point (a repulsor with a negative strength)
+//   vortex     swirls around an axis, optionally pulling toward it
+//   drag       opposes the velocity
+//   wind       drags toward a wind velocity scaled by a noise gust
+
+enum ForceFieldType {
+    FORCE_ATTRACTOR = 0,
+    FORCE_VORTEX = 1,
+    FORCE_DRAG = 2,
+    FORCE_WIND = 3,
+};
+
+// the same packing as the ForceField struct of emit.vert, params = (type, strength, radius, 0):
+//   attractor  shape0 = (center, 0)
+//   vortex     shape0 = (point on the axis, 0),  shape1 = (unit axis, pull toward the axis)
+//   drag       -
+//   wind       shape0 = (wind velocity, 0),      shape1 = (gust amplitude, gust frequency, gust scale, 0)
+// Attractors and vortices fade linearly to 0 at radius, drag and wind are global.
+struct ForceField {
+    int type = FORCE_DRAG;
+    glm::vec4 shape0 = glm::vec4(0.0f);
+    glm::vec4 shape1 = glm::vec4(0.0f);
+    float strength = 0.0f;
+    float radius = 1.0f;
+
+    static ForceField attractor(const glm::vec3& center, float strength, float radius)
+    {
+        ForceField f;
+        f.type = FORCE_ATTRACTOR;
+        f.shape0 = glm::vec4(center, 0.0f);
+        f.strength = strength;
+        f.radius = radius;
+        return f;
+    }
+
+    static ForceField vortex(const glm::vec3& point, const glm::vec3& axis, float strength, float radius, float pull = 0.0f)
+    {
+        ForceField f;
+        f.type = FORCE_VORTEX;
+        f.shape0 = glm::vec4(point, 0.0f);
+        f.shape1 = glm::vec4(glm::normalize(axis), pull);
+        f.strength = strength;
+        f.radius = radius;
+        return f;
+    }
+
+    // acceleration -coefficient * velocity
+    static ForceField drag(float coefficient)
+    {
+        ForceField f;
+        f.type = FORCE_DRAG;
+        f.strength = coefficient;
+        return f;
+    }
+
+    // acceleration coefficient * (velocity * gust - particle velocity), gust is
+    // 1 + amplitude * (noise * 2 - 1) of the emission noise at position * scale
+    // scrolled by time * frequency
+    static ForceField wind(const glm::vec3& velocity, float coefficient, float gustAmplitude = 0.0f,
+                           float gustFrequency = 0.0f, float gustScale = 1.0f)
+    {
+        ForceField f;
+        f.type = FORCE_WIND;
+        f.shape0 = glm::vec4(velocity, 0.0f);
+        f.shape1 = glm::vec4(gustAmplitude, gustFrequency, gustScale, 0.0f);
+        f.strength = coefficient;
+        return f;
+    }
+
+    // largest acceleration the field adds away from the velocity, drag only slows
+    // particles down so it adds none (see emitterBounds)
+    float maxAcceleration() const
+    {
+        switch (type) {
+        case FORCE_ATTRACTOR:
+            return std::fabs(strength);
+        case FORCE_VORTEX:
+            return std::sqrt(strength * strength + shape1.w * shape1.w);
+        case FORCE_WIND:
+            return std::fabs(strength) * glm::length(glm::vec3(shape0)) * (1.0f + std::fabs(shape1.x));
+        default:
+            return 0.0f;
+        }
+    }
+};
+
+const int MAX_FORCE_FIELDS = 32;
+
+// the ForceFields uniform block of emit.vert, std140: three vec4 per field
+struct ForceFieldBlock {
+    glm::vec4 fields[MAX_FORCE_FIELDS * 3];
+};
+
+// fills block with the fields, returns the count for u_forceFieldCount
+inline int packForceFields(const std::vector<ForceField>& fields, ForceFieldBlock& block)
+{
+    int count = (int)std::min(fields.size(), (size_t)MAX_FORCE_FIELDS);
+    for (int i = 0; i < count; ++i) {
+        const ForceField& f = fields[i];
+        block.fields[i * 3] = f.shape0;
+        block.fields[i * 3 + 1] = f.shape1;
+        block.fields[i * 3 + 2] = glm::vec4((float)f.type, f.strength, f.radius, 0.0f);
+    }
+    return count;
+}
+
+// bound of the acceleration all the fields add together, for emitterBounds()
+inline float maxFieldAcceleration(const std::vector<ForceField>& fields)
+{
+    float a = 0.0f;
+    for (size_t i = 0; i < fields.size() && i < (size_t)MAX_FORCE_FIELDS; ++i)
+        a += fields[i].maxAcceleration();
+    return a;
+}
+
+const int FORCE_FIELD_CHUNK = 256;
+
+// Lanes of the CPU field kernels: 4 floats with SSE2, 1 otherwise. Each kernel is
+// written once over FieldLanes, every lane does the scalar math of fieldForce() in
+// the same order, so both widths give the same bits.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+struct FieldLanes {
+    static const int WIDTH = 4;
+    __m128 v;
+    FieldLanes(__m128 value) : v(value) {}
+    FieldLanes(float value) : v(_mm_set1_ps(value)) {}
+    static FieldLanes load(const float* p) { return _mm_load_ps(p); }
+    void store(float* p) const { _mm_store_ps(p, v); }
+};
+inline FieldLanes operator+(FieldLanes a, FieldLanes b) { return _mm_add_ps(a.v, b.v); }
+inline FieldLanes operator-(FieldLanes a, FieldLanes b) { return _mm_sub_ps(a.v, b.v); }
+inline FieldLanes operator*(FieldLanes a, FieldLanes b) { return _mm_mul_ps(a.v, b.v); }
+inline FieldLanes operator/(FieldLanes a, FieldLanes b) { return _mm_div_ps(a.v, b.v); }
+inline FieldLanes sqrt(FieldLanes a) { return _mm_sqrt_ps(a.v); }
+inline FieldLanes maxZero(FieldLanes a) { return _mm_max_ps(a.v, _mm_setzero_ps()); }
+// a where d > 0, else 0
+inline FieldLanes whenPositive(FieldLanes d, FieldLanes a) { return _mm_and_ps(_mm_cmpgt_ps(d.v, _mm_setzero_ps()), a.v); }
+#else
+struct FieldLanes {
+    static const int WIDTH = 1;
+    float v;
+    FieldLanes(float value) : v(value) {}
+    static FieldLanes load(const float* p) { return *p; }
+    void store(float* p) const { *p = v; }
+};
+inline FieldLanes operator+(FieldLanes a, FieldLanes b) { return a.v + b.v; }
+inline FieldLanes operator-(FieldLanes a, FieldLanes b) { return a.v - b.v; }
+inline FieldLanes operator*(FieldLanes a, FieldLanes b) { return a.v * b.v; }
+inline FieldLanes operator/(FieldLanes a, FieldLanes b) { return a.v / b.v; }
+inline FieldLanes sqrt(FieldLanes a) { return std::sqrt(a.v); }
+inline FieldLanes maxZero(FieldLanes a) { return std::max(a.v, 0.0f); }
+inline FieldLanes whenPositive(FieldLanes d, FieldLanes a) { return d.v > 0.0f ? a.v : 0.0f; }
+#endif
+
+// The fieldForce() of emit.vert for count particles, written to fx, fy, fz. At most
+// FORCE_FIELD_CHUNK particles per call, the caller walks the streams chunk by chunk.
+// gust(coord) is the emission noise lookup of the wind fields.
+template <class Gust>
+inline void accumulateForceFields(const std::vector<ForceField>& fields, float time,
+                                  const float* x, const float* y, const float* z,
+                                  const float* vx, const float* vy, const float* vz,
+                                  float* fx, float* fy, float* fz, int count, Gust&& gust)
+{
+    // aligned copies padded to whole lanes, the padding lanes are zeros and dropped
+    alignas(16) float px[FORCE_FIELD_CHUNK], py[FORCE_FIELD_CHUNK], pz[FORCE_FIELD_CHUNK];
+    alignas(16) float ux[FORCE_FIELD_CHUNK], uy[FORCE_FIELD_CHUNK], uz[FORCE_FIELD_CHUNK];
+    alignas(16) float ax[FORCE_FIELD_CHUNK], ay[FORCE_FIELD_CHUNK], az[FORCE_FIELD_CHUNK];
+    alignas(16) float gusts[FORCE_FIELD_CHUNK];
+    const int padded = (count + FieldLanes::WIDTH - 1) / FieldLanes::WIDTH * FieldLanes::WIDTH;
+    for (int i = 0; i < padded; ++i) {
+        bool in = i < count;
+        px[i] = in ? x[i] : 0.0f;
+        py[i] = in ? y[i] : 0.0f;
+        pz[i] = in ? z[i] : 0.0f;
+        ux[i] = in ? vx[i] : 0.0f;
+        uy[i] = in ? vy[i] : 0.0f;
+        uz[i] = in ? vz[i] : 0.0f;
+        ax[i] = ay[i] = az[i] = 0.0f;
+        gusts[i] = 1.0f;
+    }
+
+    typedef FieldLanes L;
+    const size_t fieldCount = std::min(fields.size(), (size_t)MAX_FORCE_FIELDS);
+    for (size_t k = 0; k < fieldCount; ++k) {
+        const ForceField& f = fields[k];
+        const L s = f.strength, invRadius = 1.0f / f.radius, one = 1.0f;
+        const L p0x = f.shape0.x, p0y = f.shape0.y, p0z = f.shape0.z;
+        const L p1x = f.shape1.x, p1y = f.shape1.y, p1z = f.shape1.z, p1w = f.shape1.w;
+        switch (f.type) {
+        case FORCE_ATTRACTOR:
+            for (int i = 0; i < padded; i += L::WIDTH) {
+                L rx = p0x - L::load(px + i), ry = p0y - L::load(py + i), rz = p0z - L::load(pz + i);
+                L d = sqrt(rx * rx + ry * ry + rz * rz);
+                L w = maxZero(one - d * invRadius);
+                L a = whenPositive(d, s * w / d);
+                (L::load(ax + i) + rx * a).store(ax + i);
+                (L::load(ay + i) + ry * a).store(ay + i);
+                (L::load(az + i) + rz * a).store(az + i);
+            }
+            break;
+        case FORCE_VORTEX:
+            for (int i = 0; i < padded; i += L::WIDTH) {
+                // r is the offset from the axis, t = axis x r its swirl direction
+                L qx = L::load(px + i) - p0x, qy = L::load(py + i) - p0y, qz = L::load(pz + i) - p0z;
+                L along = qx * p1x + qy * p1y + qz * p1z;
+                L rx = qx - along * p1x, ry = qy - along * p1y, rz = qz - along * p1z;
+                L d = sqrt(rx * rx + ry * ry + rz * rz);
+                L w = maxZero(one - d * invRadius);
+                L a = whenPositive(d, w / d);
+                L tx = p1y * rz - p1z * ry, ty = p1z * rx - p1x * rz, tz = p1x * ry - p1y * rx;
+                (L::load(ax + i) + (s * tx - p1w * rx) * a).store(ax + i);
+                (L::load(ay + i) + (s * ty - p1w * ry) * a).store(ay + i);
+                (L::load(az + i) + (s * tz - p1w * rz) * a).store(az + i);
+            }
+            break;
+        case FORCE_DRAG:
+            for (int i = 0; i < padded; i += L::WIDTH) {
+                L drag = L(0.0f) - s;
+                (L::load(ax + i) + drag * L::load(ux + i)).store(ax + i);
+                (L::load(ay + i) + drag * L::load(uy + i)).store(ay + i);
+                (L::load(az + i) + drag * L::load(uz + i)).store(az + i);
+            }
+            break;
+        case FORCE_WIND:
+            // the noise lookups are per particle, the rest runs in lanes
+            for (int i = 0; i < count; ++i) {
+                glm::vec3 coord = glm::vec3(px[i], py[i], pz[i]) * f.shape1.z + glm::vec3(time * f.shape1.y);
+                gusts[i] = 1.0f + f.shape1.x * (gust(coord) * 2.0f - 1.0f);
+            }
+            for (int i = 0; i < padded; i += L::WIDTH) {
+                L g = L::load(gusts + i);
+                (L::load(ax + i) + s * (p0x * g - L::load(ux + i))).store(ax + i);
+                (L::load(ay + i) + s * (p0y * g - L::load(uy + i))).store(ay + i);
+                (L::load(az + i) + s * (p0z * g - L::load(uz + i))).store(az + i);
+            }
+            break;
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        fx[i] = ax[i];
+        fy[i] = ay[i];
+        fz[i] = az[i];
+    }
+}
+
+// the fields of the app, particleSim replays journals against the same ones
+inline void demoForceFields(std::vector<ForceField>& fields)
+{
+    fields.clear();
+    fields.push_back(ForceField::attractor(glm::vec3(0.5f, 0.6f, 0.0f), 1.5f, 0.6f));
+    fields.push_back(ForceField::vortex(glm::vec3(-0.35f, 0.55f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 2.0f, 0.4f, 0.5f));
+    fields.push_back(ForceField::drag(0.3f));
+    fields.push_back(ForceField::wind(glm::vec3(0.6f, 0.0f, 0.0f), 0.5f, 0.5f, 0.3f, 1.5f));
+}
+
+#endif
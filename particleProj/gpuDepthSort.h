@@ -0,0 +1,153 @@
+#ifndef GPU_DEPTH_SORT_H
+#define GPU_DEPTH_SORT_H
+
+#include <glad/glad.h>
+
+#include "particle.h"
+#include "depthSort.h"
+#include "computeShader.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Back to front element buffer of the GPU particle buffer for the sorted draw.
+//
+// With GL 4.3 sortKeys.comp writes the key of every particle and bitonicSort.comp
+// sorts the (key, index) pairs, padded to a power of two, in place; the sorted
+// indices are the element buffer. Dead particles sort after the live ones, the draw
+// takes all of them and draw.vert hides the dead. The bitonic network costs the same
+// whatever the input order, so unlike DepthSorter it gains nothing from last frame's
+// order.
+//
+// Without compute the app sorts a readback with DepthSorter and upload() writes its
+// order into the same element buffer.
+class GpuDepthSort
+{
+public:
+    // returns false when the compute path isn't available, upload() must be used then
+    bool init(size_t maxParticles)
+    {
+        release();
+        capacity = maxParticles;
+        size_t padded = sortCountFor(maxParticles);
+        glGenBuffers(1, &keysBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, keysBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * padded, nullptr, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * padded, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+#ifdef GL_VERSION_4_3
+        if (GLAD_GL_VERSION_4_3) {
+            keysProgram = loadComputeProgram("sortKeys.comp");
+            sortProgram = loadComputeProgram("bitonicSort.comp");
+            compute = keysProgram && sortProgram;
+        }
+#endif
+        return compute;
+    }
+
+    bool hasCompute() const { return compute; }
+
+    // sorts the first count particles of particleBuffer (the transform feedback
+    // layout), returns the number of elements to draw
+#ifdef GL_VERSION_4_3
+    size_t sort(GLuint particleBuffer, size_t count, float time, const glm::mat4& viewProjection)
+    {
+        if (!compute || count > capacity)
+            return 0;
+        const GLuint sortCount = (GLuint)sortCountFor(count);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, keysBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indexBuffer);
+
+        glUseProgram(keysProgram);
+        glUniform1ui(glGetUniformLocation(keysProgram, "u_particleCount"), (GLuint)count);
+        glUniform1ui(glGetUniformLocation(keysProgram, "u_sortCount"), sortCount);
+        glUniform1f(glGetUniformLocation(keysProgram, "u_time"), time);
+        glUniformMatrix4fv(glGetUniformLocation(keysProgram, "u_viewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+        glDispatchCompute((sortCount + 255) / 256, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(sortProgram);
+        GLint stage = glGetUniformLocation(sortProgram, "u_stage");
+        GLint size = glGetUniformLocation(sortProgram, "u_size");
+        GLint distance = glGetUniformLocation(sortProgram, "u_distance");
+        const GLuint blocks = sortCount / BLOCK;
+        glUniform1i(stage, 0);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        for (GLuint s = BLOCK * 2; s <= sortCount; s <<= 1) {
+            glUniform1ui(size, s);
+            glUniform1i(stage, 1);
+            for (GLuint d = s / 2; d >= BLOCK; d >>= 1) {
+                glUniform1ui(distance, d);
+                glDispatchCompute(sortCount / 2 / 256, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            }
+            glUniform1i(stage, 2);
+            glDispatchCompute(blocks, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        // the draw reads the indices as its element buffer
+        glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+
+        glUseProgram(0);
+        for (GLuint i = 0; i <= 2; ++i)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+        return count;
+    }
+#else
+    size_t sort(GLuint, size_t, float, const glm::mat4&) { return 0; }
+#endif
+
+    // fallback, uploads an order sorted on the CPU, returns the number of elements to draw
+    size_t upload(const std::vector<uint32_t>& order)
+    {
+        if (order.size() > capacity)
+            return 0;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLuint) * order.size(), order.data());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        return order.size();
+    }
+
+    // the sorted indices, GL_UNSIGNED_INT
+    GLuint elementBuffer() const { return indexBuffer; }
+
+    void release()
+    {
+        if (keysBuffer)
+            glDeleteBuffers(1, &keysBuffer);
+        if (indexBuffer)
+            glDeleteBuffers(1, &indexBuffer);
+        if (keysProgram)
+            glDeleteProgram(keysProgram);
+        if (sortProgram)
+            glDeleteProgram(sortProgram);
+        keysBuffer = indexBuffer = keysProgram = sortProgram = 0;
+        compute = false;
+    }
+
+private:
+    // pairs per work group of bitonicSort.comp
+    static const GLuint BLOCK = 512;
+
+    size_t capacity = 0;
+    bool compute = false;
+    GLuint keysBuffer = 0, indexBuffer = 0;
+    GLuint keysProgram = 0, sortProgram = 0;
+
+    // the power of two the keys are padded to, at least one block
+    static size_t sortCountFor(size_t count)
+    {
+        size_t n = BLOCK;
+        while (n < count)
+            n <<= 1;
+        return n;
+    }
+};
+
+#endif
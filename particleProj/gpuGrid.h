@@ -0,0 +1,213 @@
+#ifndef GPU_GRID_H
+#define GPU_GRID_H
+
+#include <glad/glad.h>
+
+#include "particle.h"
+#include "shader.h"
+#include "spatialGrid.h"
+#include "computeShader.h"
+
+#include <iostream>
+#include <vector>
+
+// Neighbor grid of the GPU particle buffer for the neighborForce() of emit.vert.
+//
+// With GL 4.3 the grid is built by compute shaders: gridCount.comp bins every particle
+// into its bucket (same hash as SpatialGrid), gridScan.comp prefix sums the bucket
+// counts into bucket starts and gridScatter.comp copies the particles into a cell
+// ordered buffer. Without compute (3.3 drivers, or a glad generated without 4.3) the
+// app builds a SpatialGrid on the CPU and upload() fills the same buffers.
+//
+// emit.vert stays #version 330, it reads the bucket starts and the cell ordered
+// particles through buffer textures bound by bind().
+class GpuGrid
+{
+public:
+    // returns false when the compute path isn't available, upload() must be used then
+    bool init(size_t maxParticles)
+    {
+        release();
+        capacity = maxParticles;
+        int maxBits = bitsFor(maxParticles);
+        size_t maxBuckets = (size_t)1 << maxBits;
+
+        glGenBuffers(1, &startsBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, startsBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint) * (maxBuckets + 1), nullptr, GL_DYNAMIC_DRAW);
+        glGenBuffers(1, &sortedBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, sortedBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(Particle) * maxParticles, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glGenTextures(1, &startsTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, startsTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, startsBuffer);
+        glGenTextures(1, &sortedTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, sortedTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, sortedBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+#ifdef GL_VERSION_4_3
+        if (GLAD_GL_VERSION_4_3) {
+            countProgram = loadComputeProgram("gridCount.comp");
+            scanProgram = loadComputeProgram("gridScan.comp");
+            scatterProgram = loadComputeProgram("gridScatter.comp");
+            compute = countProgram && scanProgram && scatterProgram;
+        }
+        if (compute) {
+            size_t blocks = (maxBuckets + 255) / 256;
+            GLuint* buffers[] = { &countsBuffer, &slotsBuffer, &blockSumsBuffer };
+            size_t sizes[] = { sizeof(GLuint) * maxBuckets, sizeof(GLuint) * 2 * maxParticles, sizeof(GLuint) * blocks };
+            for (int i = 0; i < 3; ++i) {
+                glGenBuffers(1, buffers[i]);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffers[i]);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], nullptr, GL_DYNAMIC_COPY);
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+#endif
+        return compute;
+    }
+
+    bool hasCompute() const { return compute; }
+
+    // bins the first count particles of particleBuffer (the transform feedback layout)
+#ifdef GL_VERSION_4_3
+    void build(GLuint particleBuffer, size_t count, float cellSize)
+    {
+        if (!compute || count > capacity)
+            return;
+        bits = bitsFor(count);
+        invCellSize = 1.0f / cellSize;
+        const GLuint buckets = 1u << bits;
+        const GLuint blocks = (buckets + 255) / 256;
+        const GLuint groups = (GLuint)((count + 255) / 256);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countsBuffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint) * buckets, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, slotsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, startsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, blockSumsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, sortedBuffer);
+
+        glUseProgram(countProgram);
+        glUniform1ui(glGetUniformLocation(countProgram, "u_particleCount"), (GLuint)count);
+        glUniform1f(glGetUniformLocation(countProgram, "u_gridInvCellSize"), invCellSize);
+        glUniform1i(glGetUniformLocation(countProgram, "u_gridBucketBits"), bits);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(scanProgram);
+        glUniform1ui(glGetUniformLocation(scanProgram, "u_bucketCount"), buckets);
+        GLint stage = glGetUniformLocation(scanProgram, "u_stage");
+        glUniform1i(stage, 0);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1i(stage, 1);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1i(stage, 2);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(scatterProgram);
+        glUniform1ui(glGetUniformLocation(scatterProgram, "u_particleCount"), (GLuint)count);
+        glDispatchCompute(groups, 1, 1);
+        // emit.vert reads the results through buffer textures
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(0);
+        for (GLuint i = 0; i <= 5; ++i)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+    }
+#else
+    void build(GLuint, size_t, float) {}
+#endif
+
+    // fallback, uploads a grid built on the CPU over the same particles
+    void upload(const SpatialGrid& grid, const std::vector<Particle>& particles)
+    {
+        if (particles.size() > capacity)
+            return;
+        bits = grid.bucketBits();
+        invCellSize = 1.0f / grid.cellSize();
+        const std::vector<uint32_t>& starts = grid.bucketStarts();
+        const std::vector<uint32_t>& order = grid.order();
+        sortedScratch.resize(order.size());
+        for (size_t k = 0; k < order.size(); ++k)
+            sortedScratch[k] = particles[order[k]];
+
+        glBindBuffer(GL_TEXTURE_BUFFER, startsBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(GLuint) * starts.size(), starts.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, sortedBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(Particle) * sortedScratch.size(), sortedScratch.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // binds the grid textures to the given units and sets the grid uniforms of emit.vert
+    void bind(const Shader& shader, int startsUnit, int particlesUnit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + startsUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, startsTexture);
+        shader.setInt("s_gridStarts", startsUnit);
+        glActiveTexture(GL_TEXTURE0 + particlesUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, sortedTexture);
+        shader.setInt("s_gridParticles", particlesUnit);
+        shader.setFloat("u_gridInvCellSize", invCellSize);
+        shader.setInt("u_gridBucketBits", bits);
+    }
+
+    // the first particle of every bucket and the cell ordered copy of the particles,
+    // the buffers behind the textures of bind()
+    int bucketBits() const { return bits; }
+    GLuint bucketStarts() const { return startsBuffer; }
+    GLuint sortedParticles() const { return sortedBuffer; }
+
+    void release()
+    {
+        GLuint buffers[] = { startsBuffer, sortedBuffer, countsBuffer, slotsBuffer, blockSumsBuffer };
+        for (GLuint b : buffers) {
+            if (b)
+                glDeleteBuffers(1, &b);
+        }
+        if (startsTexture)
+            glDeleteTextures(1, &startsTexture);
+        if (sortedTexture)
+            glDeleteTextures(1, &sortedTexture);
+        GLuint programs[] = { countProgram, scanProgram, scatterProgram };
+        for (GLuint p : programs) {
+            if (p)
+                glDeleteProgram(p);
+        }
+        startsBuffer = sortedBuffer = countsBuffer = slotsBuffer = blockSumsBuffer = 0;
+        startsTexture = sortedTexture = 0;
+        countProgram = scanProgram = scatterProgram = 0;
+        compute = false;
+    }
+
+private:
+    size_t capacity = 0;
+    bool compute = false;
+    int bits = 0;
+    float invCellSize = 1.0f;
+    GLuint startsBuffer = 0, sortedBuffer = 0;
+    GLuint countsBuffer = 0, slotsBuffer = 0, blockSumsBuffer = 0;
+    GLuint startsTexture = 0, sortedTexture = 0;
+    GLuint countProgram = 0, scanProgram = 0, scatterProgram = 0;
+    std::vector<Particle> sortedScratch;
+
+    // log2 of the bucket count for count particles, as in SpatialGrid::build
+    static int bitsFor(size_t count)
+    {
+        int b = 0;
+        while (((size_t)1 << b) < count)
+            ++b;
+        return b;
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A small JSON reader for the effect files (effectDesc.h): objects, arrays,
+// numbers, strings, true/false/null, and // comments so the files can say why
+// their values are what they are. Members keep the file's order.
+
+struct JsonValue {
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+};
+
+class JsonReader
+{
+public:
+    // false with error() set when text isn't one JSON value
+    bool parse(const std::string& source, JsonValue& value)
+    {
+        text = &source;
+        pos = 0;
+        line = 1;
+        message.clear();
+        if (!parseValue(value, 0))
+            return false;
+        skipSpace();
+        if (pos != text->size())
+            return fail("trailing characters");
+        return true;
+    }
+
+    // "line <n>: <what>"
+    const std::string& error() const { return message; }
+
+private:
+    const std::string* text = nullptr;
+    size_t pos = 0;
+    int line = 1;
+    std::string message;
+
+    static const int MAX_DEPTH = 64;
+
+    bool fail(const std::string& what)
+    {
+        if (message.empty())
+            message = "line " + std::to_string(line) + ": " + what;
+        return false;
+    }
+
+    void skipSpace()
+    {
+        while (pos < text->size()) {
+            char c = (*text)[pos];
+            if (c == '\n') {
+                ++line;
+                ++pos;
+            }
+            else if (c == ' ' || c == '\t' || c == '\r') {
+                ++pos;
+            }
+            else if (c == '/' && pos + 1 < text->size() && (*text)[pos + 1] == '/') {
+                while (pos < text->size() && (*text)[pos] != '\n')
+                    ++pos;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    bool literal(const char* word)
+    {
+        size_t n = std::char_traits<char>::length(word);
+        if (text->compare(pos, n, word) != 0)
+            return false;
+        pos += n;
+        return true;
+    }
+
+    bool parseString(std::string& out)
+    {
+        ++pos; // opening quote
+        out.clear();
+        while (pos < text->size()) {
+            char c = (*text)[pos++];
+            if (c == '"')
+                return true;
+            if (c == '\n')
+                return fail("unterminated string");
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text->size())
+                break;
+            char e = (*text)[pos++];
+            switch (e) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                // the effect files are ASCII, other code points become '?'
+                if (pos + 4 > text->size())
+                    return fail("bad \\u escape");
+                unsigned long code = std::strtoul(text->substr(pos, 4).c_str(), nullptr, 16);
+                out += code < 0x80 ? (char)code : '?';
+                pos += 4;
+                break;
+            }
+            default: out += e; break;
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool parseValue(JsonValue& value, int depth)
+    {
+        if (depth > MAX_DEPTH)
+            return fail("nested too deep");
+        skipSpace();
+        if (pos >= text->size())
+            return fail("unexpected end");
+        char c = (*text)[pos];
+        if (c == '{') {
+            value.type = JsonValue::OBJECT;
+            ++pos;
+            skipSpace();
+            if (pos < text->size() && (*text)[pos] == '}') {
+                ++pos;
+                return true;
+            }
+            for (;;) {
+                skipSpace();
+                if (pos >= text->size() || (*text)[pos] != '"')
+                    return fail("expected a member name");
+                std::string name;
+                if (!parseString(name))
+                    return false;
+                skipSpace();
+                if (pos >= text->size() || (*text)[pos] != ':')
+                    return fail("expected ':' after \"" + name + "\"");
+                ++pos;
+                value.members.emplace_back(name, JsonValue());
+                if (!parseValue(value.members.back().second, depth + 1))
+                    return false;
+                skipSpace();
+                if (pos < text->size() && (*text)[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                if (pos < text->size() && (*text)[pos] == '}') {
+                    ++pos;
+                    return true;
+                }
+                return fail("expected ',' or '}'");
+            }
+        }
+        if (c == '[') {
+            value.type = JsonValue::ARRAY;
+            ++pos;
+            skipSpace();
+            if (pos < text->size() && (*text)[pos] == ']') {
+                ++pos;
+                return true;
+            }
+            for (;;) {
+                value.items.emplace_back();
+                if (!parseValue(value.items.back(), depth + 1))
+                    return false;
+                skipSpace();
+                if (pos < text->size() && (*text)[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                if (pos < text->size() && (*text)[pos] == ']') {
+                    ++pos;
+                    return true;
+                }
+                return fail("expected ',' or ']'");
+            }
+        }
+        if (c == '"') {
+            value.type = JsonValue::STRING;
+            return parseString(value.string);
+        }
+        if (literal("true")) {
+            value.type = JsonValue::BOOLEAN;
+            value.boolean = true;
+            return true;
+        }
+        if (literal("false")) {
+            value.type = JsonValue::BOOLEAN;
+            value.boolean = false;
+            return true;
+        }
+        if (literal("null")) {
+            value.type = JsonValue::NUL;
+            return true;
+        }
+        const char* start = text->c_str() + pos;
+        char* end;
+        value.number = std::strtod(start, &end);
+        if (end == start)
+            return fail(std::string("unexpected '") + c + "'");
+        value.type = JsonValue::NUMBER;
+        pos += (size_t)(end - start);
+        return true;
+    }
+};
+
+#endif
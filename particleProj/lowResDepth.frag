@@ -0,0 +1,18 @@
+#version 330 core
+uniform sampler2D s_sceneDepth;   // full resolution
+uniform int u_divisor;
+
+out vec4 depth;
+
+// the farthest scene depth under each low resolution texel: particles in front of
+// any of its full resolution texels are kept, the upsample sorts out the edges
+void main()
+{
+    ivec2 base = ivec2( gl_FragCoord.xy ) * u_divisor;
+    ivec2 last = textureSize( s_sceneDepth, 0 ) - 1;
+    float farthest = 0.0;
+    for ( int y = 0; y < u_divisor; ++y )
+        for ( int x = 0; x < u_divisor; ++x )
+            farthest = max( farthest, texelFetch( s_sceneDepth, min( base + ivec2( x, y ), last ), 0 ).r );
+    depth = vec4( farthest );
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+#ifndef LOW_RES_PARTICLES_H
+#define LOW_RES_PARTICLES_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <memory>
+
+// Off screen particles at a fraction of the window resolution, the resolutionDivisor
+// of effectRender.h. Large soft sprites are bound by the blending, a half resolution
+// target blends 4 times fewer pixels and a quarter one 16 times fewer.
+//
+//   begin()     lowResDepth.frag takes the farthest scene depth under every low
+//               resolution texel (the s_sceneDepth of the soft fade in draw.frag),
+//               then the target is cleared to no color and full transmittance
+//   the particles draw with the premultiplied blend begin() sets, or with
+//   WeightedOitPass sized to the target
+//   upsample()  lowResUpsample.frag brings the target back over the framebuffer
+//               bound at begin(), bilaterally: the low resolution texels at the
+//               depth of each full resolution pixel weigh the most
+//
+// The particles' gl_PointSize is in pixels, draw.vert scales it by u_pointScale = 1 /
+// divisor().
+class LowResParticlePass
+{
+public:
+    bool init(int w, int h, int div)
+    {
+        release();
+        fullWidth = w;
+        fullHeight = h;
+        divisorValue = div;
+        lowWidth = (w + div - 1) / div;
+        lowHeight = (h + div - 1) / div;
+
+        // the upsample texelFetches its 4 texels itself
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, lowWidth, lowHeight, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenTextures(1, &depthTex);
+        glBindTexture(GL_TEXTURE_2D, depthTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, lowWidth, lowHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glGenFramebuffers(1, &depthFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthTex, 0);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            std::cout << "Low resolution particle framebuffer is incomplete" << std::endl;
+            release();
+            return false;
+        }
+
+        glGenVertexArrays(1, &emptyVao);
+        depthShader.reset(new Shader("fullScreen.vert", "lowResDepth.frag"));
+        upsampleShader.reset(new Shader("fullScreen.vert", "lowResUpsample.frag"));
+        return true;
+    }
+
+    bool isReady() const { return fbo != 0; }
+    int divisor() const { return divisorValue; }
+    int width() const { return lowWidth; }
+    int height() const { return lowHeight; }
+
+    // the low resolution scene depth, for the soft fade of the particles
+    GLuint depthTexture() const { return depthTex; }
+
+    // sceneDepth is the full resolution depth texture, 0 when no scene is drawn
+    void begin(GLuint sceneDepth)
+    {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glViewport(0, 0, lowWidth, lowHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+        glDisable(GL_BLEND);
+        if (sceneDepth) {
+            depthShader->use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, sceneDepth);
+            depthShader->setInt("s_sceneDepth", 0);
+            depthShader->setInt("u_divisor", divisorValue);
+            glBindVertexArray(emptyVao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glUseProgram(0);
+        }
+        else {
+            const GLfloat farPlane[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glClearBufferfv(GL_COLOR, 0, farPlane);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        const GLfloat empty[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        glClearBufferfv(GL_COLOR, 0, empty);
+        // draw.frag's straight alpha: rgb accumulates premultiplied, alpha the transmittance
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // composites the target over the framebuffer bound at begin() and leaves it bound
+    // with the usual alpha blending
+    void upsample(GLuint sceneDepth, const glm::mat4& inverseViewProjection)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+        glViewport(0, 0, fullWidth, fullHeight);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+        upsampleShader->use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        upsampleShader->setInt("s_particles", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, depthTex);
+        upsampleShader->setInt("s_lowDepth", 1);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, sceneDepth);
+        upsampleShader->setInt("s_sceneDepth", 2);
+        upsampleShader->setInt("u_divisor", divisorValue);
+        upsampleShader->setInt("u_depthAware", sceneDepth ? 1 : 0);
+        upsampleShader->setMat4("u_inverseViewProjection", inverseViewProjection);
+        upsampleShader->setVec2("u_viewportSize", (float)fullWidth, (float)fullHeight);
+        glBindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        glUseProgram(0);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    void release()
+    {
+        GLuint framebuffers[] = { fbo, depthFbo };
+        for (GLuint f : framebuffers) {
+            if (f)
+                glDeleteFramebuffers(1, &f);
+        }
+        GLuint textures[] = { colorTexture, depthTex };
+        for (GLuint t : textures) {
+            if (t)
+                glDeleteTextures(1, &t);
+        }
+        if (emptyVao)
+            glDeleteVertexArrays(1, &emptyVao);
+        if (depthShader)
+            glDeleteProgram(depthShader->ID);
+        if (upsampleShader)
+            glDeleteProgram(upsampleShader->ID);
+        depthShader.reset();
+        upsampleShader.reset();
+        fbo = depthFbo = colorTexture = depthTex = emptyVao = 0;
+    }
+
+private:
+    int fullWidth = 0, fullHeight = 0, lowWidth = 0, lowHeight = 0, divisorValue = 1;
+    GLuint fbo = 0, depthFbo = 0, colorTexture = 0, depthTex = 0, emptyVao = 0;
+    GLint target = 0;
+    std::unique_ptr<Shader> depthShader, upsampleShader;
+};
+
+#endif
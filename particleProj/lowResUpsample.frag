@@ -0,0 +1,51 @@
+#version 330 core
+uniform sampler2D s_particles;    // low resolution, rgb: premultiplied color, a: transmittance
+uniform sampler2D s_lowDepth;     // the scene depth the particles were faded against
+uniform sampler2D s_sceneDepth;   // full resolution
+uniform int u_divisor;
+uniform int u_depthAware;         // 0: the scene depth is not drawn, plain bilinear
+uniform mat4 u_inverseViewProjection;
+uniform vec2 u_viewportSize;
+
+// depths this close (world units) weigh about the same, a sharper falloff picks
+// single texels and turns smooth smoke blocky
+const float DEPTH_TOLERANCE = 0.1;
+
+out vec4 fragColor;
+
+vec3 unproject( vec2 ndc, float depth )
+{
+    vec4 world = u_inverseViewProjection * vec4( ndc, depth * 2.0 - 1.0, 1.0 );
+    return world.xyz / world.w;
+}
+
+// Bilateral upsample: the bilinear weights of the 4 nearest low resolution texels,
+// each divided by how far its depth is from this pixel's along the view ray, so
+// particles faded against the background don't bleed over a foreground edge and the
+// other way around. Blended with ( ONE, SRC_ALPHA ).
+void main()
+{
+    vec2 low = gl_FragCoord.xy / float( u_divisor ) - 0.5;
+    ivec2 base = ivec2( floor( low ) );
+    vec2 f = low - vec2( base );
+    ivec2 last = textureSize( s_particles, 0 ) - 1;
+
+    vec2 ndc = gl_FragCoord.xy / u_viewportSize * 2.0 - 1.0;
+    vec3 pixel = vec3( 0.0 );
+    if ( u_depthAware != 0 )
+        pixel = unproject( ndc, texelFetch( s_sceneDepth, ivec2( gl_FragCoord.xy ), 0 ).r );
+
+    vec4 sum = vec4( 0.0 );
+    float weightSum = 0.0;
+    for ( int i = 0; i < 4; ++i )
+    {
+        ivec2 offset = ivec2( i & 1, i >> 1 );
+        ivec2 texel = clamp( base + offset, ivec2( 0 ), last );
+        float weight = ( offset.x == 1 ? f.x : 1.0 - f.x ) * ( offset.y == 1 ? f.y : 1.0 - f.y );
+        if ( u_depthAware != 0 )
+            weight /= DEPTH_TOLERANCE + distance( pixel, unproject( ndc, texelFetch( s_lowDepth, texel, 0 ).r ) );
+        sum += texelFetch( s_particles, texel, 0 ) * weight;
+        weightSum += weight;
+    }
+    fragColor = sum / max( weightSum, 1e-8 );
+}
\ No newline at end of file
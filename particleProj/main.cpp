@@ -9,6 +9,23 @@
 #include <filesystem>
 
 #include "shader.h"
+#include "particle.h"
+#include "simInput.h"
+#include "particleDump.h"
+#include "profiler.h"
+#include "spatialGrid.h"
+#include "gpuGrid.h"
+#include "colliders.h"
+#include "sceneDepth.h"
+#include "forceFields.h"
+#include "depthSort.h"
+#include "gpuDepthSort.h"
+#include "effectRender.h"
+#include "effectDesc.h"
+#include "weightedOit.h"
+#include "lowResParticles.h"
+#include "textureAtlas.h"
+#include "textureRegistry.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "Noise3D.c"
@@ -18,50 +35,12 @@ const unsigned int WINDOW_HEIGHT = 600;
 
 const unsigned int NUM_PARTICLES = 200;
 
-struct Particle {
-    glm::vec3 position;
-    glm::vec3 velocity;
-    float size;
-    float lifetime;
-    float curtime;
-
-    Particle() : position(0.0f), velocity(0.0f), lifetime(0.0f) {}
-    Particle(glm::vec3 pos, glm::vec3 vel) : position(pos), velocity(vel) {}
-};
-
 std::vector<Particle> particles;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-GLuint loadTexture(std::filesystem::path filePath) {
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-    // The FileSystem::getPath(...) is part of the GitHub repository so we can find files on any IDE/platform; replace it with your own image path.
-    unsigned char* data = stbi_load(filePath.string().c_str(), &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-    return texture;
-}
-
 void initParticles() {
-    particles.resize(5000);
+    particles.resize(NUM_PARTICLES);
     for (size_t i = 0; i < particles.size(); ++i) {
         particles[i].position = glm::vec3(0,0,0);
         particles[i].velocity = glm::vec3(0,0,0);
@@ -97,7 +76,75 @@ void SetupVertexAttributes(GLuint vboID)
 
 }
 
-int main() {
+// sizes the off screen particle targets for the effect's resolution divisor, the
+// effect falls back to what the context can do
+void resizeParticleTargets(EffectRender& effect, LowResParticlePass& lowRes, WeightedOitPass& weightedOit)
+{
+    lowRes.release();
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    if (effect.resolutionDivisor > 1) {
+        if (lowRes.init(WINDOW_WIDTH, WINDOW_HEIGHT, effect.resolutionDivisor)) {
+            width = lowRes.width();
+            height = lowRes.height();
+        }
+        else {
+            effect.resolutionDivisor = 1;
+        }
+    }
+    if (!weightedOit.init(width, height) && effect.transparency == TRANSPARENCY_WEIGHTED)
+        effect.transparency = TRANSPARENCY_SORTED;
+}
+
+int main(int argc, char** argv) {
+    // --record <journal>  record the per-frame inputs
+    // --replay <journal>  drive the simulation from a recorded journal, exits when it runs out
+    // --dump <file>       write the particle buffer hash of every frame (compare with particleDiff)
+    // --dump-buffers      also write the whole particle buffer of every frame into the dump
+    // --seed <n>          seed for live runs
+    // --profile <file>    write a Chrome trace of the CPU scopes and GPU timer queries on exit
+    // --effect <name>     the effect of effects/demo.json to run, the journal's or the first one by default
+    // --cache <dir>       where the baked SDF is kept between runs, "" bakes it every run
+    std::filesystem::path recordPath, replayPath, dumpPath, tracePath, cacheDir = "sdfcache";
+    std::string effectName;
+    bool dumpBuffers = false;
+    unsigned int seed = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (arg == "--dump" && i + 1 < argc)
+            dumpPath = argv[++i];
+        else if (arg == "--dump-buffers")
+            dumpBuffers = true;
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = (unsigned int)std::stoul(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--effect" && i + 1 < argc)
+            effectName = argv[++i];
+        else if (arg == "--cache" && i + 1 < argc)
+            cacheDir = argv[++i];
+        else
+            std::cerr << "Unknown argument: " << arg << std::endl;
+    }
+
+    InputJournal journal;
+    if (!replayPath.empty() && !journal.load(replayPath))
+        return -1;
+    if (effectName.empty()) {
+        effectName = journal.effect;
+    }
+    else if (!journal.effect.empty() && effectName != journal.effect) {
+        std::cerr << "--effect " << effectName << " conflicts with the effect of the journal, " << journal.effect << std::endl;
+        return -1;
+    }
+
+    ParticleDump dump;
+    if (!dumpPath.empty() && !dump.open(dumpPath, NUM_PARTICLES, dumpBuffers))
+        return -1;
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -128,16 +175,116 @@ int main() {
 
     Shader emitShader("emit.vert", "emit.frag", feedbackVaryings, 5);
     Shader drawShader("draw.vert", "draw.frag");
+    Shader oitShader("draw.vert", "weightedOit.frag");
 
     // ʼ
     initParticles();
 
     GLuint curSrcIndex = 0;
 
-    std::filesystem::path filePath = "textures/smoke.tga";
-    GLuint textureId = loadTexture(filePath);
+    Profiler profiler;
 
-    GLuint noiseTextureId = Create3DNoiseTexture(128, 50.0);
+    // the effects share emit.vert, each binds its range of the Effect block
+    std::vector<EffectDesc> effects;
+    bool effectsLoaded = loadEffects("effects/demo.json", effects) && !effects.empty();
+    if (!effectsLoaded) {
+        std::cout << "Running the default effect" << std::endl;
+        effects.assign(1, EffectDesc());
+    }
+    size_t effectIndex = 0;
+    if (!effectName.empty()) {
+        const EffectDesc* named = findEffect(effects, effectName);
+        if (named)
+            effectIndex = (size_t)(named - effects.data());
+        else
+            std::cout << "No effect named " << effectName << ", running " << effects[0].name << std::endl;
+    }
+    const EffectDesc& effect = effects[effectIndex];
+    // so particleSim replays a recording with the same effect, the built-in one has no name to look up
+    journal.effect = effectsLoaded ? effect.name : "";
+    if (effect.update[0])
+        std::cout << "The update of " << effect.name << " runs on the CPU backend only (particleSim)" << std::endl;
+    EffectBuffer effectBuffer;
+    effectBuffer.init(effects);
+    EffectBuffer::attach(emitShader.ID);
+    // and one texture of their curves over age
+    CurveLut curveLut;
+    for (const EffectDesc& e : effects)
+        curveLut.add(e.curves);
+    const glm::vec2 curveRows = curveLut.rowCoords(effectIndex);
+
+    // the effect's texture, an atlas when particleAtlas wrote rects beside it
+    std::filesystem::path filePath = effect.texture;
+    std::vector<glm::vec4> atlasRects;
+    if (!loadAtlasRects(filePath, atlasRects))
+        atlasRects.assign(1, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+    TextureRegistry textures;
+    GLuint textureId, noiseTextureId, curlTextureId, curveTextureId;
+    float maxCurl;
+    {
+        ProfileScope scope(profiler, "upload");
+        profiler.beginGpu("upload");
+        textureId = textures.acquire(filePath);
+        // the emission noise keeps the book's table, the curl volume tiles over its
+        // 4 lattice cells so the time scroll in emit.vert wraps without a seam
+        NoiseGenerator emitNoise, curlNoise;
+        initNoiseGenerator(&emitNoise, 0, 0);
+        initNoiseGenerator(&curlNoise, 1, 4);
+        noiseTextureId = Create3DNoiseTexture(&emitNoise, 128, 50.0);
+        curlTextureId = Create3DCurlNoiseTexture(&curlNoise, 64, 4.0, &maxCurl);
+        curveTextureId = uploadCurveLut(curveLut);
+        profiler.endGpu();
+    }
+
+    // scene colliders, the ones overlapping the emitter bounds go to the Colliders
+    // block of emit.vert every frame. The bounds need the largest curl vector, maxCurl.
+    std::vector<Collider> colliders, activeColliders;
+    SdfVolume sdf;
+    GLuint sdfTextureId;
+    {
+        ProfileScope scope(profiler, "sdf");
+        bakeDemoSdf(sdf, cacheDir);
+        sdfTextureId = Create3DSdfTexture(sdf);
+    }
+    demoColliders(colliders, sdf);
+    ColliderBlock colliderBlock;
+    GLuint colliderUBO;
+    glGenBuffers(1, &colliderUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, colliderUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ColliderBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLuint colliderBlockIndex = glGetUniformBlockIndex(emitShader.ID, "Colliders");
+    if (colliderBlockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(emitShader.ID, colliderBlockIndex, 0);
+    bool collisions = false, collisionsKey = false;
+
+    // force fields, uploaded once to the ForceFields block of emit.vert
+    std::vector<ForceField> forceFields;
+    demoForceFields(forceFields);
+    ForceFieldBlock forceFieldBlock;
+    int forceFieldCount = packForceFields(forceFields, forceFieldBlock);
+    float fieldAccel = maxFieldAcceleration(forceFields);
+    GLuint forceFieldUBO;
+    glGenBuffers(1, &forceFieldUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, forceFieldUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ForceFieldBlock), &forceFieldBlock, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLuint forceFieldBlockIndex = glGetUniformBlockIndex(emitShader.ID, "ForceFields");
+    if (forceFieldBlockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(emitShader.ID, forceFieldBlockIndex, 1);
+    bool fieldsOn = false, fieldsKey = false;
+
+    // the demo mesh rendered into an offscreen depth for the screen space collision,
+    // its color replaces the clear of the draw pass while it is on
+    SceneDepthPass sceneDepth;
+    bool depthCollision = false, depthCollisionKey = false;
+    if (sceneDepth.init(DEPTH_WIDTH, DEPTH_HEIGHT)) {
+        TriangleMesh sceneMesh;
+        demoMesh(sceneMesh);
+        sceneDepth.upload(sceneMesh);
+    }
+    const glm::mat4 viewProjection = sceneViewProjection();
+    const glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
 
     unsigned int particleVBO[2];
     glGenBuffers(2, &particleVBO[0]);
@@ -147,74 +294,217 @@ int main() {
         glBufferData(GL_ARRAY_BUFFER, sizeof(Particle) * NUM_PARTICLES,particles.data(), GL_DYNAMIC_COPY);
     }
 
+    // neighbor grid for the separation force, binned by compute shaders when the
+    // context has GL 4.3, otherwise on the CPU from a readback of the source buffer
+    GpuGrid grid;
+    if (!grid.init(NUM_PARTICLES))
+        std::cout << "No GL 4.3 compute, the neighbor grid is built on the CPU" << std::endl;
+    SpatialGrid cpuGrid;
+    ParticleStreams gridStreams;
+    std::vector<Particle> gridParticles(NUM_PARTICLES);
+    bool separation = false, separationKey = false;
+
+    // back to front element order for the blended draw, sorted by compute shaders with
+    // GL 4.3, otherwise incrementally on the CPU from a readback of the particles
+    GpuDepthSort depthSort;
+    if (!depthSort.init(NUM_PARTICLES))
+        std::cout << "No GL 4.3 compute, the depth sort runs on the CPU" << std::endl;
+    DepthSorter cpuSorter;
+    ParticleStreams sortStreams;
+    std::vector<Particle> sortParticles(NUM_PARTICLES);
+
+    EffectRender effectRender = effect.render;
+    if (!flipbookFits(effectRender, atlasRects.size())) {
+        std::cout << "The effect's flipbook is outside its atlas, drawing the first rect" << std::endl;
+        effectRender.firstFrame = 0;
+        effectRender.frameCount = effectRender.variantCount = 1;
+    }
+    WeightedOitPass weightedOit;
+    LowResParticlePass lowRes;
+    resizeParticleTargets(effectRender, lowRes, weightedOit);
+    bool sortedKey = false, weightedKey = false, resolutionKey = false;
+
     float uTime = 0.f;
+    size_t frame = 0;
+    std::vector<Particle> readback(NUM_PARTICLES);
     GLsync emitSync;
-    unsigned int myTBOquery;
+    double lastReport = glfwGetTime();
 
     // Loop until the user closes the window
             // Bind the texture
 
     while (!glfwWindowShouldClose(window)) {
+        ProfileScope frameScope(profiler, "frame");
         //---------------------------------------------------emit particles--------------------------------------------------------
-        uTime += 0.001;
+        FrameInput input;
+        if (!replayPath.empty()) {
+            if (!journal.replay(frame, input))
+                break;
+        }
+        else {
+            uTime += 0.001;
+            input.time = uTime;
+            input.emissionRate = effect.emissionRate;
+            input.acceleration = effect.acceleration;
+            input.spawnBurst = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS ? NUM_PARTICLES / 4 : 0;
+            input.seed = seed;
+            input.turbulence = effect.turbulence;
+            // N toggles the neighbor separation
+            bool key = glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS;
+            if (key && !separationKey)
+                separation = !separation;
+            separationKey = key;
+            input.separation = separation ? 1.0f : 0.0f;
+            // C toggles the collisions with the scene colliders
+            key = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+            if (key && !collisionsKey)
+                collisions = !collisions;
+            collisionsKey = key;
+            input.collisions = collisions;
+            // D toggles the collisions with the scene depth
+            key = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+            if (key && !depthCollisionKey)
+                depthCollision = !depthCollision;
+            depthCollisionKey = key;
+            input.depthCollision = depthCollision;
+            // F toggles the force fields
+            key = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+            if (key && !fieldsKey)
+                fieldsOn = !fieldsOn;
+            fieldsKey = key;
+            input.forceFields = fieldsOn;
+            // S toggles the depth sorted draw, O the weighted blended one
+            key = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+            if (key && !sortedKey)
+                effectRender.transparency = effectRender.transparency == TRANSPARENCY_SORTED ? TRANSPARENCY_BLENDED : TRANSPARENCY_SORTED;
+            sortedKey = key;
+            key = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+            if (key && !weightedKey && weightedOit.isReady())
+                effectRender.transparency = effectRender.transparency == TRANSPARENCY_WEIGHTED ? TRANSPARENCY_BLENDED : TRANSPARENCY_WEIGHTED;
+            weightedKey = key;
+            // R cycles the resolution of the particles: full, half, quarter
+            key = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+            if (key && !resolutionKey) {
+                effectRender.resolutionDivisor = effectRender.resolutionDivisor >= 4 ? 1 : effectRender.resolutionDivisor * 2;
+                resizeParticleTargets(effectRender, lowRes, weightedOit);
+            }
+            resolutionKey = key;
+            if (!recordPath.empty())
+                journal.record(input);
+        }
         //ȡ
         GLuint srcVBO = particleVBO[curSrcIndex];
         //
         GLuint dstVBO = particleVBO[(curSrcIndex + 1) % 2];
 
-        emitShader.use();
-
-        SetupVertexAttributes(srcVBO);
-
-        // Set transform feedback buffer,feedback buffer info destination
-        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, dstVBO);
-        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, dstVBO);
-
-        // ñ任,ֹ
-        glEnable(GL_RASTERIZER_DISCARD);
-
-        emitShader.setFloat("u_time", uTime);
-        emitShader.setFloat("u_emissionRate", 0.3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_3D,noiseTextureId);
-        emitShader.setInt("s_noiseTex", 0);
-
-        glGenQueries(1, &myTBOquery);
-        // ʼ任
-        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, myTBOquery);
-        glBeginTransformFeedback(GL_POINTS);
+        deltaTime = input.time - lastFrame;
+        lastFrame = input.time;
 
-        // 
-        glDrawArrays(GL_POINTS, 0, particles.size());
-
-        // 任
-        glEndTransformFeedback();
-        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
-        unsigned int numEdgesFedBack;
-        glGetQueryObjectuiv(myTBOquery, GL_QUERY_RESULT, &numEdgesFedBack);
-        std::cout << numEdgesFedBack<<std::endl;
-
-        // 󶨻
-        glBindBuffer(GL_ARRAY_BUFFER, dstVBO);
-
-        // ӳ仺󵽿ͻڴ
-        void* dataPtr = glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
-        if (dataPtr != nullptr) {
-            float* dataArray = static_cast<float*>(dataPtr);
-            for (int i = 0; i < 9; ++i) {
-                std::cout << "Data[" << i << "] = " << dataArray[i] << std::endl;
+        if (input.separation != 0.0f) {
+            ProfileScope gridScope(profiler, "grid");
+            profiler.beginGpu("grid");
+            if (grid.hasCompute()) {
+                grid.build(srcVBO, NUM_PARTICLES, input.neighborRadius);
+            }
+            else {
+                glBindBuffer(GL_ARRAY_BUFFER, srcVBO);
+                glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Particle) * NUM_PARTICLES, gridParticles.data());
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                particlesToStreams(gridParticles, gridStreams);
+                cpuGrid.build(gridStreams, input.neighborRadius);
+                grid.upload(cpuGrid, gridParticles);
             }
+            profiler.endGpu();
+        }
 
-            // ȡӳ仺
-            glUnmapBuffer(GL_ARRAY_BUFFER);
+        if (input.depthCollision) {
+            ProfileScope sceneScope(profiler, "scene");
+            profiler.beginGpu("scene");
+            sceneDepth.render(viewProjection);
+            profiler.endGpu();
         }
-        else {
-            // ӳʧܣ
-            std::cerr << "Failed to map buffer object" << std::endl;
+
+        {
+            ProfileScope emitScope(profiler, "emit");
+            profiler.beginGpu("emit");
+
+            emitShader.use();
+
+            SetupVertexAttributes(srcVBO);
+
+            // Set transform feedback buffer,feedback buffer info destination
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, dstVBO);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, dstVBO);
+
+            // ñ任,ֹ
+            glEnable(GL_RASTERIZER_DISCARD);
+
+            emitShader.setFloat("u_time", input.time);
+            emitShader.setFloat("u_emissionRate", input.emissionRate);
+            emitShader.setFloat("u_seed", (float)input.seed);
+            emitShader.setInt("u_spawnBurst", (int)input.spawnBurst);
+            emitShader.setInt("u_particleCount", NUM_PARTICLES);
+            emitShader.setFloat("u_deltaTime", deltaTime);
+            emitShader.setVec3("u_acceleration", input.acceleration);
+            emitShader.setFloat("u_turbulence", input.turbulence);
+            emitShader.setFloat("u_separation", input.separation);
+            emitShader.setFloat("u_neighborRadius", input.neighborRadius);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_3D,noiseTextureId);
+            emitShader.setInt("s_noiseTex", 0);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_3D, curlTextureId);
+            emitShader.setInt("s_curlTex", 1);
+            grid.bind(emitShader, 2, 3);
+
+            int colliderCount = 0;
+            if (input.collisions) {
+                cullColliders(colliders, emitterBounds(input, effect.block, curveBound(effect.curves.speed), maxCurl, deltaTime,
+                                                       input.forceFields ? fieldAccel : 0.0f), activeColliders);
+                colliderCount = packColliders(activeColliders, colliderBlock);
+                glBindBuffer(GL_UNIFORM_BUFFER, colliderUBO);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::vec4) * 3 * colliderCount, colliderBlock.colliders);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+            glBindBufferBase(GL_UNIFORM_BUFFER, 0, colliderUBO);
+            emitShader.setInt("u_colliderCount", colliderCount);
+            glBindBufferBase(GL_UNIFORM_BUFFER, 1, forceFieldUBO);
+            effectBuffer.bind(effectIndex);
+            emitShader.setInt("u_forceFieldCount", input.forceFields ? forceFieldCount : 0);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_3D, sdfTextureId);
+            emitShader.setInt("s_sdfTex", 4);
+            emitShader.setInt("u_depthCollision", input.depthCollision ? 1 : 0);
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, sceneDepth.depthTexture());
+            emitShader.setInt("s_sceneDepth", 5);
+            glActiveTexture(GL_TEXTURE6);
+            glBindTexture(GL_TEXTURE_2D, curveTextureId);
+            emitShader.setInt("s_curves", 6);
+            emitShader.setFloat("u_speedRow", curveRows.y);
+            emitShader.setMat4("u_viewProjection", viewProjection);
+            emitShader.setMat4("u_inverseViewProjection", inverseViewProjection);
+            emitShader.setFloat("u_depthThickness", DEPTH_THICKNESS);
+            emitShader.setVec2("u_depthResponse", DEPTH_RESTITUTION, DEPTH_FRICTION);
+
+            // ʼ任
+            glBeginTransformFeedback(GL_POINTS);
+
+            // 
+            glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+
+            // 任
+            glEndTransformFeedback();
+            profiler.endGpu();
         }
 
-        // 󻺳
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (dump.isOpen()) {
+            ProfileScope readbackScope(profiler, "readback");
+            glBindBuffer(GL_ARRAY_BUFFER, dstVBO);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Particle) * NUM_PARTICLES, readback.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            dump.write((uint32_t)frame, readback.data());
+        }
 
         // Create a sync object to ensure transform feedback results are completed before the draw that uses them.
         emitSync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
@@ -235,43 +525,143 @@ int main() {
         glWaitSync(emitSync, 0, GL_TIMEOUT_IGNORED);
         glDeleteSync(emitSync);
 
-        // Set the viewport
-        glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-
-        // Clear the color buffer
-        glClear(GL_COLOR_BUFFER_BIT);
-        glClearColor(1, 1, 1, 0);
-        glEnable(GL_PROGRAM_POINT_SIZE);
-        glEnable(0x8861);
-        
-        drawShader.use();   
-
-        SetupVertexAttributes(particleVBO[curSrcIndex]);
-
-        //unifrom set
-        drawShader.setFloat("u_time", uTime);
-        drawShader.setVec3("u_acceleration", glm::vec3(0,-1,0));
-        drawShader.setVec4("u_color",glm::vec4(1.0f));
-        drawShader.setInt("s_texture", 0);
+        const bool sorted = effectRender.transparency == TRANSPARENCY_SORTED;
+        const bool weighted = effectRender.transparency == TRANSPARENCY_WEIGHTED;
+        size_t drawCount = NUM_PARTICLES;
+        if (sorted) {
+            ProfileScope sortScope(profiler, "sort");
+            profiler.beginGpu("sort");
+            if (depthSort.hasCompute()) {
+                drawCount = depthSort.sort(particleVBO[curSrcIndex], NUM_PARTICLES, input.time, viewProjection);
+            }
+            else {
+                glBindBuffer(GL_ARRAY_BUFFER, particleVBO[curSrcIndex]);
+                glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Particle) * NUM_PARTICLES, sortParticles.data());
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                particlesToStreams(sortParticles, sortStreams);
+                drawCount = depthSort.upload(cpuSorter.sort(sortStreams, input.time, viewProjection));
+            }
+            profiler.endGpu();
+        }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        {
+            ProfileScope drawScope(profiler, "draw");
+            profiler.beginGpu("draw");
+            // Set the viewport
+            glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
-        //Blend particles
-        glEnable(GL_BLEND);
-        //ͱɫalpha
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            // Clear the color buffer, or draw over the scene
+            if (input.depthCollision) {
+                sceneDepth.blit(WINDOW_WIDTH, WINDOW_HEIGHT);
+            }
+            else {
+                glClearColor(1, 1, 1, 0);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+            glEnable(GL_PROGRAM_POINT_SIZE);
+            glEnable(0x8861);
+
+            // A low resolution effect draws into an off screen target that is upsampled
+            // over the frame, the weighted blend into its own targets that composite
+            // over the frame or the low resolution target. The particles fade into the
+            // scene depth when the scene is drawn.
+            GLuint particleDepth = input.depthCollision ? sceneDepth.depthTexture() : 0;
+            const bool lowResolution = lowRes.isReady();
+            if (lowResolution)
+                lowRes.begin(particleDepth);
+            if (weighted)
+                weightedOit.begin();
+            Shader& particleShader = weighted ? oitShader : drawShader;
+            particleShader.use();
+
+            SetupVertexAttributes(particleVBO[curSrcIndex]);
+
+            //unifrom set
+            particleShader.setFloat("u_time", input.time);
+            particleShader.setMat4("u_viewProjection", viewProjection);
+            particleShader.setFloat("u_pointScale", 1.0f / (float)effectRender.resolutionDivisor);
+            particleShader.setInt("s_texture", 0);
+            glUniform4fv(glGetUniformLocation(particleShader.ID, "u_atlasRects"), (GLsizei)atlasRects.size(), glm::value_ptr(atlasRects[0]));
+            particleShader.setInt("u_firstFrame", effectRender.firstFrame);
+            particleShader.setInt("u_frameCount", effectRender.frameCount);
+            particleShader.setInt("u_variantCount", effectRender.variantCount);
+            particleShader.setInt("u_blendFrames", effectRender.blendFrames ? 1 : 0);
+            particleShader.setInt("s_sceneDepth", 1);
+            particleShader.setInt("s_curves", 2);
+            particleShader.setVec2("u_curveRows", curveRows);
+            particleShader.setFloat("u_softness", particleDepth ? effectRender.softness : 0.0f);
+            particleShader.setMat4("u_inverseViewProjection", inverseViewProjection);
+            if (lowResolution)
+                particleShader.setVec2("u_viewportSize", (float)lowRes.width(), (float)lowRes.height());
+            else
+                particleShader.setVec2("u_viewportSize", (float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, curveTextureId);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, lowResolution ? lowRes.depthTexture() : particleDepth);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, textureId);
+
+            //Blend particles
+            if (!weighted && !lowResolution) {
+                glEnable(GL_BLEND);
+                //ͱɫalpha
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            }
 
-        glPointSize(10.0f);
-        glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+            glPointSize(10.0f);
+            if (sorted) {
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, depthSort.elementBuffer());
+                glDrawElements(GL_POINTS, (GLsizei)drawCount, GL_UNSIGNED_INT, (void*)0);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            }
+            else {
+                glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+            }
+            if (weighted)
+                weightedOit.composite();
+            if (lowResolution)
+                lowRes.upsample(particleDepth, inverseViewProjection);
+            profiler.endGpu();
+        }
         //------------------------------------------------ draw end---------------------------------------------------------------------------
         // Swap front and back buffers
         glfwSwapBuffers(window);
 
         // Poll for and process events
         glfwPollEvents();
+        ++frame;
+
+        profiler.collectGpu();
+        if (glfwGetTime() - lastReport > 2.0) {
+            profiler.report(std::cout);
+            lastReport = glfwGetTime();
+        }
     }
 
+    if (!recordPath.empty())
+        journal.save(recordPath);
+
+    profiler.report(std::cout);
+    if (!tracePath.empty())
+        profiler.exportChromeTrace(tracePath);
+    profiler.release();
+    grid.release();
+    depthSort.release();
+    weightedOit.release();
+    lowRes.release();
+    glDeleteBuffers(1, &colliderUBO);
+    glDeleteBuffers(1, &forceFieldUBO);
+    glDeleteTextures(1, &sdfTextureId);
+    glDeleteTextures(1, &curveTextureId);
+    glDeleteTextures(1, &noiseTextureId);
+    glDeleteTextures(1, &curlTextureId);
+    textures.release(textureId);
+    effectBuffer.release();
+    textures.clear();
+    sceneDepth.release();
+
     // Clean up
     glDeleteBuffers(2, &particleVBO[0]);
     glfwTerminate();
@@ -0,0 +1,318 @@
+#ifndef MIPMAPS_H
+#define MIPMAPS_H
+
+#include "textureAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Mip chains built on the CPU when a texture loads, so minified sprites sample a
+// prefiltered level instead of aliasing over the full one.
+//
+// The texels are sRGB encoded colors with straight alpha. Every level is filtered
+// in linear space with the color premultiplied by alpha, so transparent texels
+// don't darken their neighbors, and converted back at the end:
+//
+//   MIP_BOX     2x2 average, the cheapest
+//   MIP_KAISER  8 tap Kaiser windowed sinc per axis, sharper, no moire
+//
+// One texel is one 4 float SIMD lane (MipLanes, SSE2 like FieldLanes of
+// forceFields.h) and the rows of every level are OpenMP parallel.
+// mipChainCached() keeps the chains on disk keyed by a hash of the image file,
+// a texture that didn't change loads its whole chain without a decode or a filter.
+
+enum MipFilter {
+    MIP_BOX = 0,
+    MIP_KAISER = 1,
+};
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+struct MipLanes {
+    __m128 v;
+    MipLanes(__m128 value) : v(value) {}
+    MipLanes(float value) : v(_mm_set1_ps(value)) {}
+    static MipLanes load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+inline MipLanes operator+(MipLanes a, MipLanes b) { return _mm_add_ps(a.v, b.v); }
+inline MipLanes operator*(MipLanes a, MipLanes b) { return _mm_mul_ps(a.v, b.v); }
+#else
+struct MipLanes {
+    float v[4];
+    MipLanes(float value) : v{ value, value, value, value } {}
+    static MipLanes load(const float* p) { MipLanes l(0.0f); std::copy(p, p + 4, l.v); return l; }
+    void store(float* p) const { std::copy(v, v + 4, p); }
+};
+inline MipLanes operator+(MipLanes a, MipLanes b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+inline MipLanes operator*(MipLanes a, MipLanes b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+#endif
+
+inline const float* srgbToLinearTable()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> t(256);
+        for (int i = 0; i < 256; ++i) {
+            float c = (float)i / 255.0f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+const int LINEAR_TO_SRGB_STEPS = 4096;
+
+inline const uint8_t* linearToSrgbTable()
+{
+    static const std::vector<uint8_t> table = [] {
+        std::vector<uint8_t> t(LINEAR_TO_SRGB_STEPS + 1);
+        for (int i = 0; i <= LINEAR_TO_SRGB_STEPS; ++i) {
+            float c = (float)i / LINEAR_TO_SRGB_STEPS;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            t[i] = (uint8_t)std::lround(std::min(1.0f, std::max(0.0f, s)) * 255.0f);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// weights of the 8 source texels under a destination texel, offsets -3.5 .. 3.5
+inline const float* kaiserWeights()
+{
+    static const std::vector<float> weights = [] {
+        auto besselI0 = [](float x) {
+            float sum = 1.0f, term = 1.0f;
+            for (int k = 1; k < 16; ++k) {
+                term *= (x / (2.0f * k)) * (x / (2.0f * k));
+                sum += term;
+            }
+            return sum;
+        };
+        const float ALPHA = 4.0f, RADIUS = 4.0f, PI = 3.14159265f;
+        std::vector<float> w(8);
+        float total = 0.0f;
+        for (int i = 0; i < 8; ++i) {
+            float t = (float)i - 3.5f;
+            // half band sinc for the 2:1 decimation
+            float x = PI * t * 0.5f;
+            float sinc = std::sin(x) / x;
+            float r = t / RADIUS;
+            w[i] = sinc * besselI0(ALPHA * std::sqrt(1.0f - r * r)) / besselI0(ALPHA);
+            total += w[i];
+        }
+        for (float& v : w)
+            v /= total;
+        return w;
+    }();
+    return weights.data();
+}
+
+// premultiplied linear RGBA floats of the level, 4 per texel
+inline void toPremultipliedLinear(const AtlasImage& image, std::vector<float>& texels)
+{
+    const float* toLinear = srgbToLinearTable();
+    texels.resize((size_t)image.width * image.height * 4);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < image.height; ++y) {
+        for (int x = 0; x < image.width; ++x) {
+            size_t i = ((size_t)y * image.width + x) * 4;
+            float alpha = image.rgba[i + 3] / 255.0f;
+            texels[i] = toLinear[image.rgba[i]] * alpha;
+            texels[i + 1] = toLinear[image.rgba[i + 1]] * alpha;
+            texels[i + 2] = toLinear[image.rgba[i + 2]] * alpha;
+            texels[i + 3] = alpha;
+        }
+    }
+}
+
+inline void fromPremultipliedLinear(const std::vector<float>& texels, int w, int h, AtlasImage& image)
+{
+    const uint8_t* toSrgb = linearToSrgbTable();
+    image.width = w;
+    image.height = h;
+    image.rgba.resize((size_t)w * h * 4);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            size_t i = ((size_t)y * w + x) * 4;
+            float alpha = std::min(1.0f, std::max(0.0f, texels[i + 3]));
+            float unpremultiply = alpha > 0.0f ? 1.0f / alpha : 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                float linear = std::min(1.0f, std::max(0.0f, texels[i + c] * unpremultiply));
+                image.rgba[i + c] = toSrgb[(int)(linear * LINEAR_TO_SRGB_STEPS + 0.5f)];
+            }
+            image.rgba[i + 3] = (uint8_t)(alpha * 255.0f + 0.5f);
+        }
+    }
+}
+
+// the next level of src (w x h) into dst, half the size rounded down, edges clamped
+inline void downsampleLevel(const std::vector<float>& src, int w, int h, MipFilter filter, std::vector<float>& dst)
+{
+    const int dw = std::max(1, w / 2), dh = std::max(1, h / 2);
+    dst.resize((size_t)dw * dh * 4);
+    auto at = [w, h](int x, int y) {
+        x = std::min(w - 1, std::max(0, x));
+        y = std::min(h - 1, std::max(0, y));
+        return ((size_t)y * w + x) * 4;
+    };
+
+    if (filter == MIP_BOX) {
+        const MipLanes quarter(0.25f);
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < dh; ++y) {
+            for (int x = 0; x < dw; ++x) {
+                MipLanes sum = MipLanes::load(&src[at(2 * x, 2 * y)]) + MipLanes::load(&src[at(2 * x + 1, 2 * y)]) +
+                               MipLanes::load(&src[at(2 * x, 2 * y + 1)]) + MipLanes::load(&src[at(2 * x + 1, 2 * y + 1)]);
+                (sum * quarter).store(&dst[((size_t)y * dw + x) * 4]);
+            }
+        }
+        return;
+    }
+
+    // separable: the rows to dw x h, then the columns to dw x dh
+    const float* weights = kaiserWeights();
+    std::vector<float> rows((size_t)dw * h * 4);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < dw; ++x) {
+            MipLanes sum(0.0f);
+            for (int k = 0; k < 8; ++k)
+                sum = sum + MipLanes::load(&src[at(2 * x - 3 + k, y)]) * MipLanes(weights[k]);
+            sum.store(&rows[((size_t)y * dw + x) * 4]);
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < dh; ++y) {
+        const float* taps[8];
+        for (int k = 0; k < 8; ++k)
+            taps[k] = &rows[(size_t)std::min(h - 1, std::max(0, 2 * y - 3 + k)) * dw * 4];
+        for (int x = 0; x < dw; ++x) {
+            MipLanes sum(0.0f);
+            for (int k = 0; k < 8; ++k)
+                sum = sum + MipLanes::load(taps[k] + (size_t)x * 4) * MipLanes(weights[k]);
+            float* out = &dst[((size_t)y * dw + x) * 4];
+            sum.store(out);
+            // the negative lobes can ring past the valid premultiplied range
+            out[3] = std::min(1.0f, std::max(0.0f, out[3]));
+            for (int c = 0; c < 3; ++c)
+                out[c] = std::min(out[3], std::max(0.0f, out[c]));
+        }
+    }
+}
+
+// levels[0] is image, then every level down to 1x1
+inline void generateMipChain(const AtlasImage& image, MipFilter filter, std::vector<AtlasImage>& levels)
+{
+    levels.assign(1, image);
+    std::vector<float> current, next;
+    toPremultipliedLinear(image, current);
+    int w = image.width, h = image.height;
+    while (w > 1 || h > 1) {
+        downsampleLevel(current, w, h, filter, next);
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+        levels.emplace_back();
+        fromPremultipliedLinear(next, w, h, levels.back());
+        std::swap(current, next);
+    }
+}
+
+// FNV-1a of the image file and the filter, the cache key of mipChainCached()
+inline uint64_t hashMipChain(const std::vector<uint8_t>& file, MipFilter filter)
+{
+    const uint32_t CACHE_VERSION = 1;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const void* data, size_t bytes) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; ++i) {
+            hash ^= p[i];
+            hash *= 0x100000001b3ull;
+        }
+    };
+    add(&CACHE_VERSION, sizeof(CACHE_VERSION));
+    add(&filter, sizeof(filter));
+    add(file.data(), file.size());
+    return hash;
+}
+
+// The mip chain of the image file read from path, from cacheDir when an earlier run
+// built it from the same file. A cache that can't be written only costs the next run
+// the filtering, an empty cacheDir always builds. False when the image can't be
+// decoded.
+inline bool mipChainCached(const std::vector<uint8_t>& file, const std::filesystem::path& path, MipFilter filter,
+                           const std::filesystem::path& cacheDir, std::vector<AtlasImage>& levels)
+{
+    const uint32_t MAGIC = 0x50494D50; // "PMIP"
+    const uint64_t key = hashMipChain(file, filter);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mips", (unsigned long long)key);
+    const std::filesystem::path cachePath = cacheDir / name;
+
+    if (!cacheDir.empty()) {
+        std::ifstream in(cachePath, std::ios::binary);
+        if (in) {
+            uint32_t magic = 0, count = 0;
+            uint64_t storedKey = 0;
+            in.read((char*)&magic, sizeof(magic));
+            in.read((char*)&storedKey, sizeof(storedKey));
+            in.read((char*)&count, sizeof(count));
+            if (in && magic == MAGIC && storedKey == key && count > 0 && count <= 32) {
+                levels.resize(count);
+                bool valid = true;
+                for (AtlasImage& level : levels) {
+                    in.read((char*)&level.width, sizeof(level.width));
+                    in.read((char*)&level.height, sizeof(level.height));
+                    valid = in && level.width > 0 && level.height > 0 && level.width <= 65536 && level.height <= 65536;
+                    if (!valid)
+                        break;
+                    level.rgba.resize((size_t)level.width * level.height * 4);
+                    in.read((char*)level.rgba.data(), (std::streamsize)level.rgba.size());
+                }
+                if (valid && in)
+                    return true;
+            }
+            std::cerr << "Ignoring bad mip cache file: " << cachePath.string() << std::endl;
+        }
+    }
+
+    AtlasImage image;
+    int channels;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(),
+                                                &image.width, &image.height, &channels, 4);
+    if (!data) {
+        std::cout << "Failed to load texture: " << path.string() << std::endl;
+        return false;
+    }
+    image.rgba.assign(data, data + (size_t)image.width * image.height * 4);
+    stbi_image_free(data);
+    generateMipChain(image, filter, levels);
+    if (cacheDir.empty())
+        return true;
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    std::ofstream out(cachePath, std::ios::binary);
+    uint32_t count = (uint32_t)levels.size();
+    out.write((const char*)&MAGIC, sizeof(MAGIC));
+    out.write((const char*)&key, sizeof(key));
+    out.write((const char*)&count, sizeof(count));
+    for (const AtlasImage& level : levels) {
+        out.write((const char*)&level.width, sizeof(level.width));
+        out.write((const char*)&level.height, sizeof(level.height));
+        out.write((const char*)level.rgba.data(), (std::streamsize)level.rgba.size());
+    }
+    if (!out)
+        std::cerr << "Failed to write mip cache file: " << cachePath.string() << std::endl;
+    return true;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#version 330 core
+uniform sampler2D s_accum;
+uniform sampler2D s_weightSum;
+
+out vec4 fragColor;
+
+// the weighted average color of the fragments, over what is behind them by their total coverage
+void main()
+{
+    ivec2 texel = ivec2( gl_FragCoord.xy );
+    vec4 accum = texelFetch( s_accum, texel, 0 );
+    float revealage = accum.a;
+    if ( revealage >= 1.0 )
+        discard;
+    float weightSum = texelFetch( s_weightSum, texel, 0 ).r;
+    fragColor = vec4( accum.rgb / max( weightSum, 1e-5 ), 1.0 - revealage );
+}
\ No newline at end of file
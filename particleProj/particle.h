@@ -0,0 +1,72 @@
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Interleaved particle record, this is the exact layout of the transform feedback
+// buffers (see SetupVertexAttributes and the emit.vert varyings).
+struct Particle {
+    glm::vec3 position;
+    glm::vec3 velocity;
+    float size;
+    float lifetime;
+    float curtime;
+
+    Particle() : position(0.0f), velocity(0.0f), size(0.0f), lifetime(0.0f), curtime(0.0f) {}
+    Particle(glm::vec3 pos, glm::vec3 vel) : position(pos), velocity(vel), size(0.0f), lifetime(0.0f), curtime(0.0f) {}
+};
+
+// Structure-of-arrays copy of the particle buffer, used by the CPU backend so
+// every attribute is a contiguous stream.
+struct ParticleStreams {
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> size;
+    std::vector<float> lifetime;
+    std::vector<float> curtime;
+
+    size_t count() const { return size.size(); }
+
+    void resize(size_t n)
+    {
+        posX.assign(n, 0.0f); posY.assign(n, 0.0f); posZ.assign(n, 0.0f);
+        velX.assign(n, 0.0f); velY.assign(n, 0.0f); velZ.assign(n, 0.0f);
+        size.assign(n, 0.0f);
+        lifetime.assign(n, 0.0f);
+        curtime.assign(n, 0.0f);
+    }
+};
+
+// AoS -> SoA
+inline void particlesToStreams(const std::vector<Particle>& src, ParticleStreams& dst)
+{
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+        dst.posX[i] = src[i].position.x;
+        dst.posY[i] = src[i].position.y;
+        dst.posZ[i] = src[i].position.z;
+        dst.velX[i] = src[i].velocity.x;
+        dst.velY[i] = src[i].velocity.y;
+        dst.velZ[i] = src[i].velocity.z;
+        dst.size[i] = src[i].size;
+        dst.lifetime[i] = src[i].lifetime;
+        dst.curtime[i] = src[i].curtime;
+    }
+}
+
+// SoA -> AoS
+inline void streamsToParticles(const ParticleStreams& src, std::vector<Particle>& dst)
+{
+    dst.resize(src.count());
+    for (size_t i = 0; i < dst.size(); ++i) {
+        dst[i].position = glm::vec3(src.posX[i], src.posY[i], src.posZ[i]);
+        dst[i].velocity = glm::vec3(src.velX[i], src.velY[i], src.velZ[i]);
+        dst[i].size = src.size[i];
+        dst[i].lifetime = src.lifetime[i];
+        dst[i].curtime = src.curtime[i];
+    }
+}
+
+#endif
@@ -0,0 +1,63 @@
+// Packs sprites and flipbook sheets into one atlas texture for an effect.
+//
+//   particleAtlas <out.tga> [--max-size <n>] [--padding <n>] <image | --sheet <image> <columns> <rows>>...
+//
+// Writes <out.tga> and the uv rects beside it as <out>.atlas (textureAtlas.h). The
+// rects follow the arguments, the frames of a sheet in reading order.
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "textureAtlas.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: particleAtlas <out.tga> [--max-size <n>] [--padding <n>] <image | --sheet <image> <columns> <rows>>..." << std::endl;
+        return -1;
+    }
+    std::filesystem::path outPath = argv[1];
+    int maxSize = 4096, padding = 2;
+    std::vector<AtlasImage> images;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max-size" && i + 1 < argc) {
+            maxSize = std::stoi(argv[++i]);
+        }
+        else if (arg == "--padding" && i + 1 < argc) {
+            padding = std::stoi(argv[++i]);
+        }
+        else if (arg == "--sheet" && i + 3 < argc) {
+            AtlasImage sheet;
+            if (!loadAtlasImage(argv[i + 1], sheet))
+                return -1;
+            int columns = std::stoi(argv[i + 2]), rows = std::stoi(argv[i + 3]);
+            if (columns <= 0 || rows <= 0 || sheet.width % columns || sheet.height % rows) {
+                std::cerr << argv[i + 1] << " doesn't split into " << columns << "x" << rows << " frames" << std::endl;
+                return -1;
+            }
+            splitSheet(sheet, columns, rows, images);
+            i += 3;
+        }
+        else {
+            AtlasImage image;
+            if (!loadAtlasImage(arg, image))
+                return -1;
+            images.push_back(std::move(image));
+        }
+    }
+    if (images.empty()) {
+        std::cerr << "No images to pack" << std::endl;
+        return -1;
+    }
+    if (images.size() > (size_t)MAX_ATLAS_RECTS)
+        std::cerr << "Warning: " << images.size() << " rects, draw.vert takes the first " << MAX_ATLAS_RECTS << std::endl;
+
+    TextureAtlas atlas;
+    if (!buildAtlas(images, maxSize, padding, atlas))
+        return -1;
+    if (!saveAtlas(outPath, atlas))
+        return -1;
+    std::cout << images.size() << " images in " << atlas.width << "x" << atlas.height << std::endl;
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Block compresses a texture offline for TextureRegistry, which takes the .dds/.ktx
+// beside a texture over the texture itself.
+//
+//   particleCompress <image> <out.dds | out.ktx> [--format bc1 | bc3] [--mips box | kaiser]
+//
+// Without --format images with any alpha below 255 become BC3, the others BC1
+// (textureCompression.h). --mips compresses the whole mip chain of mipmaps.h.
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "textureCompression.h"
+#include "mipmaps.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: particleCompress <image> <out.dds | out.ktx> [--format bc1 | bc3] [--mips box | kaiser]" << std::endl;
+        return -1;
+    }
+    std::string formatName, mipsName;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            formatName = argv[++i];
+        }
+        else if (arg == "--mips" && i + 1 < argc) {
+            mipsName = argv[++i];
+        }
+        else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return -1;
+        }
+    }
+
+    AtlasImage image;
+    if (!loadAtlasImage(argv[1], image))
+        return -1;
+    uint32_t format;
+    if (formatName == "bc1") {
+        format = COMPRESSED_RGB_BC1;
+    }
+    else if (formatName == "bc3") {
+        format = COMPRESSED_RGBA_BC3;
+    }
+    else if (formatName.empty()) {
+        bool opaque = true;
+        for (size_t i = 3; i < image.rgba.size() && opaque; i += 4)
+            opaque = image.rgba[i] == 255;
+        format = opaque ? COMPRESSED_RGB_BC1 : COMPRESSED_RGBA_BC3;
+    }
+    else {
+        std::cerr << "Unknown format " << formatName << ", bc1 or bc3" << std::endl;
+        return -1;
+    }
+
+    if (!mipsName.empty() && mipsName != "box" && mipsName != "kaiser") {
+        std::cerr << "Unknown mip filter " << mipsName << ", box or kaiser" << std::endl;
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<AtlasImage> levels(1, image);
+    if (!mipsName.empty())
+        generateMipChain(image, mipsName == "box" ? MIP_BOX : MIP_KAISER, levels);
+    CompressedImage compressed;
+    if (!compressImage(levels, format, compressed))
+        return -1;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!saveCompressed(argv[2], compressed))
+        return -1;
+
+    size_t bytes = 0;
+    for (const std::vector<uint8_t>& level : compressed.levels)
+        bytes += level.size();
+    std::cout << image.width << "x" << image.height << " " << (format == COMPRESSED_RGB_BC1 ? "BC1" : "BC3") << ", "
+              << levels.size() << " levels, "
+              << bytes << " bytes (RGBA8 " << image.rgba.size() << "), encoded in " << ms << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Compares two particle dumps (app vs app, app vs particleSim, before vs after a change).
+// Exits with 0 when both dumps have the same frames and every one matches, bit-exactly
+// or within --tolerance when both dumps carry buffers, and with 1 otherwise.
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "particleDump.h"
+
+struct FieldError {
+    float maxError = 0.0f;
+    size_t particles = 0; // particles of the frame that differ by more than the tolerance
+};
+
+static FieldError compareFrame(const DumpFrame& a, const DumpFrame& b, float tolerance)
+{
+    FieldError result;
+    for (size_t i = 0; i < a.particles.size(); ++i) {
+        const float* pa = reinterpret_cast<const float*>(&a.particles[i]);
+        const float* pb = reinterpret_cast<const float*>(&b.particles[i]);
+        float error = 0.0f;
+        bool differs = false;
+        for (size_t f = 0; f < sizeof(Particle) / sizeof(float); ++f) {
+            if (std::memcmp(&pa[f], &pb[f], sizeof(float)) == 0)
+                continue;
+            float d = std::fabs(pa[f] - pb[f]);
+            // a NaN or infinite difference fails the test instead of dropping out of the max
+            if (!(d <= tolerance))
+                differs = true;
+            error = std::max(error, d);
+        }
+        result.maxError = std::max(result.maxError, error);
+        if (differs)
+            ++result.particles;
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: particleDiff <a.dump> <b.dump> [--tolerance <eps>]" << std::endl;
+        return -1;
+    }
+    float tolerance = 0.0f;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--tolerance" && i + 1 < argc)
+            tolerance = std::stof(argv[++i]);
+    }
+
+    ParticleDump a, b;
+    if (!a.load(argv[1]) || !b.load(argv[2]))
+        return -1;
+    if (a.particleCount != b.particleCount) {
+        std::cerr << "Particle counts differ: " << a.particleCount << " vs " << b.particleCount << std::endl;
+        return 1;
+    }
+
+    const size_t numFrames = std::min(a.frames.size(), b.frames.size());
+    const bool buffers = a.withBuffers && b.withBuffers;
+    size_t exact = 0, withinTolerance = 0, mismatched = 0;
+    float maxError = 0.0f;
+    long firstMismatch = -1;
+    for (size_t f = 0; f < numFrames; ++f) {
+        if (a.frames[f].hash == b.frames[f].hash) {
+            ++exact;
+            continue;
+        }
+        if (buffers) {
+            FieldError error = compareFrame(a.frames[f], b.frames[f], tolerance);
+            maxError = std::max(maxError, error.maxError);
+            if (error.particles == 0) {
+                ++withinTolerance;
+                continue;
+            }
+            if (firstMismatch < 0)
+                std::cout << "frame " << a.frames[f].frame << ": " << error.particles
+                          << " particles differ, max error " << error.maxError << std::endl;
+        }
+        else if (firstMismatch < 0) {
+            std::cout << "frame " << a.frames[f].frame << ": hash mismatch" << std::endl;
+        }
+        if (firstMismatch < 0)
+            firstMismatch = (long)f;
+        ++mismatched;
+    }
+
+    std::cout << numFrames << " frames compared: " << exact << " bit-exact, "
+              << withinTolerance << " within tolerance, " << mismatched << " mismatched";
+    if (buffers)
+        std::cout << ", max error " << maxError;
+    std::cout << std::endl;
+    if (a.frames.size() != b.frames.size()) {
+        std::cout << "frame counts differ: " << a.frames.size() << " vs " << b.frames.size() << std::endl;
+        return 1;
+    }
+
+    return mismatched == 0 ? 0 : 1;
+}
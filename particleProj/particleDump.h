@@ -0,0 +1,107 @@
+#ifndef PARTICLE_DUMP_H
+#define PARTICLE_DUMP_H
+
+#include "particle.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// FNV-1a over the raw bytes of the interleaved buffer. Both backends hash the
+// AoS layout so their hashes are directly comparable.
+inline uint64_t hashParticles(const Particle* particles, size_t count)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(particles);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count * sizeof(Particle); ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+struct DumpFrame {
+    uint32_t frame;
+    uint64_t hash;
+    std::vector<Particle> particles; // empty unless the dump was written with buffers
+};
+
+// Per-frame particle hashes (and optionally whole buffers) of one run.
+// Written by the app and by particleSim, compared by particleDiff.
+class ParticleDump
+{
+public:
+    uint32_t particleCount = 0;
+    bool withBuffers = false;
+    std::vector<DumpFrame> frames;
+
+    bool open(const std::filesystem::path& path, uint32_t count, bool buffers)
+    {
+        particleCount = count;
+        withBuffers = buffers;
+        out.open(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "Failed to open dump for writing: " << path.string() << std::endl;
+            return false;
+        }
+        uint32_t header[4] = { MAGIC, VERSION, particleCount, withBuffers ? 1u : 0u };
+        out.write((const char*)header, sizeof(header));
+        return true;
+    }
+
+    bool isOpen() const { return out.is_open(); }
+
+    void write(uint32_t frame, const Particle* particles)
+    {
+        uint64_t hash = hashParticles(particles, particleCount);
+        out.write((const char*)&frame, sizeof(frame));
+        out.write((const char*)&hash, sizeof(hash));
+        if (withBuffers)
+            out.write((const char*)particles, sizeof(Particle) * particleCount);
+    }
+
+    bool load(const std::filesystem::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Failed to open dump: " << path.string() << std::endl;
+            return false;
+        }
+        uint32_t header[4] = { 0, 0, 0, 0 };
+        in.read((char*)header, sizeof(header));
+        if (header[0] != MAGIC || header[1] != VERSION) {
+            std::cerr << "Not a particle dump (or unsupported version): " << path.string() << std::endl;
+            return false;
+        }
+        particleCount = header[2];
+        withBuffers = header[3] != 0;
+        frames.clear();
+        for (;;) {
+            DumpFrame f;
+            if (!in.read((char*)&f.frame, sizeof(f.frame)))
+                break;
+            in.read((char*)&f.hash, sizeof(f.hash));
+            if (withBuffers) {
+                f.particles.resize(particleCount);
+                in.read((char*)f.particles.data(), sizeof(Particle) * particleCount);
+            }
+            if (!in) {
+                std::cerr << "Truncated dump, ignoring the last frame: " << path.string() << std::endl;
+                break;
+            }
+            frames.push_back(std::move(f));
+        }
+        return true;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x4D445350; // "PSDM"
+    static const uint32_t VERSION = 1;
+
+    std::ofstream out;
+};
+
+#endif
@@ -0,0 +1,43 @@
+// Compiles effect files (effectDesc.h) into the binary form the app loads with
+// one read.
+//
+//   particleEffects <out.effects> <effects.json>...
+//
+// The effects of all the inputs go to one file, in argument order. Writing
+// effects/demo.effects beside effects/demo.json makes the app take it while it is
+// newer than the JSON.
+#define PARTICLE_NO_GL
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "effectDesc.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: particleEffects <out.effects> <effects.json>..." << std::endl;
+        return -1;
+    }
+    std::vector<EffectDesc> effects;
+    for (int i = 2; i < argc; ++i) {
+        std::ifstream in(argv[i]);
+        if (!in) {
+            std::cerr << "Failed to open effects: " << argv[i] << std::endl;
+            return -1;
+        }
+        std::stringstream json;
+        json << in.rdbuf();
+        if (!parseEffects(json.str(), argv[i], effects))
+            return -1;
+    }
+    for (size_t i = 0; i < effects.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (std::string(effects[i].name) == effects[j].name)
+                std::cerr << "Warning: two effects named " << effects[i].name << ", --effect picks the first" << std::endl;
+        }
+    }
+    if (!saveCompiledEffects(argv[1], effects))
+        return -1;
+    std::cout << effects.size() << " effects, " << sizeof(EffectDesc) * effects.size() << " bytes" << std::endl;
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Checks of the GL 4.3 compute paths against the CPU code they replace: the grid
+// gpuGrid.h builds with compute shaders against SpatialGrid.
+//
+//   particleGlTests [grid]...
+//
+// Runs every check without a name in a hidden window. Exits with 0 when all of them
+// pass, with 1 otherwise and with 77 (skipped, for ctest) when the driver or the glad
+// loader has no GL 4.3. Run it from the directory holding the shaders.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "particle.h"
+#include "spatialGrid.h"
+#include "gpuGrid.h"
+
+struct TestCase {
+    std::string name;
+    std::function<void()> run;
+};
+
+static const int SKIPPED = 77;
+static size_t failures;
+
+// prints what failed, the test carries on so one run reports every broken check
+static bool expect(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cout << "  FAILED: " << what << std::endl;
+        ++failures;
+    }
+    return ok;
+}
+
+static bool particleLess(const Particle& a, const Particle& b)
+{
+    return std::memcmp(&a, &b, sizeof(Particle)) < 0;
+}
+
+// ------------------------------------------------------------------ grid
+
+// the compute grid has SpatialGrid's bucket starts and, bucket for bucket, the same
+// particles (the atomics of gridCount.comp leave their order inside a bucket open)
+static void testGrid()
+{
+    for (size_t n : { (size_t)200, (size_t)1000, (size_t)100000 }) {
+        std::mt19937 rng((unsigned int)n);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<Particle> particles(n);
+        for (Particle& p : particles) {
+            p.position = glm::vec3(unit(rng), unit(rng), 0.3f * unit(rng));
+            p.velocity = glm::vec3(unit(rng), unit(rng), unit(rng));
+            p.size = 60.0f;
+            p.lifetime = 2.0f;
+            p.curtime = unit(rng);
+        }
+        const float radius = 0.05f;
+        const std::string what = std::to_string(n) + " particles";
+
+        GLuint vbo;
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Particle) * n, particles.data(), GL_DYNAMIC_COPY);
+        GpuGrid grid;
+        if (!expect(grid.init(n), "the grid shaders don't build")) {
+            glDeleteBuffers(1, &vbo);
+            return;
+        }
+        grid.build(vbo, n, radius);
+
+        ParticleStreams streams;
+        particlesToStreams(particles, streams);
+        SpatialGrid reference;
+        reference.build(streams, radius);
+        const std::vector<uint32_t>& starts = reference.bucketStarts();
+        const std::vector<uint32_t>& order = reference.order();
+
+        std::vector<GLuint> gpuStarts(starts.size());
+        std::vector<Particle> sorted(n);
+        glBindBuffer(GL_ARRAY_BUFFER, grid.bucketStarts());
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLuint) * gpuStarts.size(), gpuStarts.data());
+        glBindBuffer(GL_ARRAY_BUFFER, grid.sortedParticles());
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Particle) * n, sorted.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        expect(grid.bucketBits() == reference.bucketBits(), what + ": the bucket table size differs from SpatialGrid");
+        if (expect(gpuStarts == std::vector<GLuint>(starts.begin(), starts.end()), what + ": the bucket starts differ from SpatialGrid")) {
+            size_t wrongBuckets = 0;
+            for (size_t b = 0; b + 1 < starts.size(); ++b) {
+                std::vector<Particle> expected, found(sorted.begin() + starts[b], sorted.begin() + starts[b + 1]);
+                for (size_t k = starts[b]; k < starts[b + 1]; ++k)
+                    expected.push_back(particles[order[k]]);
+                std::sort(expected.begin(), expected.end(), particleLess);
+                std::sort(found.begin(), found.end(), particleLess);
+                wrongBuckets += !std::equal(found.begin(), found.end(), expected.begin(), [](const Particle& a, const Particle& b) {
+                    return std::memcmp(&a, &b, sizeof(Particle)) == 0;
+                });
+            }
+            expect(wrongBuckets == 0, what + ": " + std::to_string(wrongBuckets) + " buckets hold other particles than SpatialGrid's");
+        }
+        expect(glGetError() == GL_NO_ERROR, what + ": GL error");
+        grid.release();
+        glDeleteBuffers(1, &vbo);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<TestCase> cases = {
+        { "grid", testGrid },
+    };
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (std::any_of(cases.begin(), cases.end(), [&arg](const TestCase& c) { return c.name == arg; })) {
+            selected.push_back(arg);
+        }
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return -1;
+        }
+    }
+
+    GLFWwindow* window = nullptr;
+    if (glfwInit()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow(64, 64, "particleGlTests", NULL, NULL);
+    }
+    if (window) {
+        glfwMakeContextCurrent(window);
+        gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
+#ifdef GL_VERSION_4_3
+    bool compute = window && GLAD_GL_VERSION_4_3;
+#else
+    bool compute = false;
+#endif
+    if (!compute) {
+        std::cout << "No GL 4.3 context, skipping" << std::endl;
+        glfwTerminate();
+        return SKIPPED;
+    }
+
+    for (const TestCase& c : cases) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), c.name) == selected.end())
+            continue;
+        size_t before = failures;
+        c.run();
+        std::cout << c.name << ": " << (failures == before ? "passed" : "FAILED") << std::endl;
+    }
+    glfwTerminate();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+// Headless particle simulator, runs the CPU backend without a window or GL context.
+// Replays an input journal recorded by the app (or generates the same inputs the
+// app generates live) and dumps per-frame particle hashes for particleDiff.
+//
+// --train runs the fixed workload used to collect PGO profiles (see scripts/pgo.sh):
+// startup noise generation, repeated smoke.tga decodes, then frames of emission with
+// periodic bursts and rate changes, each followed by the draw.vert evaluation.
+#define PARTICLE_NO_GL
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "particle.h"
+#include "simInput.h"
+#include "particleDump.h"
+#include "cpuSimulator.h"
+#include "profiler.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "Noise3D.c"
+
+// the scripted inputs of --train
+static void trainingJournal(InputJournal& journal, size_t numFrames, unsigned int numParticles)
+{
+    float uTime = 0.f;
+    for (size_t frame = 0; frame < numFrames; ++frame) {
+        FrameInput input;
+        uTime += 0.001;
+        input.time = uTime;
+        input.emissionRate = (frame / 500) % 2 ? 0.6f : 0.3f;
+        input.spawnBurst = frame % 250 == 0 ? numParticles / 8 : 0;
+        journal.record(input);
+    }
+}
+
+static void trainingTextureLoads(const std::filesystem::path& assets, int count)
+{
+    std::filesystem::path filePath = assets / "textures/smoke.tga";
+    for (int i = 0; i < count; ++i) {
+        int width, height, nrChannels;
+        stbi_set_flip_vertically_on_load(true);
+        unsigned char* data = stbi_load(filePath.string().c_str(), &width, &height, &nrChannels, 0);
+        if (!data) {
+            std::cout << "Failed to load texture" << std::endl;
+            return;
+        }
+        stbi_image_free(data);
+    }
+}
+
+int main(int argc, char** argv) {
+    // --replay <journal>  inputs to run, otherwise --frames frames of default inputs
+    // --record <journal>  save the inputs that were run
+    // --dump <file>       per-frame particle hashes
+    // --dump-buffers      also write the whole particle buffer of every frame
+    // --frames <n>        frame count for runs without a journal
+    // --particles <n>     particle count, must match the run being compared against
+    // --seed <n>          seed for runs without a journal
+    // --profile <file>    write a Chrome trace of the run
+    // --train             run the PGO training workload (defaults to 2000 frames of 100000 particles)
+    // --assets <dir>      directory holding textures/ and effects/, for --train and --effect
+    // --effect <name>     spawn the effect of effects/demo.json, and use its rate and
+    //                     forces for runs without a journal; a journal's own effect by default
+    // --update <source>   per-particle update statements (particleVm.h), instead of the effect's
+    // --cache <dir>       where the baked SDF is kept between runs, "" bakes it every run
+    std::filesystem::path recordPath, replayPath, dumpPath, tracePath, assets = ".", cacheDir = "sdfcache";
+    std::string effectName, updateSource;
+    bool hasUpdate = false;
+    bool dumpBuffers = false;
+    bool train = false;
+    size_t numFrames = 0;
+    unsigned int numParticles = 0;
+    unsigned int seed = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (arg == "--dump" && i + 1 < argc)
+            dumpPath = argv[++i];
+        else if (arg == "--dump-buffers")
+            dumpBuffers = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            numFrames = std::stoul(argv[++i]);
+        else if (arg == "--particles" && i + 1 < argc)
+            numParticles = (unsigned int)std::stoul(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = (unsigned int)std::stoul(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--train")
+            train = true;
+        else if (arg == "--assets" && i + 1 < argc)
+            assets = argv[++i];
+        else if (arg == "--effect" && i + 1 < argc)
+            effectName = argv[++i];
+        else if (arg == "--update" && i + 1 < argc) {
+            updateSource = argv[++i];
+            hasUpdate = true;
+        }
+        else if (arg == "--cache" && i + 1 < argc) {
+            cacheDir = argv[++i];
+        }
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return -1;
+        }
+    }
+
+    if (numFrames == 0)
+        numFrames = train ? 2000 : 1000;
+    if (numParticles == 0)
+        numParticles = train ? 100000 : 200;
+
+    InputJournal journal;
+    if (!replayPath.empty()) {
+        if (!journal.load(replayPath))
+            return -1;
+        if (effectName.empty()) {
+            effectName = journal.effect;
+        }
+        else if (!journal.effect.empty() && effectName != journal.effect) {
+            std::cerr << "--effect " << effectName << " conflicts with the effect of the journal, " << journal.effect << std::endl;
+            return -1;
+        }
+    }
+
+    EffectDesc effect;
+    if (!effectName.empty()) {
+        std::vector<EffectDesc> effects;
+        if (!loadEffects(assets / "effects/demo.json", effects))
+            return -1;
+        const EffectDesc* found = findEffect(effects, effectName);
+        if (!found) {
+            std::cerr << "No effect named " << effectName << std::endl;
+            return -1;
+        }
+        effect = *found;
+    }
+    if (!hasUpdate)
+        updateSource = effect.update;
+
+    // --record saves the effect with the inputs
+    journal.effect = effectName;
+    if (replayPath.empty() && train) {
+        trainingJournal(journal, numFrames, numParticles);
+    }
+    else if (replayPath.empty()) {
+        float uTime = 0.f;
+        for (size_t frame = 0; frame < numFrames; ++frame) {
+            FrameInput input;
+            uTime += 0.001;
+            input.time = uTime;
+            input.seed = seed;
+            input.emissionRate = effect.emissionRate;
+            input.acceleration = effect.acceleration;
+            input.turbulence = effect.turbulence;
+            journal.record(input);
+        }
+    }
+
+    ParticleDump dump;
+    if (!dumpPath.empty() && !dump.open(dumpPath, numParticles, dumpBuffers))
+        return -1;
+
+    Profiler profiler;
+    CpuSimulator sim;
+    sim.effect = effect.block;
+    sim.curves.bake(effect.curves);
+    if (!sim.update.compile(updateSource)) {
+        std::cerr << "--update: " << sim.update.error() << std::endl;
+        return -1;
+    }
+    NoiseGenerator emitNoise, curlNoise;
+    initNoiseGenerator(&emitNoise, 0, 0);
+    initNoiseGenerator(&curlNoise, 1, 4);
+    {
+        // same volume as the app's Create3DNoiseTexture(&emitNoise, 128, 50.0)
+        ProfileScope scope(profiler, "noise");
+        sim.noise.size = 128;
+        sim.noise.texels.resize(128 * 128 * 128);
+        Generate3DNoise(&emitNoise, 128, 50.0, sim.noise.texels.data());
+    }
+    {
+        // and Create3DCurlNoiseTexture(&curlNoise, 64, 4.0), a GL_REPEAT texture
+        ProfileScope scope(profiler, "curl");
+        sim.curl.size = 64;
+        sim.curl.repeat = curlNoise.period > 0;
+        sim.curl.texels.resize(64 * 64 * 64 * 3);
+        Generate3DCurlNoise(&curlNoise, 64, 4.0, sim.curl.texels.data());
+    }
+    if (train) {
+        ProfileScope scope(profiler, "textures");
+        trainingTextureLoads(assets, 64);
+    }
+    // the app's scene, used by the frames recorded with collisions on
+    {
+        ProfileScope scope(profiler, "sdf");
+        bakeDemoSdf(sim.sdf, cacheDir);
+    }
+    demoColliders(sim.colliders, sim.sdf);
+    demoForceFields(sim.forceFields);
+    // and its depth, for the frames recorded with depth collisions on
+    {
+        ProfileScope scope(profiler, "depth");
+        TriangleMesh sceneMesh;
+        demoMesh(sceneMesh);
+        sim.depth.resize(DEPTH_WIDTH, DEPTH_HEIGHT, sceneViewProjection());
+        rasterizeDepth(sceneMesh, sim.depth);
+    }
+    sim.init(numParticles);
+
+    std::vector<Particle> snapshot;
+    std::vector<glm::vec3> drawOut;
+    FrameInput input;
+    for (size_t frame = 0; journal.replay(frame, input); ++frame) {
+        {
+            ProfileScope scope(profiler, "step");
+            sim.step(input);
+        }
+        if (train) {
+            ProfileScope scope(profiler, "draw");
+            sim.drawAttributes(input, drawOut);
+        }
+        if (dump.isOpen()) {
+            ProfileScope scope(profiler, "dump");
+            sim.snapshot(snapshot);
+            dump.write((uint32_t)frame, snapshot.data());
+        }
+    }
+
+    sim.snapshot(snapshot);
+    std::cout << journal.frames.size() << " frames, final hash " << std::hex
+              << hashParticles(snapshot.data(), snapshot.size()) << std::dec << std::endl;
+
+    profiler.report(std::cout);
+    if (!tracePath.empty() && !profiler.exportChromeTrace(tracePath))
+        return -1;
+    if (!recordPath.empty() && !journal.save(recordPath))
+        return -1;
+    return 0;
+}
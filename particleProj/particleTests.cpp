@@ -0,0 +1,1038 @@
+// Checks of the CPU building blocks against straightforward reference versions:
+// the update VM against the same statements in C++, the noise gradients against
+// central differences, the radix and depth sorts against std::stable_sort, the
+// neighbor grid against a brute force search, baked distance volumes against the
+// analytic torus, depth collisions against a plane, the force field kernels against
+// fieldForce() per particle, and the noise seeds and periods, colliders, atlas packer,
+// block encoder, mip chains and effect files against what they promise.
+//
+//   particleTests [--assets <dir>] [check]...
+//
+// check: vm, curves, gradient, noise, sort, grid, colliders, sdf, depth, fields, atlas,
+// compress, mips or effects.
+//
+// Runs every check without a name. Exits with 0 when all of them pass and with 1
+// otherwise, CMake registers each one as a test (ctest).
+#define PARTICLE_NO_GL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "particle.h"
+#include "particleVm.h"
+#include "curves.h"
+#include "depthSort.h"
+#include "spatialGrid.h"
+#include "colliders.h"
+#include "depthCollision.h"
+#include "forceFields.h"
+#include "cpuSimulator.h"
+#include "effectDesc.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "textureCompression.h"
+#include "mipmaps.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Noise3D.c"
+
+struct TestCase {
+    std::string name;
+    std::function<void()> run;
+};
+
+static std::filesystem::path assets = ".";
+static size_t failures;
+
+// prints what failed, the test carries on so one run reports every broken check
+static bool expect(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cout << "  FAILED: " << what << std::endl;
+        ++failures;
+    }
+    return ok;
+}
+
+static bool close(float a, float b, float tolerance)
+{
+    return std::fabs(a - b) <= tolerance * (1.0f + std::fabs(b));
+}
+
+static void randomStreams(ParticleStreams& streams, size_t n, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), span(0.0f, 2.0f);
+    streams.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        streams.posX[i] = unit(rng); streams.posY[i] = unit(rng); streams.posZ[i] = unit(rng);
+        streams.velX[i] = unit(rng); streams.velY[i] = unit(rng); streams.velZ[i] = unit(rng);
+        streams.size[i] = 60.0f + 20.0f * unit(rng);
+        streams.curtime[i] = span(rng);
+        streams.lifetime[i] = span(rng);
+    }
+}
+
+// ------------------------------------------------------------------ vm
+
+// every operator and function of the language, with the scalar code it must match
+static void testVm()
+{
+    const char* source =
+        "velX = velX - velX * 0.5 * dt + sin(time * 3.0 + posY) * dt;"
+        "velY = -velY / (1.0 + abs(velZ)) + cos(posX) * dt;"
+        "velZ = clamp(velZ, -0.25, 0.5) + floor(posZ * 4.0) * 0.125;"
+        "posX = posX + velX * dt; posY = posY + velY * dt; posZ = min(posZ, max(posX, sqrt(abs(posY))));"
+        "size = mix(size, 0.0, step(0.8, age) * dt)";
+    ParticleProgram program;
+    if (!expect(program.compile(source), "compile: " + program.error()))
+        return;
+    expect(program.writtenStreams() == (1u << VM_POS_X | 1u << VM_POS_Y | 1u << VM_POS_Z | 1u << VM_VEL_X | 1u << VM_VEL_Y |
+                                        1u << VM_VEL_Z | 1u << VM_SIZE) && program.movesParticles(), "the written streams are wrong");
+    ParticleProgram shrink;
+    expect(shrink.compile("size = size * (1.0 - dt)") && !shrink.movesParticles(), "a size update moves particles");
+
+    const float time = 1.5f, dt = 0.01f;
+    for (size_t n : { (size_t)3, (size_t)1000, (size_t)1003 }) {
+        for (int chunk : { VM_CHUNK, 4, 100 }) {
+            ParticleStreams vm, reference;
+            randomStreams(vm, n, 1);
+            reference = vm;
+            program.run(vm, time, dt, chunk);
+
+            ParticleStreams& s = reference;
+            for (size_t i = 0; i < n; ++i) {
+                float deltaTime = time - s.curtime[i];
+                if (!(deltaTime > 0.0f && deltaTime <= s.lifetime[i]))
+                    continue;
+                float age = deltaTime / s.lifetime[i];
+                s.velX[i] = s.velX[i] - s.velX[i] * 0.5f * dt + std::sin(time * 3.0f + s.posY[i]) * dt;
+                s.velY[i] = -s.velY[i] / (1.0f + std::fabs(s.velZ[i])) + std::cos(s.posX[i]) * dt;
+                s.velZ[i] = std::min(std::max(s.velZ[i], -0.25f), 0.5f) + std::floor(s.posZ[i] * 4.0f) * 0.125f;
+                s.posX[i] = s.posX[i] + s.velX[i] * dt;
+                s.posY[i] = s.posY[i] + s.velY[i] * dt;
+                s.posZ[i] = std::min(s.posZ[i], std::max(s.posX[i], std::sqrt(std::fabs(s.posY[i]))));
+                float shrink = age < 0.8f ? 0.0f : dt;
+                s.size[i] = s.size[i] + (0.0f - s.size[i]) * shrink;
+            }
+
+            const std::vector<float>* a[] = { &vm.posX, &vm.posY, &vm.posZ, &vm.velX, &vm.velY, &vm.velZ, &vm.size, &vm.lifetime, &vm.curtime };
+            const std::vector<float>* b[] = { &s.posX, &s.posY, &s.posZ, &s.velX, &s.velY, &s.velZ, &s.size, &s.lifetime, &s.curtime };
+            size_t wrong = 0;
+            for (int stream = 0; stream < 9; ++stream) {
+                for (size_t i = 0; i < n; ++i)
+                    wrong += !close((*a[stream])[i], (*b[stream])[i], 1e-5f);
+            }
+            expect(wrong == 0, std::to_string(wrong) + " values differ from the scalar update, n " + std::to_string(n) +
+                               " chunk " + std::to_string(chunk));
+        }
+    }
+
+    for (const char* bad : { "posX = ", "age = 1.0", "posX = foo(1.0)", "posX = (1.0", "posX = 1.0 $" }) {
+        ParticleProgram rejected;
+        expect(!rejected.compile(bad) && !rejected.error().empty() && rejected.empty(),
+               std::string("compiles invalid source: ") + bad);
+    }
+
+    // an update that lifts every particle into the scene's last collider, past the
+    // first MAX_COLLIDERS, kills them all on the next step
+    CpuSimulator sim;
+    const size_t n = 100;
+    sim.init(n);
+    randomStreams(sim.streams, n, 2);
+    std::fill(sim.streams.curtime.begin(), sim.streams.curtime.end(), 0.0f);
+    std::fill(sim.streams.lifetime.begin(), sim.streams.lifetime.end(), 100.0f);
+    for (int i = 0; i < MAX_COLLIDERS; ++i)
+        sim.colliders.push_back(Collider::sphere(glm::vec3(100.0f + i, 0.0f, 0.0f), 0.1f));
+    sim.colliders.push_back(Collider::box(glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(10.0f, 1.0f, 10.0f)).response(0.5f, 0.0f, true));
+    if (!expect(sim.update.compile("posY = 5.0"), "compile: " + sim.update.error()))
+        return;
+    FrameInput input;
+    input.emissionRate = 0.0f;
+    input.turbulence = 0.0f;
+    input.collisions = true;
+    for (int frame = 1; frame <= 2; ++frame) {
+        input.time = 0.01f * frame;
+        sim.step(input);
+    }
+    size_t killed = std::count_if(sim.streams.lifetime.begin(), sim.streams.lifetime.end(), [](float t) { return t < 0.0f; });
+    expect(killed == n, std::to_string(killed) + " of " + std::to_string(n) + " particles moved by the update hit the collider past MAX_COLLIDERS");
+}
+
+// the SIMD table lookup against its scalar form, on ages before, inside and past the lifetime
+static void testCurves()
+{
+    EffectCurves effectCurves;
+    const float ages[4] = { 0.0f, 0.2f, 0.7f, 1.0f }, values[4] = { 0.1f, 1.5f, 0.8f, 0.0f };
+    effectCurves.size.count = 4;
+    std::copy(ages, ages + 4, effectCurves.size.time);
+    std::copy(values, values + 4, effectCurves.size.value);
+    CurveTable table;
+    table.bake(effectCurves);
+
+    const size_t n = 1003;
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> spawn(-1.0f, 3.0f), life(0.5f, 2.0f);
+    std::vector<float> curtime(n), lifetime(n), out(n);
+    for (size_t i = 0; i < n; ++i) {
+        curtime[i] = spawn(rng);
+        lifetime[i] = i % 17 ? life(rng) : -1.0f;
+    }
+    evaluateCurve(table.size.data(), 2.0f, curtime.data(), lifetime.data(), out.data(), n);
+    size_t wrong = 0, offCurve = 0;
+    for (size_t i = 0; i < n; ++i) {
+        float age = (2.0f - curtime[i]) / lifetime[i];
+        wrong += out[i] != sampleCurveTable(table.size.data(), age);
+        offCurve += !close(out[i], evaluateCurve(effectCurves.size, clampAge(age)), 1e-2f);
+    }
+    expect(wrong == 0, std::to_string(wrong) + " lookups differ from sampleCurveTable");
+    expect(offCurve == 0, std::to_string(offCurve) + " lookups are off the curve");
+}
+
+// ------------------------------------------------------------------ noise
+
+// the analytic gradient against central differences of noise3DGen, and the 4 wide
+// form against it lane for lane, on plain and tiling generators
+static void testGradient()
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coord(-8.0f, 8.0f);
+    for (int period : { 0, 4 }) {
+        NoiseGenerator gen;
+        initNoiseGenerator(&gen, 3, period);
+        const std::string what = period ? "tiling noise" : "noise";
+
+        size_t wrongValues = 0, wrongGradients = 0;
+        for (int i = 0; i < 1000; ++i) {
+            float p[3] = { coord(rng), coord(rng), coord(rng) }, grad[3];
+            float value = noise3DGen_grad(&gen, p, grad);
+            wrongValues += !close(value, noise3DGen(&gen, p), 1e-5f);
+            for (int a = 0; a < 3; ++a) {
+                const float h = 1e-3f;
+                float hi[3] = { p[0], p[1], p[2] }, lo[3] = { p[0], p[1], p[2] };
+                hi[a] += h;
+                lo[a] -= h;
+                float difference = (noise3DGen(&gen, hi) - noise3DGen(&gen, lo)) / (hi[a] - lo[a]);
+                wrongGradients += !close(grad[a], difference, 2e-3f);
+            }
+        }
+        expect(wrongValues == 0, std::to_string(wrongValues) + " " + what + " values differ from noise3DGen");
+        expect(wrongGradients == 0, std::to_string(wrongGradients) + " " + what + " gradients differ from central differences");
+
+        // random points, and lattice points where the floor of a negative coordinate matters
+        size_t wrongLanes = 0;
+        for (int i = 0; i < 1000; ++i) {
+            float x[4], y[4], z[4], value[4], gx[4], gy[4], gz[4];
+            for (int lane = 0; lane < 4; ++lane) {
+                x[lane] = coord(rng);
+                y[lane] = coord(rng);
+                z[lane] = coord(rng);
+                if (i % 4 == 0) {
+                    x[lane] = std::floor(x[lane]);
+                    y[lane] = -(float)lane;
+                }
+            }
+            noise3DGen_grad4(&gen, x, y, z, value, gx, gy, gz);
+            for (int lane = 0; lane < 4; ++lane) {
+                float p[3] = { x[lane], y[lane], z[lane] }, grad[3];
+                float scalar = noise3DGen_grad(&gen, p, grad);
+                wrongLanes += !(close(value[lane], scalar, 1e-5f) && close(gx[lane], grad[0], 1e-5f) &&
+                                close(gy[lane], grad[1], 1e-5f) && close(gz[lane], grad[2], 1e-5f));
+            }
+        }
+        expect(wrongLanes == 0, std::to_string(wrongLanes) + " " + what + " lanes of noise3DGen_grad4 differ from noise3DGen_grad");
+    }
+}
+
+// a seed always gives the same noise and other seeds other noise, a period makes it
+// tile: n(p) == n(p + period) along each axis, on both sides of the origin
+static void testNoise()
+{
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<float> coord(-8.0f, 8.0f);
+    std::vector<glm::vec3> points(1000);
+    for (glm::vec3& p : points)
+        p = glm::vec3(coord(rng), coord(rng), coord(rng));
+
+    NoiseGenerator a, b, other;
+    initNoiseGenerator(&a, 5, 0);
+    initNoiseGenerator(&b, 5, 0);
+    initNoiseGenerator(&other, 6, 0);
+    size_t differentSeedSame = 0, sameSeedDifferent = 0;
+    for (const glm::vec3& p : points) {
+        float f[3] = { p.x, p.y, p.z };
+        sameSeedDifferent += noise3DGen(&a, f) != noise3DGen(&b, f);
+        differentSeedSame += noise3DGen(&a, f) == noise3DGen(&other, f);
+    }
+    expect(sameSeedDifferent == 0, std::to_string(sameSeedDifferent) + " points differ between two generators of one seed");
+    expect(differentSeedSame < points.size() / 100, std::to_string(differentSeedSame) + " points are the same for seeds 5 and 6");
+
+    NoiseGenerator book;
+    initNoiseGenerator(&book, 0, 0);
+    expect(std::equal(book.perm, book.perm + 256, bookPermTable), "seed 0 isn't the book's permutation");
+
+    for (int period : { 1, 4, 7, 256 }) {
+        NoiseGenerator tiling;
+        initNoiseGenerator(&tiling, 9, period);
+        size_t wrong = 0;
+        for (const glm::vec3& p : points) {
+            float f[3] = { p.x, p.y, p.z };
+            float n = noise3DGen(&tiling, f);
+            for (int axis = 0; axis < 3; ++axis) {
+                for (float shift : { (float)period, -2.0f * period }) {
+                    float g[3] = { p.x, p.y, p.z };
+                    g[axis] += shift;
+                    wrong += !close(noise3DGen(&tiling, g), n, 1e-3f);
+                }
+            }
+        }
+        expect(wrong == 0, std::to_string(wrong) + " points don't repeat after a period of " + std::to_string(period));
+    }
+}
+
+// ------------------------------------------------------------------ sort
+
+static void testSort()
+{
+    // many equal keys, so the stability shows
+    for (size_t n : { (size_t)1, (size_t)1000, (size_t)100000 }) {
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<uint32_t> key(0, 5000);
+        std::vector<uint32_t> keys(n), values(n);
+        std::vector<std::pair<uint32_t, uint32_t>> reference(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = key(rng) * 0x10001u;
+            values[i] = (uint32_t)i;
+            reference[i] = { keys[i], values[i] };
+        }
+        RadixSorter radix;
+        radix.sort(keys, values);
+        std::stable_sort(reference.begin(), reference.end(),
+                         [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+        bool same = true;
+        for (size_t i = 0; i < n; ++i)
+            same = same && keys[i] == reference[i].first && values[i] == reference[i].second;
+        expect(same, "radix sort of " + std::to_string(n) + " keys differs from std::stable_sort");
+    }
+
+    // a full sort, then an incremental one after a frame's worth of movement
+    ParticleStreams streams;
+    randomStreams(streams, 5000, 4);
+    const float time = 1.0f;
+    glm::mat4 viewProjection = glm::perspective(60.0f, 4.0f / 3.0f, 0.1f, 10.0f) *
+                               glm::lookAt(glm::vec3(1.5f, 0.5f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    DepthSorter sorter;
+    for (int frame = 0; frame < 2; ++frame) {
+        if (frame == 1) {
+            for (size_t i = 0; i < streams.count(); ++i)
+                streams.posX[i] += streams.velX[i] * 0.001f;
+        }
+        std::vector<uint32_t> order = sorter.sort(streams, time, viewProjection);
+        std::vector<uint32_t> alive, keys;
+        for (size_t i = 0; i < streams.count(); ++i) {
+            if (time - streams.curtime[i] <= streams.lifetime[i]) {
+                alive.push_back((uint32_t)i);
+                keys.push_back(backToFrontKey(windowDepth(viewProjection, streams.posX[i], streams.posY[i], streams.posZ[i])));
+            }
+        }
+        std::vector<uint32_t> sortedKeys = keys, orderKeys;
+        std::sort(sortedKeys.begin(), sortedKeys.end());
+        for (uint32_t i : order)
+            orderKeys.push_back(backToFrontKey(windowDepth(viewProjection, streams.posX[i], streams.posY[i], streams.posZ[i])));
+        std::sort(order.begin(), order.end());
+        const std::string what = frame == 0 ? "full depth sort" : "incremental depth sort";
+        expect(order == alive, what + " doesn't hold every live particle once");
+        expect(orderKeys == sortedKeys, what + " isn't back to front");
+        if (frame == 1)
+            expect(sorter.wasIncremental(), "a frame's movement fell back to the full sort");
+    }
+}
+
+// ------------------------------------------------------------------ grid
+
+static void testGrid()
+{
+    const size_t n = 3000;
+    ParticleStreams streams;
+    randomStreams(streams, n, 5);
+    const float radius = 0.15f;
+    SpatialGrid grid;
+    grid.build(streams, radius);
+    expect(std::set<uint32_t>(grid.order().begin(), grid.order().end()).size() == n, "order() isn't a permutation");
+
+    size_t wrongParticles = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        std::vector<uint32_t> found, expected;
+        grid.forEachNeighbor(i, radius, [&found](uint32_t j, float) { found.push_back(j); });
+        for (uint32_t j = 0; j < n; ++j) {
+            float dx = streams.posX[j] - streams.posX[i], dy = streams.posY[j] - streams.posY[i], dz = streams.posZ[j] - streams.posZ[i];
+            if (j != i && dx * dx + dy * dy + dz * dz <= radius * radius)
+                expected.push_back(j);
+        }
+        std::sort(found.begin(), found.end());
+        wrongParticles += found != expected;
+    }
+    expect(wrongParticles == 0, std::to_string(wrongParticles) + " particles' neighbors differ from the brute force search");
+
+    // a query point outside the particles, with a radius wider than a cell
+    glm::vec3 p(1.2f, -0.3f, 0.4f);
+    std::vector<uint32_t> found, expected;
+    grid.forEachNeighbor(p, 3.0f * radius, [&found](uint32_t j, float) { found.push_back(j); });
+    for (uint32_t j = 0; j < n; ++j) {
+        float dx = streams.posX[j] - p.x, dy = streams.posY[j] - p.y, dz = streams.posZ[j] - p.z;
+        if (dx * dx + dy * dy + dz * dz <= 9.0f * radius * radius)
+            expected.push_back(j);
+    }
+    std::sort(found.begin(), found.end());
+    expect(found == expected, "the neighbors of a point differ from the brute force search");
+}
+
+// ------------------------------------------------------------------ colliders
+
+static bool closeVec(const glm::vec3& a, const glm::vec3& b, float tolerance)
+{
+    return close(a.x, b.x, tolerance) && close(a.y, b.y, tolerance) && close(a.z, b.z, tolerance);
+}
+
+// every analytic shape with its surface at y = 0.5 above the test point: a particle
+// 0.1 inside is moved to the surface, bounces and slides, one outside is left alone
+// and a kill collider reports the hit. Then the broad phase, on colliders just inside
+// and just outside the bounds, and the reach of emitterBounds().
+static void testColliders()
+{
+    const float restitution = 0.6f, friction = 0.25f;
+    const std::pair<std::string, Collider> shapes[] = {
+        { "plane", Collider::plane(glm::vec3(0.0f, 1.0f, 0.0f), 0.5f) },
+        { "sphere", Collider::sphere(glm::vec3(0.3f, 0.0f, -0.2f), 0.5f) },
+        { "box", Collider::box(glm::vec3(0.0f), glm::vec3(1.0f, 0.5f, 1.0f)) },
+        { "capsule", Collider::capsule(glm::vec3(-1.0f, 0.0f, -0.2f), glm::vec3(1.0f, 0.0f, -0.2f), 0.5f) },
+    };
+    const SdfVolume noSdf;
+    for (const auto& shape : shapes) {
+        const std::string& name = shape.first;
+        std::vector<Collider> active(1, shape.second);
+        active[0].response(restitution, friction);
+
+        glm::vec3 pos(0.3f, 0.4f, -0.2f), vel(1.0f, -2.0f, 0.5f);
+        bool killed = collideParticle(active, noSdf, pos, vel);
+        expect(!killed && closeVec(pos, glm::vec3(0.3f, 0.5f, -0.2f), 1e-5f), name + " doesn't push the particle to its surface");
+        expect(closeVec(vel, glm::vec3(1.0f - friction, 2.0f * restitution, 0.5f * (1.0f - friction)), 1e-5f),
+               name + " doesn't reflect and slow the velocity by restitution and friction");
+
+        // already leaving: moved out, velocity kept
+        pos = glm::vec3(0.3f, 0.45f, -0.2f);
+        vel = glm::vec3(1.0f, 2.0f, 0.0f);
+        collideParticle(active, noSdf, pos, vel);
+        expect(closeVec(pos, glm::vec3(0.3f, 0.5f, -0.2f), 1e-5f) && vel == glm::vec3(1.0f, 2.0f, 0.0f),
+               name + " changes the velocity of a particle leaving it");
+
+        pos = glm::vec3(0.3f, 0.6f, -0.2f);
+        vel = glm::vec3(1.0f, -2.0f, 0.5f);
+        collideParticle(active, noSdf, pos, vel);
+        expect(pos == glm::vec3(0.3f, 0.6f, -0.2f) && vel == glm::vec3(1.0f, -2.0f, 0.5f), name + " moves a particle outside it");
+
+        active[0].response(restitution, friction, true);
+        pos = glm::vec3(0.3f, 0.4f, -0.2f);
+        expect(collideParticle(active, noSdf, pos, vel), name + " doesn't kill a particle inside it");
+        pos = glm::vec3(0.3f, 0.6f, -0.2f);
+        expect(!collideParticle(active, noSdf, pos, vel), name + " kills a particle outside it");
+    }
+
+    // pairs just inside and just outside the unit bounds
+    const Bounds bounds{ glm::vec3(-1.0f), glm::vec3(1.0f) };
+    std::vector<Collider> scene;
+    for (float gap : { -0.01f, 0.01f }) {
+        scene.push_back(Collider::plane(glm::vec3(0.0f, 1.0f, 0.0f), -1.0f - gap));
+        scene.push_back(Collider::sphere(glm::vec3(1.5f + gap, 0.0f, 0.0f), 0.5f));
+        scene.push_back(Collider::box(glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3(0.5f, 0.5f, 1.0f - gap)));
+        scene.push_back(Collider::capsule(glm::vec3(-1.3f - gap, -5.0f, 0.0f), glm::vec3(-1.3f - gap, 5.0f, 0.0f), 0.3f));
+    }
+    std::vector<Collider> active;
+    cullColliders(scene, bounds, active);
+    bool insideKept = active.size() == 4;
+    for (size_t i = 0; insideKept && i < 4; ++i)
+        insideKept = active[i].shape0 == scene[i].shape0 && active[i].shape1 == scene[i].shape1;
+    expect(insideKept, std::to_string(active.size()) + " colliders pass the broad phase, expected the 4 just inside the bounds");
+
+    // a crowded scene is capped, in scene order
+    scene.clear();
+    for (int i = 0; i < MAX_COLLIDERS + 20; ++i)
+        scene.push_back(Collider::sphere(glm::vec3(0.0f, 0.01f * i, 0.0f), 0.1f));
+    cullColliders(scene, bounds, active);
+    ColliderBlock block;
+    expect(active.size() == (size_t)MAX_COLLIDERS && active.back().shape0 == scene[MAX_COLLIDERS - 1].shape0 &&
+           packColliders(active, block) == MAX_COLLIDERS, "the broad phase isn't capped at MAX_COLLIDERS");
+
+    // no particle of the effect, integrated like CpuSimulator, leaves emitterBounds()
+    FrameInput input;
+    input.acceleration = glm::vec3(0.5f, -1.0f, 0.0f);
+    input.turbulence = 0.0f;
+    EffectBlock effect;
+    const float dt = 1.0f / 60.0f;
+    Bounds reach = emitterBounds(input, effect, 1.0f, 0.0f, dt);
+    bool inside = true;
+    for (int corner = 0; corner < 4; ++corner) {
+        glm::vec3 vel = glm::vec3(effect.velocityMin) + glm::vec3(corner & 1, corner >> 1, 0.0f) * glm::vec3(effect.velocityRange);
+        glm::vec3 pos(0.0f);
+        for (float t = 0.0f; t <= effect.spawn.x; t += dt) {
+            vel += input.acceleration * dt;
+            pos += vel * dt;
+            inside = inside && Bounds{ pos, pos }.overlaps(reach);
+        }
+    }
+    expect(inside, "a particle leaves emitterBounds()");
+    scene.assign(1, Collider::sphere(glm::vec3(reach.max.x + 0.11f, 0.0f, 0.0f), 0.1f));
+    cullColliders(scene, reach, active);
+    expect(active.empty(), "a sphere just outside emitterBounds() passes the broad phase");
+}
+
+// the analytic distance of makeTorus()'s torus, negative inside
+static float torusDistance(const glm::vec3& p, const glm::vec3& center, float majorRadius, float minorRadius)
+{
+    glm::vec3 q = p - center;
+    return glm::length(glm::vec2(glm::length(glm::vec2(q.x, q.y)) - majorRadius, q.z)) - minorRadius;
+}
+
+// a baked torus against its analytic distance, on the texels and between them, with
+// the sign wherever the distance is more than the polygon error, and a COLLIDER_SDF
+// collision moving a particle out of its tube
+static void testSdf()
+{
+    const glm::vec3 center(0.1f, -0.2f, 0.05f);
+    const float majorRadius = 0.3f, minorRadius = 0.1f;
+    TriangleMesh torus;
+    makeTorus(torus, center, majorRadius, minorRadius, 64, 32);
+    SdfVolume volume;
+    bakeSdf(torus, 48, 0.1f, volume);
+    const float h = volume.extent / volume.size;
+    // the mesh lies inside the torus by up to r (1 - cos(pi / 32)) + R (1 - cos(pi / 64))
+    const float polygonError = 0.002f;
+
+    size_t wrongDistances = 0, wrongSigns = 0;
+    for (int z = 0; z < volume.size; ++z) {
+        for (int y = 0; y < volume.size; ++y) {
+            for (int x = 0; x < volume.size; ++x) {
+                glm::vec3 p = volume.origin + (glm::vec3((float)x, (float)y, (float)z) + 0.5f) * h;
+                float exact = torusDistance(p, center, majorRadius, minorRadius);
+                float baked = volume.texels[(((size_t)z * volume.size + y) * volume.size + x) * 4 + 3];
+                wrongDistances += !(std::fabs(baked - exact) <= polygonError);
+                wrongSigns += std::fabs(exact) > polygonError && (baked < 0.0f) != (exact < 0.0f);
+            }
+        }
+    }
+    expect(wrongDistances == 0, std::to_string(wrongDistances) + " texels are off the analytic torus distance");
+    expect(wrongSigns == 0, std::to_string(wrongSigns) + " texels have the wrong sign");
+
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    // trilinear filtering rounds off the kinks of the distance (the core circle of the
+    // tube, the axis of the hole) by up to half a texel diagonal
+    size_t wrongSamples = 0, wrongSampleSigns = 0;
+    for (int i = 0; i < 10000; ++i) {
+        glm::vec3 p = volume.origin + glm::vec3(unit(rng), unit(rng), unit(rng)) * volume.extent;
+        float d;
+        glm::vec3 g;
+        if (!volume.sample(p, d, g))
+            continue;
+        float exact = torusDistance(p, center, majorRadius, minorRadius);
+        wrongSamples += !(std::fabs(d - exact) <= h);
+        wrongSampleSigns += std::fabs(exact) > h && (d < 0.0f) != (exact < 0.0f);
+    }
+    expect(wrongSamples == 0, std::to_string(wrongSamples) + " samples are off the analytic torus distance");
+    expect(wrongSampleSigns == 0, std::to_string(wrongSampleSigns) + " samples have the wrong sign");
+
+    std::vector<Collider> active(1, Collider::sdf(volume));
+    glm::vec3 pos = center + glm::vec3(majorRadius + 0.05f, 0.0f, 0.0f), vel(-1.0f, 0.0f, 0.0f);
+    bool killed = collideParticle(active, volume, pos, vel);
+    float after = torusDistance(pos, center, majorRadius, minorRadius);
+    expect(!killed && std::fabs(after) <= 0.25f * h && vel.x > 0.0f, "a particle in the tube isn't pushed out of the SDF collider");
+}
+
+// a tilted plane written into the depth image of the app's camera and of a perspective
+// one: particles just behind it land on it along their view ray and bounce off its
+// normal, particles in front of it, deeper than DEPTH_THICKNESS or off screen are left
+// alone
+static void testDepthCollision()
+{
+    const glm::vec3 planePoint(0.0f, 0.0f, 0.2f), normal = glm::normalize(glm::vec3(-0.3f, 0.2f, 1.0f));
+    const glm::vec3 tangent = glm::normalize(glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)));
+    const glm::mat4 cameras[] = {
+        sceneViewProjection(),
+        glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 10.0f) *
+            glm::lookAt(glm::vec3(0.3f, 0.2f, 2.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+    };
+    for (int camera = 0; camera < 2; ++camera) {
+        const std::string what = camera == 0 ? "scene camera" : "perspective camera";
+        DepthImage image;
+        image.resize(200, 150, cameras[camera]);
+        // where the view ray through window position (sx, sy) meets the plane
+        auto onPlane = [&](float sx, float sy, glm::vec3& direction) {
+            glm::vec4 nearPoint = image.inverseViewProjection * glm::vec4(sx, sy, -1.0f, 1.0f);
+            glm::vec4 farPoint = image.inverseViewProjection * glm::vec4(sx, sy, 1.0f, 1.0f);
+            glm::vec3 from = glm::vec3(nearPoint) / nearPoint.w, to = glm::vec3(farPoint) / farPoint.w;
+            direction = glm::normalize(to - from);
+            return from + direction * (glm::dot(planePoint - from, normal) / glm::dot(direction, normal));
+        };
+        for (int y = 0; y < image.height; ++y) {
+            for (int x = 0; x < image.width; ++x) {
+                glm::vec3 direction;
+                glm::vec3 p = onPlane((x + 0.5f) / image.width * 2.0f - 1.0f, (y + 0.5f) / image.height * 2.0f - 1.0f, direction);
+                glm::vec4 clip = image.viewProjection * glm::vec4(p, 1.0f);
+                image.depth[(size_t)y * image.width + x] = clip.z / clip.w * 0.5f + 0.5f;
+            }
+        }
+
+        // the normal comes from the depths of neighboring texels, which a perspective
+        // camera spends mostly near the camera: about 2% off at this distance
+        const float normalTolerance = camera == 0 ? 1e-3f : 0.05f;
+        std::mt19937 rng(10);
+        std::uniform_real_distribution<float> screen(-0.9f, 0.9f);
+        size_t wrongPositions = 0, wrongVelocities = 0, moved = 0;
+        const glm::vec3 vel0 = -normal + 0.5f * tangent;
+        const glm::vec3 bounced = 0.5f * tangent * (1.0f - DEPTH_FRICTION) + DEPTH_RESTITUTION * normal;
+        for (int i = 0; i < 1000; ++i) {
+            glm::vec3 direction;
+            glm::vec3 surface = onPlane(screen(rng), screen(rng), direction);
+            glm::vec3 pos = surface + 0.5f * DEPTH_THICKNESS * direction, vel = vel0;
+            collideDepth(image, pos, vel);
+            wrongPositions += !(glm::length(pos - surface) <= 0.01f);
+            wrongVelocities += !(glm::length(vel - bounced) <= normalTolerance);
+
+            for (float behind : { -0.5f, 1.5f }) {
+                glm::vec3 p = surface + behind * DEPTH_THICKNESS * direction, v = vel0;
+                collideDepth(image, p, v);
+                moved += p != surface + behind * DEPTH_THICKNESS * direction || v != vel0;
+            }
+        }
+        expect(wrongPositions == 0, what + ": " + std::to_string(wrongPositions) + " particles behind the plane don't land on it");
+        expect(wrongVelocities == 0, what + ": " + std::to_string(wrongVelocities) + " particles don't bounce off the plane's normal");
+        expect(moved == 0, what + ": " + std::to_string(moved) + " particles in front of the plane or deeper than its thickness move");
+
+        glm::vec3 direction;
+        glm::vec3 pos = onPlane(1.2f, 0.0f, direction) + 0.5f * DEPTH_THICKNESS * direction, vel = vel0;
+        const glm::vec3 offScreen = pos;
+        collideDepth(image, pos, vel);
+        expect(pos == offScreen && vel == vel0, what + ": a particle off screen collides");
+    }
+}
+
+// ------------------------------------------------------------------ fields
+
+// fieldForce() of emit.vert, one particle at a time
+static glm::vec3 referenceFieldForce(const std::vector<ForceField>& fields, float time, const glm::vec3& p, const glm::vec3& v,
+                                     const std::function<float(const glm::vec3&)>& gust)
+{
+    glm::vec3 force(0.0f);
+    for (size_t k = 0; k < fields.size() && k < (size_t)MAX_FORCE_FIELDS; ++k) {
+        const ForceField& f = fields[k];
+        glm::vec3 shape0(f.shape0), axis(f.shape1);
+        if (f.type == FORCE_ATTRACTOR) {
+            glm::vec3 r = shape0 - p;
+            float d = glm::length(r);
+            float w = std::max(1.0f - d / f.radius, 0.0f);
+            force += r * (d > 0.0f ? f.strength * w / d : 0.0f);
+        }
+        else if (f.type == FORCE_VORTEX) {
+            glm::vec3 q = p - shape0;
+            glm::vec3 r = q - glm::dot(q, axis) * axis;
+            float d = glm::length(r);
+            float w = std::max(1.0f - d / f.radius, 0.0f);
+            force += (f.strength * glm::cross(axis, r) - f.shape1.w * r) * (d > 0.0f ? w / d : 0.0f);
+        }
+        else if (f.type == FORCE_DRAG) {
+            force += -f.strength * v;
+        }
+        else {
+            float g = 1.0f + f.shape1.x * (gust(p * f.shape1.z + glm::vec3(time * f.shape1.y)) * 2.0f - 1.0f);
+            force += f.strength * (shape0 * g - v);
+        }
+    }
+    return force;
+}
+
+// accumulateForceFields() against the reference for chunks that fill the lanes and
+// ones that leave padding, with the demo fields and with more than MAX_FORCE_FIELDS
+// of every type. Then maxAcceleration() and maxFieldAcceleration() against their
+// formulas and against the forces of still particles.
+static void testFields()
+{
+    std::function<float(const glm::vec3&)> gust = [](const glm::vec3& c) {
+        return 0.5f + 0.5f * std::sin(c.x + 2.0f * c.y + 3.0f * c.z);
+    };
+    const float time = 1.25f;
+
+    std::mt19937 rng(40);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), span(0.0f, 2.0f);
+    std::vector<ForceField> demo, crowded;
+    demoForceFields(demo);
+    for (int i = 0; i < MAX_FORCE_FIELDS + 8; ++i) {
+        glm::vec3 point(unit(rng), unit(rng), unit(rng)), axis(unit(rng), unit(rng), unit(rng) + 2.0f);
+        switch (i % 4) {
+        case FORCE_ATTRACTOR: crowded.push_back(ForceField::attractor(point, 2.0f * unit(rng), 0.2f + span(rng))); break;
+        case FORCE_VORTEX: crowded.push_back(ForceField::vortex(point, axis, 2.0f * unit(rng), 0.2f + span(rng), span(rng))); break;
+        case FORCE_DRAG: crowded.push_back(ForceField::drag(span(rng))); break;
+        default: crowded.push_back(ForceField::wind(point, span(rng), unit(rng), span(rng), span(rng))); break;
+        }
+    }
+
+    for (const auto& scene : { std::make_pair("demo fields", &demo), std::make_pair("crowded fields", &crowded) }) {
+        const std::vector<ForceField>& fields = *scene.second;
+        for (int count : { 1, 3, 255, FORCE_FIELD_CHUNK }) {
+            const std::string what = std::string(scene.first) + ", " + std::to_string(count) + " particles";
+            ParticleStreams streams;
+            randomStreams(streams, count, (unsigned int)count);
+            // on the attractor and on the vortex axis, where the direction is undefined
+            streams.posX[0] = fields[0].shape0.x; streams.posY[0] = fields[0].shape0.y; streams.posZ[0] = fields[0].shape0.z;
+            if (count > 1) {
+                streams.posX[1] = fields[1].shape0.x; streams.posY[1] = fields[1].shape0.y; streams.posZ[1] = fields[1].shape0.z;
+            }
+            std::vector<float> fx(count), fy(count), fz(count);
+            accumulateForceFields(fields, time, streams.posX.data(), streams.posY.data(), streams.posZ.data(),
+                                  streams.velX.data(), streams.velY.data(), streams.velZ.data(), fx.data(), fy.data(), fz.data(), count, gust);
+            size_t wrong = 0;
+            for (int i = 0; i < count; ++i) {
+                glm::vec3 p(streams.posX[i], streams.posY[i], streams.posZ[i]), v(streams.velX[i], streams.velY[i], streams.velZ[i]);
+                wrong += !closeVec(glm::vec3(fx[i], fy[i], fz[i]), referenceFieldForce(fields, time, p, v, gust), 1e-5f);
+            }
+            expect(wrong == 0, what + ": " + std::to_string(wrong) + " forces differ from fieldForce()");
+        }
+    }
+
+    // the bounds of single fields, and the sum stops at MAX_FORCE_FIELDS like the kernels
+    expect(close(ForceField::attractor(glm::vec3(0.0f), -2.0f, 1.0f).maxAcceleration(), 2.0f, 1e-6f) &&
+           close(ForceField::vortex(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 3.0f, 1.0f, 4.0f).maxAcceleration(), 5.0f, 1e-6f) &&
+           close(ForceField::wind(glm::vec3(3.0f, 4.0f, 0.0f), 0.5f, -0.5f).maxAcceleration(), 3.75f, 1e-6f) &&
+           ForceField::drag(2.0f).maxAcceleration() == 0.0f, "maxAcceleration() doesn't match the bound of its field");
+    float capped = 0.0f;
+    for (int i = 0; i < MAX_FORCE_FIELDS; ++i)
+        capped += crowded[i].maxAcceleration();
+    expect(close(maxFieldAcceleration(crowded), capped, 1e-6f), "maxFieldAcceleration() counts fields past MAX_FORCE_FIELDS");
+
+    // still particles, drag adds nothing and every field stays within its bound
+    const int samples = FORCE_FIELD_CHUNK;
+    std::vector<float> x(samples), y(samples), z(samples), zero(samples, 0.0f), fx(samples), fy(samples), fz(samples);
+    for (int i = 0; i < samples; ++i) {
+        x[i] = 1.5f * unit(rng);
+        y[i] = 1.5f * unit(rng);
+        z[i] = 1.5f * unit(rng);
+    }
+    bool bounded = true;
+    for (size_t k = 0; k <= crowded.size(); ++k) {
+        std::vector<ForceField> fields = k < crowded.size() ? std::vector<ForceField>(1, crowded[k]) : crowded;
+        float bound = maxFieldAcceleration(fields) * (1.0f + 1e-5f);
+        accumulateForceFields(fields, time, x.data(), y.data(), z.data(), zero.data(), zero.data(), zero.data(),
+                              fx.data(), fy.data(), fz.data(), samples, gust);
+        for (int i = 0; i < samples; ++i)
+            bounded = bounded && glm::length(glm::vec3(fx[i], fy[i], fz[i])) <= bound;
+    }
+    expect(bounded, "a field pushes a still particle harder than maxFieldAcceleration()");
+}
+
+// ------------------------------------------------------------------ textures
+
+static AtlasImage gradientImage(int width, int height)
+{
+    AtlasImage image;
+    image.width = width;
+    image.height = height;
+    image.rgba.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t* texel = &image.rgba[((size_t)y * width + x) * 4];
+            texel[0] = (uint8_t)(x * 255 / std::max(1, width - 1));
+            texel[1] = (uint8_t)(y * 255 / std::max(1, height - 1));
+            texel[2] = (uint8_t)((x + y) * 127 / std::max(1, width + height - 2));
+            texel[3] = (uint8_t)(255 - x * 200 / std::max(1, width - 1));
+        }
+    }
+    return image;
+}
+
+// every image inside the atlas, on its own texels, and its padding the extruded edge
+static void testAtlas()
+{
+    std::mt19937 rng(6);
+    std::uniform_int_distribution<int> side(1, 40);
+    std::vector<AtlasImage> images(200);
+    for (size_t i = 0; i < images.size(); ++i) {
+        AtlasImage& image = images[i];
+        image.width = side(rng);
+        image.height = side(rng);
+        image.rgba.resize((size_t)image.width * image.height * 4);
+        for (size_t t = 0; t < image.rgba.size(); t += 4) {
+            image.rgba[t] = (uint8_t)i;
+            image.rgba[t + 1] = (uint8_t)(t / 4);
+            image.rgba[t + 2] = (uint8_t)(t / 1024);
+            image.rgba[t + 3] = 255;
+        }
+    }
+    const int padding = 2;
+    TextureAtlas atlas;
+    if (!expect(buildAtlas(images, 1024, padding, atlas), "200 sprites don't fit in 1024x1024"))
+        return;
+    expect(!buildAtlas(images, 64, padding, atlas), "200 sprites fit in 64x64");
+    buildAtlas(images, 1024, padding, atlas);
+
+    std::vector<int> owner((size_t)atlas.width * atlas.height, -1);
+    size_t overlaps = 0, wrongTexels = 0;
+    for (size_t i = 0; i < images.size(); ++i) {
+        const AtlasImage& image = images[i];
+        int x0 = (int)std::lround(atlas.rects[i].x * atlas.width), y0 = (int)std::lround(atlas.rects[i].y * atlas.height);
+        int x1 = (int)std::lround(atlas.rects[i].z * atlas.width), y1 = (int)std::lround(atlas.rects[i].w * atlas.height);
+        if (!expect(x1 - x0 == image.width && y1 - y0 == image.height && x0 >= padding && y0 >= padding &&
+                    x1 + padding <= atlas.width && y1 + padding <= atlas.height, "rect " + std::to_string(i) + " is misplaced"))
+            continue;
+        for (int y = y0 - padding; y < y1 + padding; ++y) {
+            for (int x = x0 - padding; x < x1 + padding; ++x) {
+                int& o = owner[(size_t)y * atlas.width + x];
+                overlaps += o >= 0;
+                o = (int)i;
+                int sx = std::min(image.width - 1, std::max(0, x - x0)), sy = std::min(image.height - 1, std::max(0, y - y0));
+                wrongTexels += std::memcmp(&atlas.rgba[((size_t)y * atlas.width + x) * 4],
+                                           &image.rgba[((size_t)sy * image.width + sx) * 4], 4) != 0;
+            }
+        }
+    }
+    expect(overlaps == 0, std::to_string(overlaps) + " atlas texels are shared by two sprites");
+    expect(wrongTexels == 0, std::to_string(wrongTexels) + " atlas texels aren't their sprite's");
+}
+
+// BC1 color and BC3 alpha blocks decoded the way the GPU does, rows of RGBA8
+static void decodeBlocks(const CompressedImage& image, size_t level, std::vector<uint8_t>& rgba)
+{
+    const int w = compressedLevelWidth(image, level), h = compressedLevelHeight(image, level);
+    const int blocksX = (w + 3) / 4;
+    const bool bc3 = image.format == COMPRESSED_RGBA_BC3;
+    const size_t blockBytes = compressedBlockBytes(image.format);
+    rgba.assign((size_t)w * h * 4, 255);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            const uint8_t* block = &image.levels[level][((size_t)(y / 4) * blocksX + x / 4) * blockBytes];
+            const int t = (y % 4) * 4 + x % 4;
+            uint8_t* out = &rgba[((size_t)y * w + x) * 4];
+            if (bc3) {
+                int a0 = block[0], a1 = block[1];
+                uint64_t bits = 0;
+                for (int b = 0; b < 6; ++b)
+                    bits |= (uint64_t)block[2 + b] << (8 * b);
+                int code = (int)(bits >> (3 * t)) & 7;
+                int alpha[8] = { a0, a1 };
+                for (int k = 2; k < 8; ++k) {
+                    if (a0 > a1)
+                        alpha[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+                    else
+                        alpha[k] = k < 6 ? ((6 - k) * a0 + (k - 1) * a1) / 5 : (k == 6 ? 0 : 255);
+                }
+                out[3] = (uint8_t)alpha[code];
+                block += 8;
+            }
+            uint16_t c0 = (uint16_t)(block[0] | block[1] << 8), c1 = (uint16_t)(block[2] | block[3] << 8);
+            glm::vec3 e0 = unpackRgb565(c0), e1 = unpackRgb565(c1), color;
+            int code = (block[4 + t / 4] >> (2 * (t % 4))) & 3;
+            if (c0 > c1 || bc3) {
+                glm::vec3 palette[4] = { e0, e1, (2.0f * e0 + e1) / 3.0f, (e0 + 2.0f * e1) / 3.0f };
+                color = palette[code];
+            }
+            else {
+                glm::vec3 palette[4] = { e0, e1, (e0 + e1) * 0.5f, glm::vec3(0.0f) };
+                color = palette[code];
+            }
+            for (int c = 0; c < 3; ++c)
+                out[c] = (uint8_t)std::lround(color[c]);
+        }
+    }
+}
+
+// a smooth gradient survives the encoder within a 565 step and a palette step, and
+// the DDS and KTX files hold the levels they were given
+static void testCompress()
+{
+    std::vector<AtlasImage> levels;
+    generateMipChain(gradientImage(66, 40), MIP_BOX, levels);
+    for (uint32_t format : { COMPRESSED_RGB_BC1, COMPRESSED_RGBA_BC3 }) {
+        const std::string name = format == COMPRESSED_RGB_BC1 ? "BC1" : "BC3";
+        CompressedImage compressed;
+        if (!expect(compressImage(levels, format, compressed), name + " compression failed"))
+            continue;
+        expect(compressed.levels.size() == levels.size(), name + " lost mip levels");
+        for (size_t level = 0; level < compressed.levels.size(); ++level) {
+            int w = compressedLevelWidth(compressed, level), h = compressedLevelHeight(compressed, level);
+            expect(w == levels[level].width && h == levels[level].height &&
+                   compressed.levels[level].size() == compressedLevelBytes(format, w, h), name + " level size is wrong");
+        }
+        std::vector<uint8_t> decoded;
+        decodeBlocks(compressed, 0, decoded);
+        int maxColor = 0, maxAlpha = 0;
+        for (size_t t = 0; t < decoded.size(); t += 4) {
+            for (int c = 0; c < 3; ++c)
+                maxColor = std::max(maxColor, std::abs(decoded[t + c] - levels[0].rgba[t + c]));
+            maxAlpha = std::max(maxAlpha, std::abs(decoded[t + 3] - levels[0].rgba[t + 3]));
+        }
+        expect(maxColor <= 16, name + " color error " + std::to_string(maxColor));
+        if (format == COMPRESSED_RGBA_BC3)
+            expect(maxAlpha <= 4, name + " alpha error " + std::to_string(maxAlpha));
+
+        for (const char* extension : { ".dds", ".ktx" }) {
+            std::filesystem::path path = std::filesystem::temp_directory_path() / ("particleTests" + std::string(extension));
+            CompressedImage loaded;
+            bool ok = saveCompressed(path, compressed) && loadCompressed(path, loaded);
+            expect(ok && loaded.format == format && loaded.width == compressed.width && loaded.height == compressed.height &&
+                   loaded.levels == compressed.levels, name + " doesn't round trip through " + extension);
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+    }
+}
+
+static void testMips()
+{
+    std::vector<AtlasImage> levels;
+    generateMipChain(gradientImage(20, 7), MIP_KAISER, levels);
+    bool halving = !levels.empty();
+    for (size_t i = 1; i < levels.size(); ++i)
+        halving = halving && levels[i].width == std::max(1, levels[i - 1].width / 2) && levels[i].height == std::max(1, levels[i - 1].height / 2);
+    expect(halving && levels.back().width == 1 && levels.back().height == 1, "the chain doesn't halve down to 1x1");
+
+    // a flat color stays that color on every level, whatever the filter
+    for (MipFilter filter : { MIP_BOX, MIP_KAISER }) {
+        AtlasImage flat;
+        flat.width = 16;
+        flat.height = 16;
+        flat.rgba.resize(16 * 16 * 4);
+        for (size_t t = 0; t < flat.rgba.size(); t += 4) {
+            const uint8_t color[4] = { 200, 90, 30, 255 };
+            std::copy(color, color + 4, &flat.rgba[t]);
+        }
+        generateMipChain(flat, filter, levels);
+        int maxError = 0;
+        for (const AtlasImage& level : levels) {
+            for (size_t t = 0; t < level.rgba.size(); ++t)
+                maxError = std::max(maxError, std::abs(level.rgba[t] - flat.rgba[t % 4]));
+        }
+        expect(maxError <= 1, std::string(filter == MIP_BOX ? "box" : "kaiser") + " filter changes a flat color by " + std::to_string(maxError));
+    }
+
+    // a cached chain is the chain built from the file
+    std::filesystem::path path = assets / "textures/smoke.tga";
+    std::vector<uint8_t> file;
+    if (!expect(readFileBytes(path, file), "can't read " + path.string()))
+        return;
+    std::filesystem::path cacheDir = std::filesystem::temp_directory_path() / "particleTests.mips";
+    std::error_code error;
+    std::filesystem::remove_all(cacheDir, error);
+    std::vector<AtlasImage> built, cached;
+    expect(mipChainCached(file, path, MIP_BOX, cacheDir, built), "building the chain of " + path.string() + " failed");
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mips", (unsigned long long)hashMipChain(file, MIP_BOX));
+    expect(std::filesystem::exists(cacheDir / name), "the chain wasn't cached");
+    expect(mipChainCached(file, path, MIP_BOX, cacheDir, cached), "loading the cached chain failed");
+    bool same = built.size() == cached.size();
+    for (size_t i = 0; same && i < built.size(); ++i)
+        same = built[i].width == cached[i].width && built[i].height == cached[i].height && built[i].rgba == cached[i].rgba;
+    expect(same, "the cached chain differs from the built one");
+    std::filesystem::remove_all(cacheDir, error);
+}
+
+// ------------------------------------------------------------------ effects
+
+static void testEffects()
+{
+    const char* json = R"([
+        // every key
+        { "name": "test", "texture": "textures/test.tga", "emissionRate": 0.25, "lifetime": 3.5,
+          "size": { "min": 10, "range": 5 }, "velocity": { "min": [1, 2, 3], "range": [4, 5, 6] },
+          "acceleration": [0, -2, 0.5], "turbulence": 0.75,
+          "curves": { "size": [[0, 0.5], [0.5, 2], [1, 0]], "speed": [[0, 1], [1, 0.25]],
+                      "color": [[0, [1, 0, 0, 1]], [1, [0, 0, 1, 0]]] },
+          "update": ["velX = velX * 0.5", "size = size + dt"],
+          "render": { "transparency": "sorted", "resolutionDivisor": 1 } },
+        // and none
+        { }
+    ])";
+    std::vector<EffectDesc> effects;
+    if (!expect(parseEffects(json, "particleTests", effects) && effects.size() == 2, "the effects don't parse"))
+        return;
+    const EffectDesc& e = effects[0];
+    expect(std::string(e.name) == "test" && std::string(e.texture) == "textures/test.tga", "name or texture is wrong");
+    expect(e.emissionRate == 0.25f && e.turbulence == 0.75f && e.acceleration == glm::vec3(0.0f, -2.0f, 0.5f), "rate or forces are wrong");
+    expect(e.block.spawn == glm::vec4(3.5f, 10.0f, 5.0f, 0.0f), "lifetime or size is wrong");
+    expect(glm::vec3(e.block.velocityMin) == glm::vec3(1.0f, 2.0f, 3.0f) && glm::vec3(e.block.velocityRange) == glm::vec3(4.0f, 5.0f, 6.0f),
+           "velocity is wrong");
+    expect(e.curves.size.count == 3 && e.curves.size.value[1] == 2.0f && e.curves.speed.value[1] == 0.25f &&
+           e.curves.color.count == 2 && e.curves.color.color[1] == glm::vec4(0.0f, 0.0f, 1.0f, 0.0f), "curves are wrong");
+    expect(std::string(e.update) == "velX = velX * 0.5; size = size + dt", "update is wrong");
+    expect(e.render.transparency == TRANSPARENCY_SORTED && e.render.resolutionDivisor == 1, "render is wrong");
+
+    EffectDesc defaults;
+    const EffectDesc& d = effects[1];
+    expect(std::string(d.name) == defaults.name && d.block.spawn == defaults.block.spawn && d.emissionRate == defaults.emissionRate &&
+           d.curves.size.value[1] == defaults.curves.size.value[1] && d.render.transparency == defaults.render.transparency,
+           "an empty effect isn't the default one");
+    expect(findEffect(effects, "test") == &effects[0] && !findEffect(effects, "none"), "findEffect is wrong");
+
+    // the compiled form is the same records
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "particleTests.effects";
+    std::vector<EffectDesc> loaded;
+    expect(saveCompiledEffects(path, effects) && loadCompiledEffects(path, loaded) && loaded.size() == effects.size() &&
+           std::memcmp(loaded.data(), effects.data(), effects.size() * sizeof(EffectDesc)) == 0, "compiled effects don't round trip");
+    std::error_code error;
+    std::filesystem::remove(path, error);
+
+    for (const char* bad : { "[ { \"name\": \"x\" ", "{ \"lifetime\": \"long\" }", "{ \"velocity\": { \"min\": [1, 2] } }" }) {
+        std::vector<EffectDesc> rejected;
+        expect(!parseEffects(bad, "particleTests", rejected), std::string("parses invalid effects: ") + bad);
+    }
+
+    std::vector<EffectDesc> demo;
+    expect(loadEffects(assets / "effects/demo.json", demo) && findEffect(demo, "smoke") && findEffect(demo, "sparks"),
+           "effects/demo.json doesn't load");
+}
+
+int main(int argc, char** argv) {
+    std::vector<TestCase> cases = {
+        { "vm", testVm },
+        { "curves", testCurves },
+        { "gradient", testGradient },
+        { "noise", testNoise },
+        { "sort", testSort },
+        { "grid", testGrid },
+        { "colliders", testColliders },
+        { "sdf", testSdf },
+        { "depth", testDepthCollision },
+        { "fields", testFields },
+        { "atlas", testAtlas },
+        { "compress", testCompress },
+        { "mips", testMips },
+        { "effects", testEffects },
+    };
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--assets" && i + 1 < argc) {
+            assets = argv[++i];
+        }
+        else if (std::any_of(cases.begin(), cases.end(), [&arg](const TestCase& c) { return c.name == arg; })) {
+            selected.push_back(arg);
+        }
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return -1;
+        }
+    }
+
+    for (const TestCase& c : cases) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), c.name) == selected.end())
+            continue;
+        size_t before = failures;
+        c.run();
+        std::cout << c.name << ": " << (failures == before ? "passed" : "FAILED") << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,565 @@
+#ifndef PARTICLE_VM_H
+#define PARTICLE_VM_H
+
+#include "particle.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Custom per-particle update logic for the CPU backend without a rebuild: a few
+// GLSL-like assignments, compiled to bytecode for a small register VM.
+//
+//   velX = velX - velX * 0.5 * dt + sin(time * 3.0 + posY) * dt;
+//   size = mix(size, 0.0, step(0.8, age) * dt)
+//
+// Statements run in order and see each other's assignments. They read and assign
+// the streams (posX, posY, posZ, velX, velY, velZ, size, lifetime, curtime) and read
+// time, dt and age (the normalized age). Functions: sin, cos, abs, sqrt, floor,
+// min, max, step, mix, clamp.
+//
+// A register is a whole chunk of particles, not one value: every instruction runs
+// across the chunk before the next is decoded, so the dispatch is paid once per
+// VM_CHUNK particles and the arithmetic runs on SIMD lanes (VmLanes, SSE2 like
+// FieldLanes of forceFields.h). The chunks are OpenMP parallel, each thread has its
+// own register file. Only the streams the program reads are loaded and only the
+// ones it assigns are written back, for the particles alive after the step's own
+// advection (not the ones spawned by it).
+//
+// The collider broad phase (emitterBounds() of colliders.h) only knows the effect's
+// emission and forces. A program that assigns a position, a velocity, the lifetime
+// or curtime can carry particles out of those bounds, so for it CpuSimulator hands
+// the whole scene, uncapped, to the narrow phase instead of the culled list, see
+// movesParticles().
+
+const int VM_CHUNK = 256;
+const int VM_MAX_REGISTERS = 64;
+
+enum VmOp : uint8_t {
+    VM_MOV, VM_ADD, VM_SUB, VM_MUL, VM_DIV, VM_MIN, VM_MAX, VM_STEP,
+    VM_NEG, VM_ABS, VM_SQRT, VM_FLOOR, VM_SIN, VM_COS,
+};
+
+struct VmInstruction {
+    uint8_t op, dst, a, b;
+};
+
+// the fixed registers, the constants and temporaries follow
+enum VmRegister {
+    VM_POS_X, VM_POS_Y, VM_POS_Z, VM_VEL_X, VM_VEL_Y, VM_VEL_Z, VM_SIZE, VM_LIFETIME, VM_CURTIME,
+    VM_STREAM_COUNT,
+    VM_AGE = VM_STREAM_COUNT, VM_TIME, VM_DT,
+    VM_FIRST_FREE,
+};
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+struct VmLanes {
+    static const int WIDTH = 4;
+    __m128 v;
+    VmLanes(__m128 value) : v(value) {}
+    VmLanes(float value) : v(_mm_set1_ps(value)) {}
+    static VmLanes load(const float* p) { return _mm_load_ps(p); }
+    void store(float* p) const { _mm_store_ps(p, v); }
+};
+inline VmLanes operator+(VmLanes a, VmLanes b) { return _mm_add_ps(a.v, b.v); }
+inline VmLanes operator-(VmLanes a, VmLanes b) { return _mm_sub_ps(a.v, b.v); }
+inline VmLanes operator*(VmLanes a, VmLanes b) { return _mm_mul_ps(a.v, b.v); }
+inline VmLanes operator/(VmLanes a, VmLanes b) { return _mm_div_ps(a.v, b.v); }
+inline VmLanes min(VmLanes a, VmLanes b) { return _mm_min_ps(a.v, b.v); }
+inline VmLanes max(VmLanes a, VmLanes b) { return _mm_max_ps(a.v, b.v); }
+inline VmLanes sqrt(VmLanes a) { return _mm_sqrt_ps(a.v); }
+inline VmLanes abs(VmLanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+// GLSL step(edge, x): 0 where x < edge, else 1
+inline VmLanes step(VmLanes edge, VmLanes x) { return _mm_andnot_ps(_mm_cmplt_ps(x.v, edge.v), _mm_set1_ps(1.0f)); }
+#else
+struct VmLanes {
+    static const int WIDTH = 1;
+    float v;
+    VmLanes(float value) : v(value) {}
+    static VmLanes load(const float* p) { return *p; }
+    void store(float* p) const { *p = v; }
+};
+inline VmLanes operator+(VmLanes a, VmLanes b) { return a.v + b.v; }
+inline VmLanes operator-(VmLanes a, VmLanes b) { return a.v - b.v; }
+inline VmLanes operator*(VmLanes a, VmLanes b) { return a.v * b.v; }
+inline VmLanes operator/(VmLanes a, VmLanes b) { return a.v / b.v; }
+inline VmLanes min(VmLanes a, VmLanes b) { return a.v < b.v ? a.v : b.v; }
+inline VmLanes max(VmLanes a, VmLanes b) { return a.v > b.v ? a.v : b.v; }
+inline VmLanes sqrt(VmLanes a) { return std::sqrt(a.v); }
+inline VmLanes abs(VmLanes a) { return std::fabs(a.v); }
+inline VmLanes step(VmLanes edge, VmLanes x) { return x.v < edge.v ? 0.0f : 1.0f; }
+#endif
+
+// one op on one value, folds the constant expressions at compile time
+inline float vmScalar(VmOp op, float a, float b)
+{
+    switch (op) {
+    case VM_MOV: return a;
+    case VM_ADD: return a + b;
+    case VM_SUB: return a - b;
+    case VM_MUL: return a * b;
+    case VM_DIV: return a / b;
+    case VM_MIN: return a < b ? a : b;
+    case VM_MAX: return a > b ? a : b;
+    case VM_STEP: return b < a ? 0.0f : 1.0f;
+    case VM_NEG: return -a;
+    case VM_ABS: return std::fabs(a);
+    case VM_SQRT: return std::sqrt(a);
+    case VM_FLOOR: return std::floor(a);
+    case VM_SIN: return std::sin(a);
+    case VM_COS: return std::cos(a);
+    }
+    return 0.0f;
+}
+
+class ParticleProgram
+{
+public:
+    // false with error() set when source doesn't compile, the program is then empty
+    bool compile(const std::string& source)
+    {
+        clear();
+        text = &source;
+        pos = 0;
+        maxTemp = VM_FIRST_FREE - 1;
+        bool ok = parseStatements();
+        text = nullptr;
+        if (ok)
+            packConstants();
+        if (!ok) {
+            std::string message = errorMessage;
+            clear();
+            errorMessage = message;
+        }
+        return ok;
+    }
+
+    // "column <n>: <what>"
+    const std::string& error() const { return errorMessage; }
+
+    bool empty() const { return code.empty(); }
+    size_t size() const { return code.size(); }
+
+    // bit s set for every stream s (VmRegister) the program assigns, the ones run() writes back
+    uint32_t writtenStreams() const { return writes; }
+
+    // whether particles can end up where the effect alone doesn't take them
+    bool movesParticles() const
+    {
+        const uint32_t motion = 1u << VM_POS_X | 1u << VM_POS_Y | 1u << VM_POS_Z | 1u << VM_VEL_X | 1u << VM_VEL_Y |
+                                1u << VM_VEL_Z | 1u << VM_LIFETIME | 1u << VM_CURTIME;
+        return (writes & motion) != 0;
+    }
+
+    void clear()
+    {
+        code.clear();
+        constants.clear();
+        reads = writes = 0;
+        registerCount = VM_FIRST_FREE;
+        errorMessage.clear();
+    }
+
+    // runs the statements over the live particles, chunk particles per dispatch
+    // (a multiple of VmLanes::WIDTH up to VM_CHUNK, smaller only to measure the dispatch)
+    void run(ParticleStreams& streams, float time, float dt, int chunk = VM_CHUNK) const
+    {
+        if (code.empty())
+            return;
+        chunk = std::max(VmLanes::WIDTH, std::min(chunk, VM_CHUNK) / VmLanes::WIDTH * VmLanes::WIDTH);
+        float* stream[VM_STREAM_COUNT] = {
+            streams.posX.data(), streams.posY.data(), streams.posZ.data(),
+            streams.velX.data(), streams.velY.data(), streams.velZ.data(),
+            streams.size.data(), streams.lifetime.data(), streams.curtime.data(),
+        };
+        const int64_t n = (int64_t)streams.count();
+        const int64_t chunkCount = (n + chunk - 1) / chunk;
+        #pragma omp parallel if (chunkCount > 1)
+        {
+            // the register file of this thread, 16 byte aligned for VmLanes::load;
+            // the constants are filled once
+            std::vector<float> file((size_t)registerCount * VM_CHUNK + 3);
+            float* base = file.data() + (16 - (uintptr_t)file.data() % 16) % 16 / sizeof(float);
+            auto reg = [&](int r) { return base + (size_t)r * VM_CHUNK; };
+            std::fill(reg(VM_TIME), reg(VM_TIME) + VM_CHUNK, time);
+            std::fill(reg(VM_DT), reg(VM_DT) + VM_CHUNK, dt);
+            for (const auto& c : constants)
+                std::fill(reg(c.first), reg(c.first) + VM_CHUNK, c.second);
+            bool alive[VM_CHUNK];
+
+            #pragma omp for schedule(static)
+            for (int64_t c = 0; c < chunkCount; ++c) {
+                const size_t first = (size_t)(c * chunk);
+                const int count = (int)std::min<int64_t>(chunk, n - (int64_t)first);
+                // curtime and lifetime decide the live particles and the age, always loaded;
+                // a stream only assigned is computed before it is read
+                for (int s = 0; s < VM_STREAM_COUNT; ++s) {
+                    if (!(reads & (1u << s)) && s != VM_LIFETIME && s != VM_CURTIME)
+                        continue;
+                    float* r = reg(s);
+                    std::copy(stream[s] + first, stream[s] + first + count, r);
+                    std::fill(r + count, r + chunk, 0.0f);
+                }
+                int liveCount = 0;
+                for (int i = 0; i < count; ++i) {
+                    float deltaTime = time - reg(VM_CURTIME)[i];
+                    alive[i] = deltaTime > 0.0f && deltaTime <= reg(VM_LIFETIME)[i];
+                    liveCount += alive[i];
+                }
+                if (liveCount == 0)
+                    continue;
+                if (reads & (1u << VM_AGE)) {
+                    typedef VmLanes L;
+                    float* age = reg(VM_AGE);
+                    for (int i = 0; i < chunk; i += L::WIDTH)
+                        ((L(time) - L::load(reg(VM_CURTIME) + i)) / L::load(reg(VM_LIFETIME) + i)).store(age + i);
+                }
+                for (const VmInstruction& in : code)
+                    execute(in, reg(in.dst), reg(in.a), reg(in.b), chunk);
+                for (int s = 0; s < VM_STREAM_COUNT; ++s) {
+                    if (!(writes & (1u << s)))
+                        continue;
+                    float* out = stream[s] + first;
+                    const float* r = reg(s);
+                    for (int i = 0; i < count; ++i)
+                        out[i] = alive[i] ? r[i] : out[i];
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<VmInstruction> code;
+    std::vector<std::pair<int, float>> constants;   // register, value
+    uint32_t reads = 0, writes = 0;                 // bits of the fixed registers
+    int registerCount = VM_FIRST_FREE;
+    std::string errorMessage;
+
+    // compiler state: the temporaries count up from VM_FIRST_FREE and are reused
+    // by every statement, the constants count down from the top until
+    // packConstants() moves them above the highest temporary
+    const std::string* text = nullptr;
+    size_t pos = 0;
+    int nextTemp = VM_FIRST_FREE;
+    int maxTemp = VM_FIRST_FREE - 1;
+
+    // one instruction across a chunk
+    static void execute(const VmInstruction& in, float* d, const float* a, const float* b, int chunk)
+    {
+        typedef VmLanes L;
+        switch (in.op) {
+        case VM_MOV: std::copy(a, a + chunk, d); break;
+        case VM_ADD: for (int i = 0; i < chunk; i += L::WIDTH) (L::load(a + i) + L::load(b + i)).store(d + i); break;
+        case VM_SUB: for (int i = 0; i < chunk; i += L::WIDTH) (L::load(a + i) - L::load(b + i)).store(d + i); break;
+        case VM_MUL: for (int i = 0; i < chunk; i += L::WIDTH) (L::load(a + i) * L::load(b + i)).store(d + i); break;
+        case VM_DIV: for (int i = 0; i < chunk; i += L::WIDTH) (L::load(a + i) / L::load(b + i)).store(d + i); break;
+        case VM_MIN: for (int i = 0; i < chunk; i += L::WIDTH) min(L::load(a + i), L::load(b + i)).store(d + i); break;
+        case VM_MAX: for (int i = 0; i < chunk; i += L::WIDTH) max(L::load(a + i), L::load(b + i)).store(d + i); break;
+        case VM_STEP: for (int i = 0; i < chunk; i += L::WIDTH) step(L::load(a + i), L::load(b + i)).store(d + i); break;
+        case VM_NEG: for (int i = 0; i < chunk; i += L::WIDTH) (L(0.0f) - L::load(a + i)).store(d + i); break;
+        case VM_ABS: for (int i = 0; i < chunk; i += L::WIDTH) abs(L::load(a + i)).store(d + i); break;
+        case VM_SQRT: for (int i = 0; i < chunk; i += L::WIDTH) sqrt(L::load(a + i)).store(d + i); break;
+        // no SSE2 forms, scalar over the chunk
+        case VM_FLOOR: for (int i = 0; i < chunk; ++i) d[i] = std::floor(a[i]); break;
+        case VM_SIN: for (int i = 0; i < chunk; ++i) d[i] = std::sin(a[i]); break;
+        case VM_COS: for (int i = 0; i < chunk; ++i) d[i] = std::cos(a[i]); break;
+        }
+    }
+
+    bool fail(const std::string& what)
+    {
+        if (errorMessage.empty())
+            errorMessage = "column " + std::to_string(pos + 1) + ": " + what;
+        return false;
+    }
+
+    void skipSpace()
+    {
+        while (pos < text->size() && std::isspace((unsigned char)(*text)[pos]))
+            ++pos;
+    }
+
+    bool accept(char c)
+    {
+        skipSpace();
+        if (pos < text->size() && (*text)[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    std::string identifier()
+    {
+        skipSpace();
+        size_t start = pos;
+        while (pos < text->size() && (std::isalnum((unsigned char)(*text)[pos]) || (*text)[pos] == '_'))
+            ++pos;
+        return text->substr(start, pos - start);
+    }
+
+    static int variable(const std::string& name)
+    {
+        static const char* names[VM_FIRST_FREE] = {
+            "posX", "posY", "posZ", "velX", "velY", "velZ", "size", "lifetime", "curtime", "age", "time", "dt",
+        };
+        for (int r = 0; r < VM_FIRST_FREE; ++r) {
+            if (name == names[r])
+                return r;
+        }
+        return -1;
+    }
+
+    bool isConstant(int r, float& value) const
+    {
+        for (const auto& c : constants) {
+            if (c.first == r) {
+                value = c.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int lowestConstant() const { return VM_MAX_REGISTERS - (int)constants.size(); }
+
+    bool isTemp(int r) const { return r >= VM_FIRST_FREE && r < lowestConstant(); }
+
+    // the register holding value, shared by equal constants
+    int constant(float value)
+    {
+        for (const auto& c : constants) {
+            if (c.second == value)
+                return c.first;
+        }
+        int r = lowestConstant() - 1;
+        if (r <= maxTemp) {
+            fail("too many constants and temporaries for " + std::to_string(VM_MAX_REGISTERS) + " registers");
+            return -1;
+        }
+        constants.emplace_back(r, value);
+        return r;
+    }
+
+    int temp()
+    {
+        if (nextTemp >= lowestConstant()) {
+            fail("too many constants and temporaries for " + std::to_string(VM_MAX_REGISTERS) + " registers");
+            return -1;
+        }
+        maxTemp = std::max(maxTemp, nextTemp);
+        return nextTemp++;
+    }
+
+    // op of a (and b) into a register, folded when the operands are constants. The
+    // operands are the newest temporaries (the expression is a tree) and die here,
+    // unless keep: the result takes the lowest of them.
+    int emit(VmOp op, int a, int b = 0, bool keep = false)
+    {
+        if (a < 0 || b < 0)
+            return -1;
+        float x, y = 0.0f;
+        bool unary = op >= VM_NEG;
+        if (isConstant(a, x) && (unary || isConstant(b, y)))
+            return constant(vmScalar(op, x, y));
+        if (!keep) {
+            if (isTemp(a))
+                nextTemp = std::min(nextTemp, a);
+            if (!unary && isTemp(b))
+                nextTemp = std::min(nextTemp, b);
+        }
+        int d = temp();
+        if (d < 0)
+            return -1;
+        code.push_back({ (uint8_t)op, (uint8_t)d, (uint8_t)a, (uint8_t)b });
+        return d;
+    }
+
+    // the constants right above the temporaries, the register file holds no gap
+    void packConstants()
+    {
+        const int shift = lowestConstant() - (maxTemp + 1);
+        const int lowest = lowestConstant();
+        auto move = [&](int r) { return r >= lowest ? r - shift : r; };
+        for (VmInstruction& in : code) {
+            in.dst = (uint8_t)move(in.dst);
+            in.a = (uint8_t)move(in.a);
+            if (in.op < VM_NEG)
+                in.b = (uint8_t)move(in.b);
+        }
+        for (auto& c : constants)
+            c.first = move(c.first);
+        registerCount = maxTemp + 1 + (int)constants.size();
+    }
+
+    bool parseStatements()
+    {
+        for (;;) {
+            skipSpace();
+            if (pos >= text->size())
+                return true;
+            if (!parseStatement())
+                return false;
+            if (!accept(';')) {
+                skipSpace();
+                if (pos < text->size())
+                    return fail("expected ';'");
+            }
+        }
+    }
+
+    bool parseStatement()
+    {
+        std::string name = identifier();
+        if (name.empty())
+            return fail("expected a stream name");
+        int target = variable(name);
+        if (target < 0 || target >= VM_STREAM_COUNT)
+            return fail("\"" + name + "\" is not a stream that can be assigned");
+        if (!accept('='))
+            return fail("expected '=' after " + name);
+        nextTemp = VM_FIRST_FREE;
+        size_t start = code.size();
+        int value = parseExpression();
+        if (value < 0)
+            return false;
+        // the last instruction can write the stream itself instead of a temporary
+        if (code.size() > start && code.back().dst == value && isTemp(value))
+            code.back().dst = (uint8_t)target;
+        else
+            code.push_back({ VM_MOV, (uint8_t)target, (uint8_t)value, 0 });
+        writes |= 1u << target;
+        return true;
+    }
+
+    int parseExpression()
+    {
+        int left = parseTerm();
+        while (left >= 0) {
+            if (accept('+'))
+                left = emit(VM_ADD, left, parseTerm());
+            else if (accept('-'))
+                left = emit(VM_SUB, left, parseTerm());
+            else
+                break;
+        }
+        return left;
+    }
+
+    int parseTerm()
+    {
+        int left = parseUnary();
+        while (left >= 0) {
+            if (accept('*'))
+                left = emit(VM_MUL, left, parseUnary());
+            else if (accept('/'))
+                left = emit(VM_DIV, left, parseUnary());
+            else
+                break;
+        }
+        return left;
+    }
+
+    int parseUnary()
+    {
+        if (accept('-'))
+            return emit(VM_NEG, parseUnary());
+        if (accept('+'))
+            return parseUnary();
+        return parsePrimary();
+    }
+
+    int parsePrimary()
+    {
+        skipSpace();
+        if (pos >= text->size()) {
+            fail("unexpected end");
+            return -1;
+        }
+        if (accept('(')) {
+            int r = parseExpression();
+            if (r >= 0 && !accept(')')) {
+                fail("expected ')'");
+                return -1;
+            }
+            return r;
+        }
+        char c = (*text)[pos];
+        if (std::isdigit((unsigned char)c) || c == '.') {
+            const char* begin = text->c_str() + pos;
+            char* end;
+            float value = std::strtof(begin, &end);
+            pos += (size_t)(end - begin);
+            int r = constant(value);
+            if (r < 0)
+                fail("too many constants");
+            return r;
+        }
+        std::string name = identifier();
+        if (name.empty()) {
+            fail(std::string("unexpected '") + c + "'");
+            return -1;
+        }
+        if (!accept('(')) {
+            int r = variable(name);
+            if (r < 0) {
+                fail("unknown name \"" + name + "\"");
+                return -1;
+            }
+            reads |= 1u << r;
+            return r;
+        }
+        std::vector<int> args;
+        if (!accept(')')) {
+            do {
+                int r = parseExpression();
+                if (r < 0)
+                    return -1;
+                args.push_back(r);
+            } while (accept(','));
+            if (!accept(')')) {
+                fail("expected ')' after the arguments of " + name);
+                return -1;
+            }
+        }
+        return call(name, args);
+    }
+
+    int call(const std::string& name, const std::vector<int>& args)
+    {
+        struct Function { const char* name; VmOp op; int arity; };
+        static const Function functions[] = {
+            { "sin", VM_SIN, 1 }, { "cos", VM_COS, 1 }, { "abs", VM_ABS, 1 }, { "sqrt", VM_SQRT, 1 },
+            { "floor", VM_FLOOR, 1 }, { "min", VM_MIN, 2 }, { "max", VM_MAX, 2 }, { "step", VM_STEP, 2 },
+        };
+        for (const Function& f : functions) {
+            if (name != f.name)
+                continue;
+            if ((int)args.size() != f.arity) {
+                fail(name + " takes " + std::to_string(f.arity) + (f.arity == 1 ? " argument" : " arguments"));
+                return -1;
+            }
+            return emit(f.op, args[0], f.arity == 2 ? args[1] : 0);
+        }
+        // the GLSL ones with 3 arguments, as sequences of the ops above
+        if (name == "mix" || name == "clamp") {
+            if (args.size() != 3) {
+                fail(name + " takes 3 arguments");
+                return -1;
+            }
+            // a is read twice, the difference mustn't take its register
+            if (name == "mix")
+                return emit(VM_ADD, args[0], emit(VM_MUL, emit(VM_SUB, args[1], args[0], true), args[2]));
+            return emit(VM_MIN, emit(VM_MAX, args[0], args[1]), args[2]);
+        }
+        fail("unknown function \"" + name + "\"");
+        return -1;
+    }
+};
+
+#endif
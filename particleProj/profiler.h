@@ -0,0 +1,228 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifndef PARTICLE_NO_GL
+#include <glad/glad.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Last WINDOW samples of one stage, in milliseconds.
+class RollingStats
+{
+public:
+    static const size_t WINDOW = 256;
+
+    void add(double ms)
+    {
+        if (samples.size() < WINDOW)
+            samples.push_back(ms);
+        else
+            samples[next] = ms;
+        next = (next + 1) % WINDOW;
+        ++total;
+    }
+
+    size_t count() const { return total; }
+
+    double min() const
+    {
+        return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+    }
+
+    double avg() const
+    {
+        double sum = 0.0;
+        for (double s : samples)
+            sum += s;
+        return samples.empty() ? 0.0 : sum / samples.size();
+    }
+
+    double p99() const
+    {
+        if (samples.empty())
+            return 0.0;
+        std::vector<double> sorted(samples);
+        size_t k = (sorted.size() * 99) / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+
+private:
+    std::vector<double> samples;
+    size_t next = 0;
+    size_t total = 0;
+};
+
+// Frame profiler. CPU time comes from ProfileScope, GPU time from GL_TIME_ELAPSED
+// queries that are read back a few frames later so the CPU never waits on the GPU.
+// Every sample also lands in a Chrome trace (chrome://tracing, Perfetto).
+class Profiler
+{
+public:
+    struct TraceEvent {
+        std::string name;
+        double startUs;
+        double durationUs;
+        int track; // 0 cpu, 1 gpu
+    };
+
+    // cap on the trace so long runs don't grow without bound
+    size_t maxTraceEvents = 1 << 20;
+
+    Profiler() : epoch(std::chrono::steady_clock::now()) {}
+
+    double nowUs() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void addCpuSample(const std::string& name, double startUs, double durationUs)
+    {
+        cpuStats[name].add(durationUs / 1000.0);
+        addTraceEvent(name, startUs, durationUs, 0);
+    }
+
+    void addGpuSample(const std::string& name, double startUs, double durationUs)
+    {
+        gpuStats[name].add(durationUs / 1000.0);
+        addTraceEvent(name, startUs, durationUs, 1);
+    }
+
+#ifndef PARTICLE_NO_GL
+    // Only one GL_TIME_ELAPSED query can be active at a time, so GPU stages must not nest.
+    void beginGpu(const std::string& name)
+    {
+        GpuQuery q;
+        q.name = name;
+        q.issuedUs = nowUs();
+        if (freeQueries.empty()) {
+            glGenQueries(1, &q.id);
+        }
+        else {
+            q.id = freeQueries.back();
+            freeQueries.pop_back();
+        }
+        glBeginQuery(GL_TIME_ELAPSED, q.id);
+        pending.push_back(q);
+    }
+
+    void endGpu()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    // Collects the queries whose results are available, call once per frame.
+    // Results are polled in issue order and the first unfinished one stops the scan.
+    void collectGpu()
+    {
+        size_t done = 0;
+        for (; done < pending.size(); ++done) {
+            GLint available = 0;
+            glGetQueryObjectiv(pending[done].id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(pending[done].id, GL_QUERY_RESULT, &ns);
+            addGpuSample(pending[done].name, pending[done].issuedUs, ns / 1000.0);
+            freeQueries.push_back(pending[done].id);
+        }
+        pending.erase(pending.begin(), pending.begin() + done);
+    }
+
+    void release()
+    {
+        for (const GpuQuery& q : pending)
+            freeQueries.push_back(q.id);
+        pending.clear();
+        if (!freeQueries.empty())
+            glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+        freeQueries.clear();
+    }
+#endif
+
+    void report(std::ostream& out) const
+    {
+        out << std::fixed << std::setprecision(3);
+        for (const auto& stage : cpuStats)
+            printStage(out, "cpu", stage.first, stage.second);
+        for (const auto& stage : gpuStats)
+            printStage(out, "gpu", stage.first, stage.second);
+        out << std::defaultfloat;
+    }
+
+    bool exportChromeTrace(const std::filesystem::path& path) const
+    {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "Failed to open trace for writing: " << path.string() << std::endl;
+            return false;
+        }
+        file << std::fixed << std::setprecision(3);
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+        for (const TraceEvent& e : trace) {
+            file << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.track
+                 << ",\"ts\":" << e.startUs << ",\"dur\":" << e.durationUs << "}";
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return (bool)file;
+    }
+
+private:
+    struct GpuQuery {
+        unsigned int id;
+        std::string name;
+        double issuedUs;
+    };
+
+    std::chrono::steady_clock::time_point epoch;
+    std::map<std::string, RollingStats> cpuStats;
+    std::map<std::string, RollingStats> gpuStats;
+    std::vector<TraceEvent> trace;
+    std::vector<GpuQuery> pending;
+    std::vector<unsigned int> freeQueries;
+
+    void addTraceEvent(const std::string& name, double startUs, double durationUs, int track)
+    {
+        if (trace.size() < maxTraceEvents)
+            trace.push_back({ name, startUs, durationUs, track });
+    }
+
+    static void printStage(std::ostream& out, const char* track, const std::string& name, const RollingStats& s)
+    {
+        out << track << " " << std::left << std::setw(10) << name << std::right
+            << " min " << s.min() << " ms  avg " << s.avg() << " ms  p99 " << s.p99()
+            << " ms  (" << s.count() << " samples)" << std::endl;
+    }
+};
+
+// RAII CPU scope, times its own lifetime into the profiler.
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler& profiler, const char* name)
+        : profiler(profiler), name(name), startUs(profiler.nowUs()) {}
+
+    ~ProfileScope()
+    {
+        profiler.addCpuSample(name, startUs, profiler.nowUs() - startUs);
+    }
+
+private:
+    Profiler& profiler;
+    const char* name;
+    double startUs;
+};
+
+#endif
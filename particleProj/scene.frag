@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 normal;
+
+out vec4 fragColor;
+
+void main()
+{
+    // a grey lit from the top left, over the white background
+    float light = max( dot( normalize( normal ), normalize( vec3( -0.4, 0.6, 1.0 ) ) ), 0.0 );
+    fragColor = vec4( vec3( 0.35 + 0.45 * light ), 1.0 );
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+uniform mat4 u_viewProjection;   // sceneViewProjection(), see depthCollision.h
+
+out vec3 normal;
+
+void main()
+{
+    normal = aNormal;
+    gl_Position = u_viewProjection * vec4( aPos, 1.0 );
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+#ifndef SCENE_DEPTH_H
+#define SCENE_DEPTH_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "depthCollision.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Renders the scene mesh into an offscreen color + depth target, the depth texture is
+// the s_sceneDepth of emit.vert's depthCollide() and the color is blitted behind the
+// particles, so they bounce off what is on screen.
+//
+// The depth is GL_DEPTH_COMPONENT32F at DEPTH_WIDTH x DEPTH_HEIGHT, the same image the
+// CPU backend gets from rasterizeDepth().
+class SceneDepthPass
+{
+public:
+    bool init(int w, int h)
+    {
+        release();
+        width = w;
+        height = h;
+
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        // emit.vert only texelFetches the depth
+        glGenTextures(1, &depthTex);
+        glBindTexture(GL_TEXTURE_2D, depthTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            std::cout << "Scene depth framebuffer is incomplete" << std::endl;
+            release();
+            return false;
+        }
+
+        shader.reset(new Shader("scene.vert", "scene.frag"));
+        return true;
+    }
+
+    // the mesh with smooth vertex normals, replaces the previous one
+    void upload(const TriangleMesh& mesh)
+    {
+        std::vector<glm::vec3> vertices(mesh.vertices.size() * 2, glm::vec3(0.0f));
+        for (size_t i = 0; i < mesh.vertices.size(); ++i)
+            vertices[i * 2] = mesh.vertices[i];
+        for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+            const uint32_t* tri = &mesh.indices[t * 3];
+            glm::vec3 a = mesh.vertices[tri[0]], b = mesh.vertices[tri[1]], c = mesh.vertices[tri[2]];
+            // area weighted
+            glm::vec3 n = glm::cross(b - a, c - a);
+            for (int k = 0; k < 3; ++k)
+                vertices[tri[k] * 2 + 1] += n;
+        }
+        for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+            float len = glm::length(vertices[i * 2 + 1]);
+            if (len > 0.0f)
+                vertices[i * 2 + 1] /= len;
+        }
+
+        if (!vao) {
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+            glGenBuffers(1, &ebo);
+        }
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3) * 2, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3) * 2, (void*)sizeof(glm::vec3));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        indexCount = (GLsizei)mesh.indices.size();
+    }
+
+    // clears to the app's white and draws the mesh with GL_LESS
+    void render(const glm::mat4& viewProjection)
+    {
+        if (!fbo)
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        glClearColor(1, 1, 1, 0);
+        glClearDepth(1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (indexCount > 0) {
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LESS);
+            shader->use();
+            shader->setMat4("u_viewProjection", viewProjection);
+            glBindVertexArray(vao);
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+            glBindVertexArray(0);
+            glUseProgram(0);
+            glDisable(GL_DEPTH_TEST);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // copies the scene color into the bound draw framebuffer, in place of its clear
+    void blit(int dstWidth, int dstHeight) const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, dstWidth, dstHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+    GLuint depthTexture() const { return depthTex; }
+
+    void release()
+    {
+        if (fbo)
+            glDeleteFramebuffers(1, &fbo);
+        GLuint textures[] = { colorTexture, depthTex };
+        for (GLuint t : textures) {
+            if (t)
+                glDeleteTextures(1, &t);
+        }
+        GLuint buffers[] = { vbo, ebo };
+        for (GLuint b : buffers) {
+            if (b)
+                glDeleteBuffers(1, &b);
+        }
+        if (vao)
+            glDeleteVertexArrays(1, &vao);
+        if (shader)
+            glDeleteProgram(shader->ID);
+        shader.reset();
+        fbo = colorTexture = depthTex = vao = vbo = ebo = 0;
+        indexCount = 0;
+    }
+
+private:
+    int width = 0, height = 0;
+    GLuint fbo = 0, colorTexture = 0, depthTex = 0;
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    GLsizei indexCount = 0;
+    std::unique_ptr<Shader> shader;
+};
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef SDF_BAKER_H
+#define SDF_BAKER_H
+
+#ifndef PARTICLE_NO_GL
+#include <glad/glad.h>
+#endif
+
+#include "volumeSampling.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Signed distance volumes baked from triangle meshes, for COLLIDER_SDF (colliders.h).
+//
+// The volume is a size^3 grid over a cube around the mesh. Every texel holds the
+// unit gradient of the distance and the signed distance (negative inside), so a
+// collision is one GL_LINEAR fetch. The bake:
+//   1. exact distances in a narrow band: every z slice tests the triangles near it
+//      against its texels around them,
+//   2. jump flooding spreads the closest triangle of the band to the whole volume,
+//      each texel takes the closest of the triangles of 26 texels step away, with
+//      the step halving from size / 2 to 1 (plus one more pass at 1),
+//   3. the sign comes from the parity of the crossings of a ray along x, so the
+//      mesh has to be closed,
+//   4. central differences of the distance give the gradient.
+// Every pass is OpenMP parallel over slices or rows. bakeSdfCached() keeps the
+// volumes on disk keyed by a hash of the mesh and the bake settings.
+
+struct TriangleMesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices; // 3 per triangle
+
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+struct SdfVolume {
+    int size = 0;
+    glm::vec3 origin = glm::vec3(0.0f); // world position of the corner of the cube
+    float extent = 1.0f;                // world size of the cube
+    std::vector<float> texels;          // RGBA: unit gradient, signed distance
+
+    // GL_LINEAR lookup at world position p, false outside the volume. Within [0, 1]
+    // the mirrored wrap of sampleTrilinear is the GL_CLAMP_TO_EDGE of the texture.
+    bool sample(const glm::vec3& p, float& distance, glm::vec3& gradient) const
+    {
+        glm::vec3 coord = (p - origin) / extent;
+        if (size == 0 || glm::any(glm::lessThan(coord, glm::vec3(0.0f))) || glm::any(glm::greaterThan(coord, glm::vec3(1.0f))))
+            return false;
+        float rgba[4];
+        sampleTrilinear<4>(size, false, coord, [this](int x, int y, int z, int c) {
+            return texels[(((size_t)z * size + y) * size + x) * 4 + c];
+        }, rgba);
+        gradient = glm::vec3(rgba[0], rgba[1], rgba[2]);
+        distance = rgba[3];
+        return true;
+    }
+};
+
+// closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+inline glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// torus around the z axis, the mesh of the demo scene
+inline void makeTorus(TriangleMesh& mesh, const glm::vec3& center, float majorRadius, float minorRadius, int rings, int sides)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    const float TWO_PI = 6.28318531f;
+    for (int i = 0; i < rings; ++i) {
+        float u = TWO_PI * i / rings;
+        for (int j = 0; j < sides; ++j) {
+            float v = TWO_PI * j / sides;
+            float r = majorRadius + minorRadius * std::cos(v);
+            mesh.vertices.push_back(center + glm::vec3(r * std::cos(u), r * std::sin(u), minorRadius * std::sin(v)));
+        }
+    }
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < sides; ++j) {
+            uint32_t a = i * sides + j, b = ((i + 1) % rings) * sides + j;
+            uint32_t c = ((i + 1) % rings) * sides + (j + 1) % sides, d = i * sides + (j + 1) % sides;
+            mesh.indices.insert(mesh.indices.end(), { a, b, c, a, c, d });
+        }
+    }
+}
+
+// v and f records of a Wavefront OBJ, faces are fanned into triangles
+inline bool loadObj(const std::filesystem::path& path, TriangleMesh& mesh)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open mesh: " << path.string() << std::endl;
+        return false;
+    }
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream in(line);
+        std::string tag;
+        in >> tag;
+        if (tag == "v") {
+            glm::vec3 v;
+            in >> v.x >> v.y >> v.z;
+            mesh.vertices.push_back(v);
+        }
+        else if (tag == "f") {
+            // "i", "i/t", "i//n" or "i/t/n", negative indices count from the end
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (in >> corner) {
+                long index = std::strtol(corner.c_str(), nullptr, 10);
+                index = index < 0 ? (long)mesh.vertices.size() + index : index - 1;
+                if (index < 0 || index >= (long)mesh.vertices.size()) {
+                    std::cerr << "Bad face index in mesh: " << path.string() << std::endl;
+                    return false;
+                }
+                face.push_back((uint32_t)index);
+            }
+            for (size_t k = 2; k < face.size(); ++k)
+                mesh.indices.insert(mesh.indices.end(), { face[0], face[k - 1], face[k] });
+        }
+    }
+    if (mesh.indices.empty()) {
+        std::cerr << "No triangles in mesh: " << path.string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline void bakeSdf(const TriangleMesh& mesh, int size, float padding, SdfVolume& volume)
+{
+    const size_t triangles = mesh.triangleCount();
+    const int64_t texels = (int64_t)size * size * size;
+    auto vertex = [&mesh](size_t t, int k) { return mesh.vertices[mesh.indices[t * 3 + k]]; };
+
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (const glm::vec3& v : mesh.vertices) {
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+    volume.size = size;
+    volume.extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z)) + 2.0f * padding;
+    volume.origin = (lo + hi) * 0.5f - glm::vec3(volume.extent * 0.5f);
+    const float h = volume.extent / size;
+    auto center = [&volume, h](int x, int y, int z) { return volume.origin + (glm::vec3((float)x, (float)y, (float)z) + 0.5f) * h; };
+    auto texelOf = [&volume, h, size](float v, int axis) {
+        return std::min(size - 1, std::max(0, (int)std::floor((v - volume.origin[axis]) / h)));
+    };
+
+    // 1. narrow band, the texels within a texel of the bounds of every triangle
+    std::vector<float> distance((size_t)texels, INFINITY);
+    std::vector<int32_t> closest((size_t)texels, -1);
+    std::vector<std::vector<uint32_t>> sliceTriangles(size);
+    for (size_t t = 0; t < triangles; ++t) {
+        float z0 = std::min(vertex(t, 0).z, std::min(vertex(t, 1).z, vertex(t, 2).z));
+        float z1 = std::max(vertex(t, 0).z, std::max(vertex(t, 1).z, vertex(t, 2).z));
+        for (int z = texelOf(z0 - h, 2); z <= texelOf(z1 + h, 2); ++z)
+            sliceTriangles[z].push_back((uint32_t)t);
+    }
+    #pragma omp parallel for schedule(dynamic)
+    for (int z = 0; z < size; ++z) {
+        for (uint32_t t : sliceTriangles[z]) {
+            glm::vec3 a = vertex(t, 0), b = vertex(t, 1), c = vertex(t, 2);
+            glm::vec3 tlo = glm::min(a, glm::min(b, c)) - h, thi = glm::max(a, glm::max(b, c)) + h;
+            for (int y = texelOf(tlo.y, 1); y <= texelOf(thi.y, 1); ++y) {
+                for (int x = texelOf(tlo.x, 0); x <= texelOf(thi.x, 0); ++x) {
+                    glm::vec3 p = center(x, y, z);
+                    float d = glm::length(p - closestPointOnTriangle(p, a, b, c));
+                    size_t i = ((size_t)z * size + y) * size + x;
+                    if (d < distance[i]) {
+                        distance[i] = d;
+                        closest[i] = (int32_t)t;
+                    }
+                }
+            }
+        }
+    }
+
+    // 2. jump flooding of the closest triangle
+    std::vector<float> nextDistance((size_t)texels);
+    std::vector<int32_t> nextClosest((size_t)texels);
+    std::vector<int> steps;
+    for (int step = std::max(1, size / 2); step >= 1; step /= 2)
+        steps.push_back(step);
+    steps.push_back(1);
+    for (int step : steps) {
+        #pragma omp parallel for schedule(static)
+        for (int z = 0; z < size; ++z) {
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    size_t i = ((size_t)z * size + y) * size + x;
+                    float best = distance[i];
+                    int32_t bestTriangle = closest[i];
+                    glm::vec3 p = center(x, y, z);
+                    for (int dz = -step; dz <= step; dz += step) {
+                        for (int dy = -step; dy <= step; dy += step) {
+                            for (int dx = -step; dx <= step; dx += step) {
+                                int nx = x + dx, ny = y + dy, nz = z + dz;
+                                if (nx < 0 || ny < 0 || nz < 0 || nx >= size || ny >= size || nz >= size)
+                                    continue;
+                                int32_t t = closest[((size_t)nz * size + ny) * size + nx];
+                                if (t < 0 || t == bestTriangle)
+                                    continue;
+                                float d = glm::length(p - closestPointOnTriangle(p, vertex(t, 0), vertex(t, 1), vertex(t, 2)));
+                                if (d < best) {
+                                    best = d;
+                                    bestTriangle = t;
+                                }
+                            }
+                        }
+                    }
+                    nextDistance[i] = best;
+                    nextClosest[i] = bestTriangle;
+                }
+            }
+        }
+        distance.swap(nextDistance);
+        closest.swap(nextClosest);
+    }
+
+    // 3. sign, crossings of a ray along x through every row of texel centers. The ray
+    // is nudged off the texel centers so it doesn't run through mesh vertices laid
+    // out on the same grid.
+    std::vector<std::vector<uint32_t>> rowTriangles((size_t)size * size);
+    for (size_t t = 0; t < triangles; ++t) {
+        glm::vec3 a = vertex(t, 0), b = vertex(t, 1), c = vertex(t, 2);
+        glm::vec3 tlo = glm::min(a, glm::min(b, c)), thi = glm::max(a, glm::max(b, c));
+        for (int z = texelOf(tlo.z, 2); z <= texelOf(thi.z, 2); ++z)
+            for (int y = texelOf(tlo.y, 1); y <= texelOf(thi.y, 1); ++y)
+                rowTriangles[(size_t)z * size + y].push_back((uint32_t)t);
+    }
+    #pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < size * size; ++row) {
+        int y = row % size, z = row / size;
+        glm::vec3 p = center(0, y, z) + glm::vec3(0.0f, 1.3e-4f, 0.7e-4f) * h;
+        std::vector<float> crossings;
+        for (uint32_t t : rowTriangles[row]) {
+            glm::vec3 a = vertex(t, 0), b = vertex(t, 1), c = vertex(t, 2);
+            // barycentrics of (p.y, p.z) in the yz projection of the triangle
+            float area = (b.y - a.y) * (c.z - a.z) - (c.y - a.y) * (b.z - a.z);
+            if (area == 0.0f)
+                continue;
+            float wa = ((b.y - p.y) * (c.z - p.z) - (c.y - p.y) * (b.z - p.z)) / area;
+            float wb = ((c.y - p.y) * (a.z - p.z) - (a.y - p.y) * (c.z - p.z)) / area;
+            float wc = 1.0f - wa - wb;
+            if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+                continue;
+            crossings.push_back(wa * a.x + wb * b.x + wc * c.x);
+        }
+        std::sort(crossings.begin(), crossings.end());
+        size_t passed = 0;
+        for (int x = 0; x < size; ++x) {
+            float px = center(x, y, z).x;
+            while (passed < crossings.size() && crossings[passed] < px)
+                ++passed;
+            if (passed % 2 == 1)
+                distance[(size_t)row * size + x] *= -1.0f;
+        }
+    }
+
+    // 4. gradient
+    volume.texels.resize((size_t)texels * 4);
+    #pragma omp parallel for schedule(static)
+    for (int z = 0; z < size; ++z) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                auto at = [&distance, size](int x, int y, int z) {
+                    x = std::min(size - 1, std::max(0, x));
+                    y = std::min(size - 1, std::max(0, y));
+                    z = std::min(size - 1, std::max(0, z));
+                    return distance[((size_t)z * size + y) * size + x];
+                };
+                glm::vec3 g(at(x + 1, y, z) - at(x - 1, y, z), at(x, y + 1, z) - at(x, y - 1, z), at(x, y, z + 1) - at(x, y, z - 1));
+                float len = glm::length(g);
+                g = len > 0.0f ? g / len : glm::vec3(0.0f);
+                size_t i = ((size_t)z * size + y) * size + x;
+                float* out = &volume.texels[i * 4];
+                out[0] = g.x;
+                out[1] = g.y;
+                out[2] = g.z;
+                out[3] = distance[i];
+            }
+        }
+    }
+}
+
+// FNV-1a of the mesh and the bake settings, the cache key of bakeSdfCached()
+inline uint64_t hashSdfBake(const TriangleMesh& mesh, int size, float padding)
+{
+    const uint32_t CACHE_VERSION = 1;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const void* data, size_t bytes) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; ++i) {
+            hash ^= p[i];
+            hash *= 0x100000001b3ull;
+        }
+    };
+    add(&CACHE_VERSION, sizeof(CACHE_VERSION));
+    add(&size, sizeof(size));
+    add(&padding, sizeof(padding));
+    add(mesh.vertices.data(), mesh.vertices.size() * sizeof(glm::vec3));
+    add(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    return hash;
+}
+
+// bakeSdf(), or the volume of an earlier bake of the same mesh and settings saved in
+// cacheDir. A cache that can't be written only costs the next run a bake, an empty
+// cacheDir always bakes.
+inline void bakeSdfCached(const TriangleMesh& mesh, int size, float padding, const std::filesystem::path& cacheDir, SdfVolume& volume)
+{
+    if (cacheDir.empty()) {
+        bakeSdf(mesh, size, padding, volume);
+        return;
+    }
+
+    const uint32_t MAGIC = 0x46445350; // "PSDF"
+    const uint64_t key = hashSdfBake(mesh, size, padding);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.sdf", (unsigned long long)key);
+    const std::filesystem::path path = cacheDir / name;
+
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        uint32_t magic = 0;
+        uint64_t storedKey = 0;
+        in.read((char*)&magic, sizeof(magic));
+        in.read((char*)&storedKey, sizeof(storedKey));
+        in.read((char*)&volume.size, sizeof(volume.size));
+        in.read((char*)&volume.origin, sizeof(volume.origin));
+        in.read((char*)&volume.extent, sizeof(volume.extent));
+        if (in && magic == MAGIC && storedKey == key && volume.size == size) {
+            volume.texels.resize((size_t)size * size * size * 4);
+            in.read((char*)volume.texels.data(), volume.texels.size() * sizeof(float));
+            if (in)
+                return;
+        }
+        std::cerr << "Ignoring bad SDF cache file: " << path.string() << std::endl;
+    }
+
+    bakeSdf(mesh, size, padding, volume);
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)&MAGIC, sizeof(MAGIC));
+    out.write((const char*)&key, sizeof(key));
+    out.write((const char*)&volume.size, sizeof(volume.size));
+    out.write((const char*)&volume.origin, sizeof(volume.origin));
+    out.write((const char*)&volume.extent, sizeof(volume.extent));
+    out.write((const char*)volume.texels.data(), volume.texels.size() * sizeof(float));
+    if (!out)
+        std::cerr << "Failed to write SDF cache file: " << path.string() << std::endl;
+}
+
+#ifndef PARTICLE_NO_GL
+// GL_RGBA32F so the GPU filters the same values the CPU backend samples
+inline unsigned int Create3DSdfTexture(const SdfVolume& volume)
+{
+    GLuint textureId;
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_3D, textureId);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, volume.size, volume.size, volume.size, 0,
+                 GL_RGBA, GL_FLOAT, volume.texels.data());
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return textureId;
+}
+#endif
+
+#endif
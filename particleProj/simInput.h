@@ -0,0 +1,192 @@
+#ifndef SIM_INPUT_H
+#define SIM_INPUT_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Every per-frame parameter the simulation depends on. Replaying the same
+// sequence of FrameInputs reproduces the same particle buffers.
+struct FrameInput {
+    float time;              // u_time
+    float emissionRate;      // u_emissionRate
+    glm::vec3 acceleration;  // u_acceleration
+    unsigned int spawnBurst; // dead particles with index < spawnBurst are forced to emit
+    unsigned int seed;       // offsets the noise lookups of randomValue()
+    float turbulence;        // u_turbulence, strength of the curl noise force
+    float separation;        // u_separation, strength of the neighbor repulsion, 0 turns the grid off
+    float neighborRadius;    // u_neighborRadius, range of the repulsion and cell size of the grid
+    bool collisions;         // collide with the scene colliders (colliders.h)
+    bool depthCollision;     // u_depthCollision, collide with the scene depth buffer (depthCollision.h)
+    bool forceFields;        // apply the scene's force fields (forceFields.h)
+
+    FrameInput() : time(0.0f), emissionRate(0.3f), acceleration(0.0f, -1.0f, 0.0f), spawnBurst(0), seed(0), turbulence(0.5f),
+                   separation(0.0f), neighborRadius(0.05f), collisions(false),
+                   depthCollision(false), forceFields(false) {}
+};
+
+// Input journal, records the FrameInput of every frame and plays it back.
+// Floats are stored as their raw bits so a replay is bit-exact.
+class InputJournal
+{
+public:
+    std::vector<FrameInput> frames;
+    std::string effect; // name of the effect (effects/demo.json) the frames ran, empty for the built-in one
+
+    void record(const FrameInput& input)
+    {
+        frames.push_back(input);
+    }
+
+    // returns false once the journal is exhausted
+    bool replay(size_t frame, FrameInput& input) const
+    {
+        if (frame >= frames.size())
+            return false;
+        input = frames[frame];
+        return true;
+    }
+
+    bool save(const std::filesystem::path& path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Failed to open journal for writing: " << path.string() << std::endl;
+            return false;
+        }
+        writeU32(file, MAGIC);
+        writeU32(file, VERSION);
+        writeU32(file, (uint32_t)effect.size());
+        file.write(effect.data(), (std::streamsize)effect.size());
+        writeU32(file, (uint32_t)frames.size());
+        for (const FrameInput& in : frames) {
+            writeF32(file, in.time);
+            writeF32(file, in.emissionRate);
+            writeF32(file, in.acceleration.x);
+            writeF32(file, in.acceleration.y);
+            writeF32(file, in.acceleration.z);
+            writeU32(file, in.spawnBurst);
+            writeU32(file, in.seed);
+            writeF32(file, in.turbulence);
+            writeF32(file, in.separation);
+            writeF32(file, in.neighborRadius);
+            writeU32(file, in.collisions ? 1 : 0);
+            writeU32(file, in.depthCollision ? 1 : 0);
+            writeU32(file, in.forceFields ? 1 : 0);
+        }
+        return (bool)file;
+    }
+
+    bool load(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Failed to open journal: " << path.string() << std::endl;
+            return false;
+        }
+        uint32_t magic = readU32(file);
+        uint32_t version = readU32(file);
+        if (magic != MAGIC || version < 1 || version > VERSION) {
+            std::cerr << "Not a particle input journal (or unsupported version): " << path.string() << std::endl;
+            return false;
+        }
+        // version 6 and older journals predate the effect files
+        effect.clear();
+        if (version >= 7) {
+            uint32_t length = readU32(file);
+            if (!file || length > 256) {
+                std::cerr << "Bad journal header: " << path.string() << std::endl;
+                return false;
+            }
+            effect.resize(length);
+            file.read(&effect[0], (std::streamsize)length);
+        }
+        uint32_t count = readU32(file);
+        // the count must fit in what's left of the file before anything is allocated
+        std::streamoff start = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff remaining = file.tellg() - start;
+        file.seekg(start);
+        if (!file || start < 0 || (uint64_t)remaining < (uint64_t)count * frameBytes(version)) {
+            std::cerr << "Truncated journal: " << path.string() << std::endl;
+            frames.clear();
+            return false;
+        }
+        frames.resize(count);
+        for (FrameInput& in : frames) {
+            in.time = readF32(file);
+            in.emissionRate = readF32(file);
+            in.acceleration.x = readF32(file);
+            in.acceleration.y = readF32(file);
+            in.acceleration.z = readF32(file);
+            in.spawnBurst = readU32(file);
+            in.seed = readU32(file);
+            // version 1 journals predate the turbulence force
+            in.turbulence = version >= 2 ? readF32(file) : 0.0f;
+            // and version 2 ones the neighbor force
+            in.separation = version >= 3 ? readF32(file) : 0.0f;
+            in.neighborRadius = version >= 3 ? readF32(file) : 0.05f;
+            // and version 3 ones the colliders
+            in.collisions = version >= 4 ? readU32(file) != 0 : false;
+            // and version 4 ones the depth collision
+            in.depthCollision = version >= 5 ? readU32(file) != 0 : false;
+            // and version 5 ones the force fields
+            in.forceFields = version >= 6 ? readU32(file) != 0 : false;
+        }
+        if (!file) {
+            std::cerr << "Truncated journal: " << path.string() << std::endl;
+            frames.clear();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x4A495350; // "PSIJ"
+    static const uint32_t VERSION = 7;
+
+    // bytes of one frame record in a journal of the given version
+    static uint64_t frameBytes(uint32_t version)
+    {
+        uint64_t fields = 7;                // time, rate, acceleration, burst, seed
+        fields += version >= 2 ? 1 : 0;     // turbulence
+        fields += version >= 3 ? 2 : 0;     // separation, neighbor radius
+        fields += version >= 4 ? 1 : 0;     // collisions
+        fields += version >= 5 ? 1 : 0;     // depth collision
+        fields += version >= 6 ? 1 : 0;     // force fields
+        return fields * 4;
+    }
+
+    static void writeU32(std::ostream& out, uint32_t v)
+    {
+        unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+        out.write((const char*)b, 4);
+    }
+    static void writeF32(std::ostream& out, float f)
+    {
+        uint32_t v;
+        std::memcpy(&v, &f, sizeof(v));
+        writeU32(out, v);
+    }
+    static uint32_t readU32(std::istream& in)
+    {
+        unsigned char b[4] = { 0, 0, 0, 0 };
+        in.read((char*)b, 4);
+        return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+    static float readF32(std::istream& in)
+    {
+        uint32_t v = readU32(in);
+        float f;
+        std::memcpy(&f, &v, sizeof(f));
+        return f;
+    }
+};
+
+#endif
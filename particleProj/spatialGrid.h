@@ -0,0 +1,229 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include "particle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Uniform grid over the particle positions for neighbor queries, rebuilt every frame.
+//
+// Cells are hashed into a table of buckets and the particles are counting sorted by
+// bucket, so the particles of a cell are contiguous and their positions are copied
+// next to each other in sorted order. Only the (y, z) row of a cell is hashed, cells
+// along x take consecutive buckets, so a query scans one range per row instead of
+// one per cell. The hash only uses 32 bit integer math so the GLSL side (gpuGrid.h,
+// emit.vert) computes the same buckets. The sort is stable, so the order (and with it the order neighbors
+// are visited in) doesn't depend on the thread count.
+//
+//   grid.build(streams, radius);
+//   for (uint32_t i : grid.order())   // cell order, neighbors are close in memory
+//       grid.forEachNeighbor(i, radius, [&](uint32_t j, float distanceSquared) { ... });
+class SpatialGrid
+{
+public:
+    void build(const ParticleStreams& streams, float cellSize)
+    {
+        build(streams.posX.data(), streams.posY.data(), streams.posZ.data(), streams.count(), cellSize);
+    }
+
+    void build(const float* x, const float* y, const float* z, size_t count, float cellSize)
+    {
+        const int64_t n = (int64_t)count;
+        cell = cellSize;
+        invCell = 1.0f / cellSize;
+        size_t buckets = 1;
+        bits = 0;
+        while (buckets < count) {
+            buckets <<= 1;
+            ++bits;
+        }
+        mask = (uint32_t)buckets - 1;
+
+        keys.resize(count);
+        bucketOf.resize(count);
+        #pragma omp parallel for schedule(static)
+        for (int64_t i = 0; i < n; ++i) {
+            int32_t cx = cellCoord(x[i]), cy = cellCoord(y[i]), cz = cellCoord(z[i]);
+            keys[i] = cellKey(cx, cy, cz);
+            bucketOf[i] = bucket(cx, cy, cz);
+        }
+
+        // counting sort: every chunk counts its own histogram, the prefix sum runs
+        // bucket by bucket over the chunks and every chunk scatters in index order
+        int chunks = 1;
+#ifdef _OPENMP
+        chunks = std::min(omp_get_max_threads(), MAX_CHUNKS);
+#endif
+        chunks = (int)std::max<int64_t>(1, std::min<int64_t>(chunks, n / 4096));
+        histogram.assign((size_t)chunks * buckets, 0);
+        #pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < chunks; ++c) {
+            uint32_t* counts = &histogram[(size_t)c * buckets];
+            for (int64_t i = n * c / chunks; i < n * (c + 1) / chunks; ++i)
+                counts[bucketOf[i]]++;
+        }
+
+        cellStart.resize(buckets + 1);
+        uint32_t offset = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            cellStart[b] = offset;
+            for (int c = 0; c < chunks; ++c) {
+                uint32_t& h = histogram[(size_t)c * buckets + b];
+                uint32_t cnt = h;
+                h = offset;
+                offset += cnt;
+            }
+        }
+        cellStart[buckets] = offset;
+
+        sorted.resize(count);
+        sortedX.resize(count);
+        sortedY.resize(count);
+        sortedZ.resize(count);
+        sortedKeys.resize(count);
+        rank.resize(count);
+        #pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < chunks; ++c) {
+            uint32_t* next = &histogram[(size_t)c * buckets];
+            for (int64_t i = n * c / chunks; i < n * (c + 1) / chunks; ++i) {
+                uint32_t k = next[bucketOf[i]]++;
+                sorted[k] = (uint32_t)i;
+                sortedX[k] = x[i];
+                sortedY[k] = y[i];
+                sortedZ[k] = z[i];
+                sortedKeys[k] = keys[i];
+                rank[i] = k;
+            }
+        }
+    }
+
+    // particle indices in cell order
+    const std::vector<uint32_t>& order() const { return sorted; }
+
+    // calls f(j, distanceSquared) for every particle j != i within radius of particle i
+    template <class F>
+    void forEachNeighbor(uint32_t i, float radius, F&& f) const
+    {
+        query(position(i), radius, i, f);
+    }
+
+    // calls f(j, distanceSquared) for every particle j within radius of p
+    template <class F>
+    void forEachNeighbor(const glm::vec3& p, float radius, F&& f) const
+    {
+        query(p, radius, UINT32_MAX, f);
+    }
+
+    float cellSize() const { return cell; }
+
+    // the bucket table, log2 of its size and the first particle (in order()) of every
+    // bucket plus the total count, what GpuGrid uploads for emit.vert
+    int bucketBits() const { return bits; }
+    const std::vector<uint32_t>& bucketStarts() const { return cellStart; }
+
+    // bucket of cell (cx, cy, cz), the same function as gridBucket() in the shaders
+    uint32_t bucket(int32_t cx, int32_t cy, int32_t cz) const
+    {
+        uint32_t h = ((uint32_t)cy & 0xFFFFu) | ((uint32_t)cz << 16);
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        uint32_t rowBucket = bits == 0 ? 0 : h >> (32 - bits);
+        return (rowBucket + (uint32_t)cx) & mask;
+    }
+
+private:
+    static const int MAX_CHUNKS = 8;
+    static const int KEY_BITS = 21;
+    static const int32_t KEY_BIAS = 1 << (KEY_BITS - 1);
+
+    float cell = 1.0f, invCell = 1.0f;
+    int bits = 0;
+    uint32_t mask = 0;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> bucketOf;
+    std::vector<uint32_t> histogram;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> sorted;
+    std::vector<float> sortedX, sortedY, sortedZ;
+    std::vector<uint64_t> sortedKeys;
+    std::vector<uint32_t> rank; // sorted position of every particle
+
+    // floor(v / cellSize) as a multiply, the shaders use the same u_gridInvCellSize
+    int32_t cellCoord(float v) const
+    {
+        return (int32_t)std::floor(v * invCell);
+    }
+
+    // the full cell coordinate, tells cells sharing a bucket apart
+    static uint64_t cellKey(int32_t cx, int32_t cy, int32_t cz)
+    {
+        const uint64_t m = (1u << KEY_BITS) - 1;
+        return ((uint64_t)(cx + KEY_BIAS) & m) | (((uint64_t)(cy + KEY_BIAS) & m) << KEY_BITS) |
+               (((uint64_t)(cz + KEY_BIAS) & m) << (2 * KEY_BITS));
+    }
+
+    static const uint64_t X_MASK = (1u << KEY_BITS) - 1;
+
+    glm::vec3 position(uint32_t i) const
+    {
+        uint32_t k = rank[i];
+        return glm::vec3(sortedX[k], sortedY[k], sortedZ[k]);
+    }
+
+    template <class F>
+    void query(const glm::vec3& p, float radius, uint32_t self, F& f) const
+    {
+        if (sorted.empty())
+            return;
+        const float r2 = radius * radius;
+        const int32_t x0 = cellCoord(p.x - radius), x1 = cellCoord(p.x + radius);
+        const int32_t y0 = cellCoord(p.y - radius), y1 = cellCoord(p.y + radius);
+        const int32_t z0 = cellCoord(p.z - radius), z1 = cellCoord(p.z + radius);
+        const float* px = sortedX.data();
+        const float* py = sortedY.data();
+        const float* pz = sortedZ.data();
+        const uint64_t* pk = sortedKeys.data();
+        const uint32_t* index = sorted.data();
+        const uint32_t spanX = (uint32_t)(x1 - x0);
+        for (int32_t cz = z0; cz <= z1; ++cz) {
+            for (int32_t cy = y0; cy <= y1; ++cy) {
+                // the cells x0..x1 of the row, in buckets b0..b1 unless the range wraps
+                const uint64_t first = cellKey(x0, cy, cz);
+                const uint64_t row = first & ~X_MASK;
+                const uint32_t firstX = (uint32_t)(first & X_MASK);
+                const uint32_t b0 = bucket(x0, cy, cz);
+                const uint32_t b1 = spanX >= mask ? b0 + mask : b0 + spanX;
+                uint32_t begin = cellStart[b0];
+                uint32_t end = cellStart[std::min(b1, mask) + 1];
+                for (int pass = 0; pass < 2; ++pass) {
+                    for (uint32_t k = begin; k < end; ++k) {
+                        // one combined test, the cell and distance checks are unpredictable
+                        uint64_t key = pk[k];
+                        float dx = px[k] - p.x, dy = py[k] - p.y, dz = pz[k] - p.z;
+                        float d2 = dx * dx + dy * dy + dz * dz;
+                        bool inRow = ((key & ~X_MASK) == row) & ((uint32_t)(key & X_MASK) - firstX <= spanX);
+                        if (inRow & (d2 <= r2) & (index[k] != self))
+                            f(index[k], d2);
+                    }
+                    if (b1 <= mask)
+                        break;
+                    // wrapped past the last bucket
+                    begin = cellStart[0];
+                    end = cellStart[std::min(b1 - mask - 1, b0 - 1) + 1];
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "stb_image.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Sprite atlas: every sprite and flipbook frame of an effect packed into one texture,
+// so the effect binds one texture and draws in one call whatever sprites it uses.
+//
+// buildAtlas() packs the images with a skyline bottom-left packer (Jylanki, "A
+// Thousand Ways to Pack the Bin") and writes the uv rect of every image, in input
+// order. Each image gets a border of its edge texels so linear filtering doesn't
+// bleed its neighbors in. A flipbook sheet is cut into its frames with splitSheet()
+// first, they become consecutive rects.
+//
+// particleAtlas builds atlases offline: saveAtlas() writes the texture as a TGA for
+// TextureRegistry and the rects beside it as <name>.atlas, loadAtlasRects() reads
+// them back. draw.vert takes up to MAX_ATLAS_RECTS rects (u_atlasRects).
+
+const int MAX_ATLAS_RECTS = 64;
+
+// RGBA8, rows bottom up like TextureRegistry uploads them
+struct AtlasImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+struct TextureAtlas {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+    std::vector<glm::vec4> rects; // (u0, v0, u1, v1) of every image
+};
+
+inline bool readFileBytes(const std::filesystem::path& path, std::vector<uint8_t>& file)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return false;
+    file.resize((size_t)in.tellg());
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(file.data()), (std::streamsize)file.size());
+    return (bool)in;
+}
+
+// needs stb_image's implementation in the program, like main.cpp
+inline bool loadAtlasImage(const std::filesystem::path& path, AtlasImage& image)
+{
+    int channels;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* data = stbi_load(path.string().c_str(), &image.width, &image.height, &channels, 4);
+    if (!data) {
+        std::cout << "Failed to load atlas image: " << path.string() << std::endl;
+        return false;
+    }
+    image.rgba.assign(data, data + (size_t)image.width * image.height * 4);
+    stbi_image_free(data);
+    return true;
+}
+
+// the frames of a flipbook sheet of columns x rows, in reading order from the top left
+inline void splitSheet(const AtlasImage& sheet, int columns, int rows, std::vector<AtlasImage>& frames)
+{
+    int frameWidth = sheet.width / columns, frameHeight = sheet.height / rows;
+    for (int r = 0; r < rows; ++r) {
+        // the top row is the last one in memory
+        int y0 = sheet.height - (r + 1) * frameHeight;
+        for (int c = 0; c < columns; ++c) {
+            AtlasImage frame;
+            frame.width = frameWidth;
+            frame.height = frameHeight;
+            frame.rgba.resize((size_t)frameWidth * frameHeight * 4);
+            for (int y = 0; y < frameHeight; ++y) {
+                const uint8_t* src = &sheet.rgba[(((size_t)(y0 + y) * sheet.width) + (size_t)c * frameWidth) * 4];
+                std::copy(src, src + (size_t)frameWidth * 4, &frame.rgba[(size_t)y * frameWidth * 4]);
+            }
+            frames.push_back(std::move(frame));
+        }
+    }
+}
+
+// Bottom-left skyline packer: the skyline is the top edge of what has been placed,
+// a rect goes where its top ends lowest, on the narrowest segment on ties.
+class SkylinePacker
+{
+public:
+    void init(int w, int h)
+    {
+        width = w;
+        height = h;
+        usedArea = 0;
+        skyline.assign(1, Segment{ 0, 0, w });
+    }
+
+    // false when the rect doesn't fit anywhere
+    bool insert(int w, int h, int& x, int& y)
+    {
+        int bestIndex = -1, bestTop = INT_MAX, bestWidth = INT_MAX, bestY = 0;
+        for (size_t i = 0; i < skyline.size(); ++i) {
+            int top;
+            if (!fits(i, w, h, top))
+                continue;
+            if (top + h < bestTop || (top + h == bestTop && skyline[i].width < bestWidth)) {
+                bestIndex = (int)i;
+                bestTop = top + h;
+                bestWidth = skyline[i].width;
+                bestY = top;
+            }
+        }
+        if (bestIndex < 0)
+            return false;
+        x = skyline[bestIndex].x;
+        y = bestY;
+        place((size_t)bestIndex, x, y, w, h);
+        usedArea += (int64_t)w * h;
+        return true;
+    }
+
+    // fraction of the area covered by the rects
+    float occupancy() const { return (float)usedArea / ((float)width * (float)height); }
+
+private:
+    struct Segment {
+        int x, y, width;
+    };
+    int width = 0, height = 0;
+    int64_t usedArea = 0;
+    std::vector<Segment> skyline;
+
+    // the rect with its left edge at segment i rests at y, if it fits
+    bool fits(size_t i, int w, int h, int& y) const
+    {
+        if (skyline[i].x + w > width)
+            return false;
+        y = skyline[i].y;
+        for (int left = w; left > 0; left -= skyline[i].width, ++i) {
+            y = std::max(y, skyline[i].y);
+            if (y + h > height)
+                return false;
+        }
+        return true;
+    }
+
+    void place(size_t i, int x, int y, int w, int h)
+    {
+        skyline.insert(skyline.begin() + i, Segment{ x, y + h, w });
+        // the segments under the rect shrink or go
+        for (size_t j = i + 1; j < skyline.size();) {
+            int end = skyline[j - 1].x + skyline[j - 1].width;
+            if (skyline[j].x >= end)
+                break;
+            int shrink = end - skyline[j].x;
+            skyline[j].x += shrink;
+            skyline[j].width -= shrink;
+            if (skyline[j].width > 0)
+                break;
+            skyline.erase(skyline.begin() + j);
+        }
+        // neighbors at the same height become one
+        for (size_t j = 0; j + 1 < skyline.size();) {
+            if (skyline[j].y == skyline[j + 1].y) {
+                skyline[j].width += skyline[j + 1].width;
+                skyline.erase(skyline.begin() + j + 1);
+            }
+            else {
+                ++j;
+            }
+        }
+    }
+};
+
+// Packs images into the smallest power of two atlas up to maxSize x maxSize, with
+// padding texels of extruded edge around each. False when they don't fit.
+inline bool buildAtlas(const std::vector<AtlasImage>& images, int maxSize, int padding, TextureAtlas& atlas)
+{
+    // tallest first, the skyline stays flat
+    std::vector<size_t> order(images.size());
+    std::iota(order.begin(), order.end(), (size_t)0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (images[a].height != images[b].height)
+            return images[a].height > images[b].height;
+        return images[a].width > images[b].width;
+    });
+    int64_t area = 0;
+    for (const AtlasImage& image : images)
+        area += (int64_t)(image.width + 2 * padding) * (image.height + 2 * padding);
+
+    int w = 1, h = 1;
+    while ((int64_t)w * h < area) {
+        if (w <= h)
+            w *= 2;
+        else
+            h *= 2;
+    }
+    std::vector<int> xs(images.size()), ys(images.size());
+    SkylinePacker packer;
+    for (;;) {
+        if (w > maxSize || h > maxSize) {
+            std::cout << "Atlas images don't fit in " << maxSize << "x" << maxSize << std::endl;
+            return false;
+        }
+        packer.init(w, h);
+        bool packed = true;
+        for (size_t i : order) {
+            if (!packer.insert(images[i].width + 2 * padding, images[i].height + 2 * padding, xs[i], ys[i])) {
+                packed = false;
+                break;
+            }
+        }
+        if (packed)
+            break;
+        if (w <= h)
+            w *= 2;
+        else
+            h *= 2;
+    }
+
+    atlas.width = w;
+    atlas.height = h;
+    atlas.rgba.assign((size_t)w * h * 4, 0);
+    atlas.rects.resize(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        const AtlasImage& image = images[i];
+        // every texel of the padded rect takes the nearest texel of the image
+        for (int y = 0; y < image.height + 2 * padding; ++y) {
+            int sy = std::min(image.height - 1, std::max(0, y - padding));
+            uint8_t* dst = &atlas.rgba[(((size_t)(ys[i] + y) * w) + xs[i]) * 4];
+            for (int x = 0; x < image.width + 2 * padding; ++x) {
+                int sx = std::min(image.width - 1, std::max(0, x - padding));
+                std::copy_n(&image.rgba[((size_t)sy * image.width + sx) * 4], 4, dst + (size_t)x * 4);
+            }
+        }
+        atlas.rects[i] = glm::vec4((float)(xs[i] + padding) / w, (float)(ys[i] + padding) / h,
+                                   (float)(xs[i] + padding + image.width) / w, (float)(ys[i] + padding + image.height) / h);
+    }
+    return true;
+}
+
+inline std::filesystem::path atlasRectsPath(const std::filesystem::path& imagePath)
+{
+    std::filesystem::path rects = imagePath;
+    return rects.replace_extension(".atlas");
+}
+
+// the texture as an uncompressed 32 bit TGA, the rects as text beside it
+inline bool saveAtlas(const std::filesystem::path& imagePath, const TextureAtlas& atlas)
+{
+    std::ofstream image(imagePath, std::ios::binary);
+    if (!image) {
+        std::cerr << "Failed to open atlas for writing: " << imagePath.string() << std::endl;
+        return false;
+    }
+    // bottom up rows, BGRA
+    uint8_t header[18] = { 0, 0, 2 };
+    header[12] = (uint8_t)(atlas.width & 0xFF);
+    header[13] = (uint8_t)(atlas.width >> 8);
+    header[14] = (uint8_t)(atlas.height & 0xFF);
+    header[15] = (uint8_t)(atlas.height >> 8);
+    header[16] = 32;
+    header[17] = 8;
+    image.write(reinterpret_cast<const char*>(header), sizeof(header));
+    std::vector<uint8_t> bgra(atlas.rgba.size());
+    for (size_t i = 0; i < atlas.rgba.size(); i += 4) {
+        bgra[i] = atlas.rgba[i + 2];
+        bgra[i + 1] = atlas.rgba[i + 1];
+        bgra[i + 2] = atlas.rgba[i];
+        bgra[i + 3] = atlas.rgba[i + 3];
+    }
+    image.write(reinterpret_cast<const char*>(bgra.data()), (std::streamsize)bgra.size());
+
+    std::ofstream rects(atlasRectsPath(imagePath));
+    if (!rects) {
+        std::cerr << "Failed to open atlas rects for writing: " << atlasRectsPath(imagePath).string() << std::endl;
+        return false;
+    }
+    rects << "atlas " << atlas.width << " " << atlas.height << " " << atlas.rects.size() << "\n";
+    char line[128];
+    for (const glm::vec4& r : atlas.rects) {
+        std::snprintf(line, sizeof(line), "%.9g %.9g %.9g %.9g\n", r.x, r.y, r.z, r.w);
+        rects << line;
+    }
+    return (bool)image && (bool)rects;
+}
+
+// the rects of the atlas texture at imagePath, false when it has no .atlas file
+inline bool loadAtlasRects(const std::filesystem::path& imagePath, std::vector<glm::vec4>& rects)
+{
+    std::ifstream file(atlasRectsPath(imagePath));
+    if (!file)
+        return false;
+    std::string tag;
+    int width, height;
+    size_t count;
+    if (!(file >> tag >> width >> height >> count) || tag != "atlas") {
+        std::cout << "Invalid atlas rects: " << atlasRectsPath(imagePath).string() << std::endl;
+        return false;
+    }
+    rects.resize(count);
+    for (glm::vec4& r : rects) {
+        if (!(file >> r.x >> r.y >> r.z >> r.w)) {
+            std::cout << "Truncated atlas rects: " << atlasRectsPath(imagePath).string() << std::endl;
+            return false;
+        }
+    }
+    if (rects.size() > (size_t)MAX_ATLAS_RECTS) {
+        std::cout << "Atlas has " << rects.size() << " rects, draw.vert takes " << MAX_ATLAS_RECTS << std::endl;
+        rects.resize(MAX_ATLAS_RECTS);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,444 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include "textureAtlas.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Block compressed textures: the GPU samples them compressed, a BC1 texture takes
+// 0.5 bytes per texel and a BC3 one 1 byte against the 4 of RGBA8 (RGB8 is padded to
+// 4 too), and loading one is a file read and glCompressedTexImage2D, no decode.
+//
+// compressImage() encodes RGBA8 images or their mip chains offline (particleCompress),
+// 4x4 blocks:
+//   BC1 (DXT1)  opaque color, two RGB565 endpoints and 2 bit indices
+//   BC3 (DXT5)  BC1 color plus two 8 bit alpha endpoints and 3 bit indices
+// The endpoints are the extremes along the principal axis of the block's colors,
+// refit once by least squares to the indices they give. Block rows are OpenMP
+// parallel.
+//
+// saveCompressed() / loadCompressed() read and write DDS and KTX (version 1) by the
+// file's extension. Both hold the levels in GL's order, bottom row first, like
+// TextureRegistry uploads the stb_image rows; KTX says so with its orientation key,
+// DDS has none. loadCompressed() takes any block format of the table below, so KTX
+// files with ETC2 from other tools load too where the driver has ETC2 (GL 4.3).
+
+// the GL internal formats, the S3TC ones come from EXT_texture_compression_s3tc
+const uint32_t COMPRESSED_RGB_BC1 = 0x83F0;  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+const uint32_t COMPRESSED_RGBA_BC3 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+const uint32_t COMPRESSED_RED_BC4 = 0x8DBB;  // GL_COMPRESSED_RED_RGTC1
+const uint32_t COMPRESSED_RG_BC5 = 0x8DBD;   // GL_COMPRESSED_RG_RGTC2
+const uint32_t COMPRESSED_RGB_ETC2 = 0x9274; // GL_COMPRESSED_RGB8_ETC2
+const uint32_t COMPRESSED_RGBA_ETC2 = 0x9278; // GL_COMPRESSED_RGBA8_ETC2_EAC
+
+// bytes per 4x4 block of a supported format, 0 for the others
+inline size_t compressedBlockBytes(uint32_t format)
+{
+    switch (format) {
+    case COMPRESSED_RGB_BC1:
+    case COMPRESSED_RED_BC4:
+    case COMPRESSED_RGB_ETC2:
+        return 8;
+    case COMPRESSED_RGBA_BC3:
+    case COMPRESSED_RG_BC5:
+    case COMPRESSED_RGBA_ETC2:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+inline size_t compressedLevelBytes(uint32_t format, int w, int h)
+{
+    return (size_t)((w + 3) / 4) * (size_t)((h + 3) / 4) * compressedBlockBytes(format);
+}
+
+// GL_RED, GL_RG, GL_RGB or GL_RGBA, the channels of format
+inline uint32_t compressedBaseFormat(uint32_t format)
+{
+    switch (format) {
+    case COMPRESSED_RED_BC4:
+        return 0x1903;
+    case COMPRESSED_RG_BC5:
+        return 0x8227;
+    case COMPRESSED_RGBA_BC3:
+    case COMPRESSED_RGBA_ETC2:
+        return 0x1908;
+    default:
+        return 0x1907;
+    }
+}
+
+struct CompressedImage {
+    uint32_t format = 0; // GL internal format
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<uint8_t>> levels; // level 0 first, each halving down to 1x1
+};
+
+inline int compressedLevelWidth(const CompressedImage& image, size_t level) { return std::max(1, image.width >> level); }
+inline int compressedLevelHeight(const CompressedImage& image, size_t level) { return std::max(1, image.height >> level); }
+
+// ------------------------------------------------------------------ encoder
+
+inline uint16_t packRgb565(const glm::vec3& c)
+{
+    int r = (int)(glm::clamp(c.r, 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+    int g = (int)(glm::clamp(c.g, 0.0f, 255.0f) * (63.0f / 255.0f) + 0.5f);
+    int b = (int)(glm::clamp(c.b, 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline glm::vec3 unpackRgb565(uint16_t c)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+// 8 bytes of BC1 color in the 4 color mode for the 16 texels (RGBA8, row by row)
+inline void encodeColorBlock(const uint8_t* texels, uint8_t* out)
+{
+    glm::vec3 colors[16], mean(0.0f);
+    for (int i = 0; i < 16; ++i) {
+        colors[i] = glm::vec3(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2]);
+        mean += colors[i];
+    }
+    mean /= 16.0f;
+
+    // principal axis by power iteration on the covariance
+    float cov[6] = {};
+    for (const glm::vec3& c : colors) {
+        glm::vec3 d = c - mean;
+        cov[0] += d.r * d.r; cov[1] += d.r * d.g; cov[2] += d.r * d.b;
+        cov[3] += d.g * d.g; cov[4] += d.g * d.b; cov[5] += d.b * d.b;
+    }
+    glm::vec3 axis(0.9f, 1.0f, 0.7f);
+    for (int it = 0; it < 4; ++it) {
+        axis = glm::vec3(cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+                         cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+                         cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b);
+        float len = std::max(std::abs(axis.r), std::max(std::abs(axis.g), std::abs(axis.b)));
+        if (len < 1e-6f)
+            break;
+        axis /= len;
+    }
+    float lo = 1e30f, hi = -1e30f;
+    glm::vec3 minColor = mean, maxColor = mean;
+    for (const glm::vec3& c : colors) {
+        float t = glm::dot(c - mean, axis);
+        if (t < lo) { lo = t; minColor = c; }
+        if (t > hi) { hi = t; maxColor = c; }
+    }
+
+    uint16_t c0 = 0, c1 = 0;
+    uint32_t indices = 0;
+    float blockError = 1e30f;
+    // the second pass refits the endpoints to the indices of the first, the block
+    // keeps the pass with the smaller error
+    for (int pass = 0; pass < 2; ++pass) {
+        uint16_t e0 = packRgb565(maxColor), e1 = packRgb565(minColor);
+        if (e0 < e1)
+            std::swap(e0, e1);
+        if (e0 == e1) {
+            // one color, every index picks it
+            if (pass == 0) {
+                c0 = c1 = e0;
+                indices = 0;
+            }
+            break;
+        }
+        glm::vec3 palette[4] = { unpackRgb565(e0), unpackRgb565(e1) };
+        palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+        palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+        // least squares sums for the endpoints a = palette[0], b = palette[1]
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        glm::vec3 ax(0.0f), bx(0.0f);
+        static const float WEIGHT[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        uint32_t passIndices = 0;
+        float passError = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int k = 0; k < 4; ++k) {
+                glm::vec3 d = colors[i] - palette[k];
+                float error = glm::dot(d, d);
+                if (error < bestError) {
+                    bestError = error;
+                    best = k;
+                }
+            }
+            passIndices |= (uint32_t)best << (i * 2);
+            passError += bestError;
+            float w = WEIGHT[best];
+            aa += w * w;
+            bb += (1.0f - w) * (1.0f - w);
+            ab += w * (1.0f - w);
+            ax += w * colors[i];
+            bx += (1.0f - w) * colors[i];
+        }
+        if (passError < blockError) {
+            blockError = passError;
+            c0 = e0;
+            c1 = e1;
+            indices = passIndices;
+        }
+        float det = aa * bb - ab * ab;
+        if (pass == 1 || std::abs(det) < 1e-6f)
+            break;
+        glm::vec3 a = (ax * bb - bx * ab) / det, b = (bx * aa - ax * ab) / det;
+        if (packRgb565(a) == e0 && packRgb565(b) == e1)
+            break;
+        maxColor = a;
+        minColor = b;
+    }
+
+    out[0] = (uint8_t)(c0 & 0xFF);
+    out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)(c1 & 0xFF);
+    out[3] = (uint8_t)(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+// 8 bytes of BC3 alpha in the 8 value mode
+inline void encodeAlphaBlock(const uint8_t* texels, uint8_t* out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, (int)texels[i * 4 + 3]);
+        hi = std::max(hi, (int)texels[i * 4 + 3]);
+    }
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    uint64_t indices = 0;
+    if (hi > lo) {
+        for (int i = 0; i < 16; ++i) {
+            // p steps from lo (0) to hi (7), index 0 is hi, 1 is lo, 2..7 step down from hi
+            int p = ((texels[i * 4 + 3] - lo) * 7 + (hi - lo) / 2) / (hi - lo);
+            uint64_t index = p == 7 ? 0 : p == 0 ? 1 : (uint64_t)(8 - p);
+            indices |= index << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+// one level of format (BC1 or BC3) from RGBA8 rows, blocks past the edge repeat it
+inline void compressLevel(const uint8_t* rgba, int w, int h, uint32_t format, std::vector<uint8_t>& out)
+{
+    int blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+    size_t blockBytes = compressedBlockBytes(format);
+    out.resize((size_t)blocksX * blocksY * blockBytes);
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int by = 0; by < blocksY; ++by) {
+        uint8_t texels[64];
+        for (int bx = 0; bx < blocksX; ++bx) {
+            for (int y = 0; y < 4; ++y) {
+                int sy = std::min(by * 4 + y, h - 1);
+                for (int x = 0; x < 4; ++x) {
+                    int sx = std::min(bx * 4 + x, w - 1);
+                    std::memcpy(&texels[(y * 4 + x) * 4], &rgba[((size_t)sy * w + sx) * 4], 4);
+                }
+            }
+            uint8_t* block = &out[((size_t)by * blocksX + bx) * blockBytes];
+            if (format == COMPRESSED_RGBA_BC3) {
+                encodeAlphaBlock(texels, block);
+                encodeColorBlock(texels, block + 8);
+            }
+            else {
+                encodeColorBlock(texels, block);
+            }
+        }
+    }
+}
+
+// levels (generateMipChain() of mipmaps.h, or just the image) in BC1 or BC3, false
+// for the other formats
+inline bool compressImage(const std::vector<AtlasImage>& levels, uint32_t format, CompressedImage& compressed)
+{
+    if (format != COMPRESSED_RGB_BC1 && format != COMPRESSED_RGBA_BC3) {
+        std::cout << "No encoder for compressed format 0x" << std::hex << format << std::dec << std::endl;
+        return false;
+    }
+    compressed.format = format;
+    compressed.width = levels[0].width;
+    compressed.height = levels[0].height;
+    compressed.levels.resize(levels.size());
+    for (size_t i = 0; i < levels.size(); ++i)
+        compressLevel(levels[i].rgba.data(), levels[i].width, levels[i].height, format, compressed.levels[i]);
+    return true;
+}
+
+inline bool compressImage(const AtlasImage& image, uint32_t format, CompressedImage& compressed)
+{
+    return compressImage(std::vector<AtlasImage>(1, image), format, compressed);
+}
+
+// ------------------------------------------------------------------ containers
+
+// DDS pixel format FourCCs of the formats above
+inline uint32_t ddsFourCC(const char* code)
+{
+    return (uint32_t)(uint8_t)code[0] | ((uint32_t)(uint8_t)code[1] << 8) |
+           ((uint32_t)(uint8_t)code[2] << 16) | ((uint32_t)(uint8_t)code[3] << 24);
+}
+
+inline uint32_t ddsFormat(uint32_t fourCC)
+{
+    if (fourCC == ddsFourCC("DXT1")) return COMPRESSED_RGB_BC1;
+    if (fourCC == ddsFourCC("DXT5")) return COMPRESSED_RGBA_BC3;
+    if (fourCC == ddsFourCC("ATI1") || fourCC == ddsFourCC("BC4U")) return COMPRESSED_RED_BC4;
+    if (fourCC == ddsFourCC("ATI2") || fourCC == ddsFourCC("BC5U")) return COMPRESSED_RG_BC5;
+    return 0;
+}
+
+inline const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+inline bool isKtxPath(const std::filesystem::path& path) { return path.extension() == ".ktx"; }
+inline bool isDdsPath(const std::filesystem::path& path) { return path.extension() == ".dds"; }
+
+inline void writeLe32(std::vector<uint8_t>& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back((uint8_t)(v >> (i * 8)));
+}
+
+inline uint32_t readLe32(const std::vector<uint8_t>& in, size_t offset)
+{
+    return (uint32_t)in[offset] | ((uint32_t)in[offset + 1] << 8) | ((uint32_t)in[offset + 2] << 16) | ((uint32_t)in[offset + 3] << 24);
+}
+
+inline bool saveCompressed(const std::filesystem::path& path, const CompressedImage& image)
+{
+    std::vector<uint8_t> file;
+    if (isKtxPath(path)) {
+        file.assign(KTX_IDENTIFIER, KTX_IDENTIFIER + 12);
+        const char orientation[] = "KTXorientation\0S=r,T=u"; // rows bottom up
+        uint32_t keyValueBytes = (uint32_t)sizeof(orientation);
+        uint32_t keyValuePadded = (4 + keyValueBytes + 3) & ~3u;
+        uint32_t header[13] = { 0x04030201, 0, 1, 0, image.format,
+                                compressedBaseFormat(image.format),
+                                (uint32_t)image.width, (uint32_t)image.height, 0, 0, 1, (uint32_t)image.levels.size(),
+                                keyValuePadded };
+        for (uint32_t v : header)
+            writeLe32(file, v);
+        writeLe32(file, keyValueBytes);
+        file.insert(file.end(), orientation, orientation + keyValueBytes);
+        file.resize(file.size() + (keyValuePadded - 4 - keyValueBytes), 0);
+        for (const std::vector<uint8_t>& level : image.levels) {
+            writeLe32(file, (uint32_t)level.size());
+            file.insert(file.end(), level.begin(), level.end());
+            file.resize((file.size() + 3) & ~(size_t)3, 0);
+        }
+    }
+    else if (isDdsPath(path)) {
+        uint32_t fourCC = image.format == COMPRESSED_RGB_BC1 ? ddsFourCC("DXT1") :
+                          image.format == COMPRESSED_RGBA_BC3 ? ddsFourCC("DXT5") :
+                          image.format == COMPRESSED_RED_BC4 ? ddsFourCC("ATI1") :
+                          image.format == COMPRESSED_RG_BC5 ? ddsFourCC("ATI2") : 0;
+        if (!fourCC) {
+            std::cerr << "DDS can't hold format 0x" << std::hex << image.format << std::dec << std::endl;
+            return false;
+        }
+        // DDSD_CAPS | HEIGHT | WIDTH | PIXELFORMAT | LINEARSIZE, MIPMAPCOUNT with levels
+        uint32_t flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000 | (image.levels.size() > 1 ? 0x20000 : 0);
+        uint32_t header[31] = { 124, flags, (uint32_t)image.height, (uint32_t)image.width,
+                                (uint32_t)image.levels[0].size(), 0, (uint32_t)image.levels.size() };
+        header[18] = 32;     // pixel format size
+        header[19] = 0x4;    // DDPF_FOURCC
+        header[20] = fourCC;
+        header[26] = 0x1000 | (image.levels.size() > 1 ? 0x400008 : 0); // DDSCAPS_TEXTURE, MIPMAP | COMPLEX
+        writeLe32(file, ddsFourCC("DDS "));
+        for (uint32_t v : header)
+            writeLe32(file, v);
+        for (const std::vector<uint8_t>& level : image.levels)
+            file.insert(file.end(), level.begin(), level.end());
+    }
+    else {
+        std::cerr << "Compressed textures are .dds or .ktx: " << path.string() << std::endl;
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open compressed texture for writing: " << path.string() << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(file.data()), (std::streamsize)file.size());
+    return (bool)out;
+}
+
+// the DDS or KTX file read from path, by its extension
+inline bool parseCompressed(const std::vector<uint8_t>& file, const std::filesystem::path& path, CompressedImage& image)
+{
+    size_t offset = 0, levelCount = 0;
+    if (isKtxPath(path)) {
+        if (file.size() < 64 || !std::equal(KTX_IDENTIFIER, KTX_IDENTIFIER + 12, file.begin()) || readLe32(file, 12) != 0x04030201) {
+            std::cout << "Invalid KTX file: " << path.string() << std::endl;
+            return false;
+        }
+        image.format = readLe32(file, 28);
+        image.width = (int)readLe32(file, 36);
+        image.height = (int)std::max(1u, readLe32(file, 40));
+        if (readLe32(file, 44) > 1 || readLe32(file, 48) > 1 || readLe32(file, 52) != 1) {
+            std::cout << "KTX file isn't a 2D texture: " << path.string() << std::endl;
+            return false;
+        }
+        levelCount = std::max(1u, readLe32(file, 56));
+        offset = 64 + (size_t)readLe32(file, 60);
+    }
+    else if (isDdsPath(path)) {
+        if (file.size() < 128 || readLe32(file, 0) != ddsFourCC("DDS ") || readLe32(file, 4) != 124) {
+            std::cout << "Invalid DDS file: " << path.string() << std::endl;
+            return false;
+        }
+        image.height = (int)readLe32(file, 12);
+        image.width = (int)readLe32(file, 16);
+        levelCount = (readLe32(file, 8) & 0x20000) ? std::max(1u, readLe32(file, 28)) : 1;
+        image.format = (readLe32(file, 80) & 0x4) ? ddsFormat(readLe32(file, 84)) : 0;
+        offset = 128;
+    }
+    else {
+        return false;
+    }
+    if (!compressedBlockBytes(image.format) || image.width <= 0 || image.height <= 0 || levelCount > 16) {
+        std::cout << "Unsupported compressed texture: " << path.string() << std::endl;
+        return false;
+    }
+
+    image.levels.resize(levelCount);
+    for (size_t level = 0; level < levelCount; ++level) {
+        size_t bytes = compressedLevelBytes(image.format, compressedLevelWidth(image, level), compressedLevelHeight(image, level));
+        if (isKtxPath(path)) {
+            if (offset + 4 > file.size() || readLe32(file, offset) != bytes)
+                bytes = SIZE_MAX;
+            offset += 4;
+        }
+        if (bytes == SIZE_MAX || offset + bytes > file.size()) {
+            std::cout << "Truncated compressed texture: " << path.string() << std::endl;
+            return false;
+        }
+        image.levels[level].assign(file.begin() + offset, file.begin() + offset + bytes);
+        offset += bytes;
+        if (isKtxPath(path))
+            offset = (offset + 3) & ~(size_t)3;
+    }
+    return true;
+}
+
+inline bool loadCompressed(const std::filesystem::path& path, CompressedImage& image)
+{
+    std::vector<uint8_t> file;
+    return readFileBytes(path, file) && parseCompressed(file, path, image);
+}
+
+#endif
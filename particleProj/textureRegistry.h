@@ -0,0 +1,257 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include "textureCompression.h"
+#include "mipmaps.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The effects' textures, loaded once however many effects use them.
+//
+// acquire() looks a texture up by its path, then by the FNV-1a hash of its file's
+// bytes (two paths to the same image share one texture), and only loads it when
+// neither is resident. Every acquire() is paired with a release(); a texture nobody
+// holds stays resident in LRU order and is deleted once the resident textures go
+// over the VRAM budget, the ones in use are never evicted.
+//
+// Loading takes the .ktx or .dds of the image written by particleCompress first,
+// its levels go to glCompressedTexImage2D as they are; otherwise the image's mip
+// chain comes from mipChainCached() (mipmaps.h), filtered once and then read back
+// from the disk cache.
+class TextureRegistry
+{
+public:
+    explicit TextureRegistry(size_t budgetBytes = 256u << 20, const std::filesystem::path& cacheDir = "texcache")
+        : budget(budgetBytes), mipCacheDir(cacheDir)
+    {
+    }
+
+    // the texture of the image at path, 0 when it can't be loaded
+    GLuint acquire(const std::filesystem::path& path)
+    {
+        std::filesystem::path source = sourcePath(path);
+        // one error code each, a successful call clears the code it is given
+        std::error_code timeError, sizeError;
+        FileStamp stamp{ std::filesystem::last_write_time(source, timeError), std::filesystem::file_size(source, sizeError) };
+        if (timeError || sizeError) {
+            std::cout << "Failed to load texture: " << path.string() << std::endl;
+            return 0;
+        }
+
+        auto known = byPath.find(path.string());
+        if (known != byPath.end() && known->second.source == source && known->second.stamp == stamp)
+            return reference(known->second.texture);
+
+        std::vector<uint8_t> file;
+        if (!readFileBytes(source, file)) {
+            std::cout << "Failed to load texture: " << source.string() << std::endl;
+            return 0;
+        }
+        uint64_t hash = hashTextureFile(file);
+        auto same = byHash.find(hash);
+        GLuint texture;
+        if (same != byHash.end()) {
+            texture = same->second;
+        }
+        else {
+            size_t bytes = 0;
+            texture = load(file, source, path, bytes);
+            if (!texture)
+                return 0;
+            entries[texture] = Entry{ hash, bytes, 0, lru.end() };
+            byHash[hash] = texture;
+            resident += bytes;
+            ++uploadCount;
+        }
+        byPath[path.string()] = PathEntry{ texture, source, stamp };
+        reference(texture);
+        evict();
+        return texture;
+    }
+
+    void release(GLuint texture)
+    {
+        auto found = entries.find(texture);
+        if (found == entries.end() || found->second.refs == 0)
+            return;
+        if (--found->second.refs == 0) {
+            found->second.lruPosition = lru.insert(lru.end(), texture);
+            evict();
+        }
+    }
+
+    void setBudget(size_t budgetBytes)
+    {
+        budget = budgetBytes;
+        evict();
+    }
+
+    size_t residentBytes() const { return resident; }
+    size_t uploads() const { return uploadCount; }
+
+    // deletes every texture, held or not
+    void clear()
+    {
+        for (auto& entry : entries)
+            glDeleteTextures(1, &entry.first);
+        entries.clear();
+        byHash.clear();
+        byPath.clear();
+        lru.clear();
+        resident = 0;
+    }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        size_t bytes;
+        int refs;
+        std::list<GLuint>::iterator lruPosition; // lru.end() while held
+    };
+    struct FileStamp {
+        std::filesystem::file_time_type time;
+        uintmax_t size;
+        bool operator==(const FileStamp& o) const { return time == o.time && size == o.size; }
+    };
+    struct PathEntry {
+        GLuint texture;
+        std::filesystem::path source;
+        FileStamp stamp;
+    };
+
+    size_t budget;
+    std::filesystem::path mipCacheDir;
+    size_t resident = 0, uploadCount = 0;
+    std::unordered_map<GLuint, Entry> entries;
+    std::unordered_map<uint64_t, GLuint> byHash;
+    std::unordered_map<std::string, PathEntry> byPath;
+    std::list<GLuint> lru; // released textures, least recently released first
+
+    static std::filesystem::path sourcePath(const std::filesystem::path& path)
+    {
+        for (const char* extension : { ".ktx", ".dds" }) {
+            std::filesystem::path compressed = path;
+            compressed.replace_extension(extension);
+            if (std::filesystem::exists(compressed))
+                return compressed;
+        }
+        return path;
+    }
+
+    static uint64_t hashTextureFile(const std::vector<uint8_t>& file)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (uint8_t b : file) {
+            hash ^= b;
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    GLuint reference(GLuint texture)
+    {
+        Entry& entry = entries[texture];
+        if (entry.refs++ == 0 && entry.lruPosition != lru.end()) {
+            lru.erase(entry.lruPosition);
+            entry.lruPosition = lru.end();
+        }
+        return texture;
+    }
+
+    void evict()
+    {
+        while (resident > budget && !lru.empty()) {
+            GLuint texture = lru.front();
+            lru.pop_front();
+            Entry& entry = entries[texture];
+            resident -= entry.bytes;
+            byHash.erase(entry.hash);
+            // the name can come back from glGenTextures for another image
+            for (auto it = byPath.begin(); it != byPath.end();) {
+                if (it->second.texture == texture)
+                    it = byPath.erase(it);
+                else
+                    ++it;
+            }
+            entries.erase(texture);
+            glDeleteTextures(1, &texture);
+        }
+    }
+
+    GLuint load(const std::vector<uint8_t>& file, const std::filesystem::path& source, const std::filesystem::path& path, size_t& bytes)
+    {
+        if (source != path) {
+            CompressedImage image;
+            if (parseCompressed(file, source, image)) {
+                GLuint texture = uploadCompressed(image, bytes);
+                if (texture)
+                    return texture;
+            }
+            std::cout << "Compressed format not supported, loading the image: " << path.string() << std::endl;
+            std::vector<uint8_t> imageFile;
+            if (!readFileBytes(path, imageFile)) {
+                std::cout << "Failed to load texture: " << path.string() << std::endl;
+                return 0;
+            }
+            return loadImage(imageFile, path, bytes);
+        }
+        return loadImage(file, path, bytes);
+    }
+
+    GLuint loadImage(const std::vector<uint8_t>& file, const std::filesystem::path& path, size_t& bytes)
+    {
+        std::vector<AtlasImage> levels;
+        if (!mipChainCached(file, path, MIP_KAISER, mipCacheDir, levels))
+            return 0;
+        GLuint texture = createTexture(levels.size());
+        bytes = 0;
+        for (size_t level = 0; level < levels.size(); ++level) {
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA, levels[level].width, levels[level].height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, levels[level].rgba.data());
+            bytes += levels[level].rgba.size();
+        }
+        return texture;
+    }
+
+    // 0 when the driver can't take the format
+    static GLuint uploadCompressed(const CompressedImage& image, size_t& bytes)
+    {
+        GLuint texture = createTexture(image.levels.size());
+        while (glGetError() != GL_NO_ERROR) {}
+        bytes = 0;
+        for (size_t level = 0; level < image.levels.size(); ++level) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, image.format,
+                                   compressedLevelWidth(image, level), compressedLevelHeight(image, level), 0,
+                                   (GLsizei)image.levels[level].size(), image.levels[level].data());
+            bytes += image.levels[level].size();
+        }
+        if (glGetError() != GL_NO_ERROR) {
+            glDeleteTextures(1, &texture);
+            return 0;
+        }
+        return texture;
+    }
+
+    static GLuint createTexture(size_t levelCount)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+        return texture;
+    }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef VOLUME_SAMPLING_H
+#define VOLUME_SAMPLING_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// GL_MIRRORED_REPEAT wrap of an integer texel coordinate
+inline int mirrorTexel(int i, int size)
+{
+    int m = i % (2 * size);
+    if (m < 0)
+        m += 2 * size;
+    int a = m - size;
+    return (size - 1) - (a >= 0 ? a : -(1 + a));
+}
+
+// GL_REPEAT wrap of an integer texel coordinate
+inline int repeatTexel(int i, int size)
+{
+    int m = i % size;
+    return m < 0 ? m + size : m;
+}
+
+// Trilinear GL_LINEAR lookup over a size^3 volume of C-channel texels, wrapped with
+// GL_REPEAT or GL_MIRRORED_REPEAT. fetch(x, y, z, c) returns one channel of one texel.
+template <int C, class Fetch>
+inline void sampleTrilinear(int size, bool repeat, const glm::vec3& coord, Fetch fetch, float* out)
+{
+    float u = coord.x * size - 0.5f;
+    float v = coord.y * size - 0.5f;
+    float w = coord.z * size - 0.5f;
+    float fu = std::floor(u), fv = std::floor(v), fw = std::floor(w);
+    float a = u - fu, b = v - fv, c = w - fw;
+    int (*wrap)(int, int) = repeat ? repeatTexel : mirrorTexel;
+    int i0 = wrap((int)fu, size), i1 = wrap((int)fu + 1, size);
+    int j0 = wrap((int)fv, size), j1 = wrap((int)fv + 1, size);
+    int k0 = wrap((int)fw, size), k1 = wrap((int)fw + 1, size);
+
+    for (int ch = 0; ch < C; ++ch) {
+        float c00 = (1 - a) * fetch(i0, j0, k0, ch) + a * fetch(i1, j0, k0, ch);
+        float c10 = (1 - a) * fetch(i0, j1, k0, ch) + a * fetch(i1, j1, k0, ch);
+        float c01 = (1 - a) * fetch(i0, j0, k1, ch) + a * fetch(i1, j0, k1, ch);
+        float c11 = (1 - a) * fetch(i0, j1, k1, ch) + a * fetch(i1, j1, k1, ch);
+        float c0 = (1 - b) * c00 + b * c10;
+        float c1 = (1 - b) * c01 + b * c11;
+        out[ch] = (1 - c) * c0 + c * c1;
+    }
+}
+
+#endif
@@ -0,0 +1,55 @@
+#version 330 core
+uniform sampler2D s_texture;          // the effect's atlas
+uniform sampler2D s_sceneDepth;       // scene depth at the resolution of the target
+uniform float u_softness;             // distance over which the particles fade into the scene, 0 turns it off
+uniform mat4 u_inverseViewProjection;
+uniform vec2 u_viewportSize;
+
+// the flipbook frames of draw.vert
+flat in vec4 frameRect;
+flat in vec4 nextFrameRect;
+in float frameBlend;
+in vec4 curveColor;   // the effect's color gradient at the particle's age
+
+// soft particles: the sprite fades out as it nears the scene surface behind it and
+// is hidden behind it. Both depths go back to world space, so the fade distance is
+// the same under any projection.
+float softFade()
+{
+    if ( u_softness <= 0.0 )
+        return 1.0;
+    float sceneDepth = texelFetch( s_sceneDepth, ivec2( gl_FragCoord.xy ), 0 ).r;
+    if ( sceneDepth < gl_FragCoord.z )
+        return 0.0;
+    vec2 ndc = gl_FragCoord.xy / u_viewportSize * 2.0 - 1.0;
+    vec4 scene = u_inverseViewProjection * vec4( ndc, sceneDepth * 2.0 - 1.0, 1.0 );
+    vec4 particle = u_inverseViewProjection * vec4( ndc, gl_FragCoord.z * 2.0 - 1.0, 1.0 );
+    return clamp( length( scene.xyz / scene.w - particle.xyz / particle.w ) / u_softness, 0.0, 1.0 );
+}
+
+// the particle's flipbook frame, blended into the next one by the sub-frame age
+vec4 spriteColor()
+{
+    vec4 color = texture( s_texture, mix( frameRect.xy, frameRect.zw, gl_PointCoord ) );
+    if ( frameBlend > 0.0 )
+        color = mix( color, texture( s_texture, mix( nextFrameRect.xy, nextFrameRect.zw, gl_PointCoord ) ), frameBlend );
+    return color;
+}
+
+// the targets of WeightedOitPass, blended with (ONE, ONE) on rgb and (ZERO, ONE_MINUS_SRC_ALPHA) on alpha
+layout (location = 0) out vec4 accum;      // rgb: sum of color * alpha * weight, a: product of (1 - alpha)
+layout (location = 1) out vec4 weightSum;  // r: sum of alpha * weight
+
+// draw.frag for the weighted blended draw, softFade() and spriteColor() are its copies, see weightedOit.h
+void main()
+{
+    vec4 texColor = spriteColor();
+    vec3 color = texColor.xyz * curveColor.rgb;
+    float alpha = texColor.y * curveColor.a * softFade();
+
+    // McGuire and Bavoil, equation 10: nearer fragments weigh more
+    float z = 1.0 - gl_FragCoord.z;
+    float weight = clamp( alpha * max( 1e-2, 3e3 * z * z * z ), 1e-2, 3e3 );
+    accum = vec4( color * alpha * weight, alpha );
+    weightSum = vec4( alpha * weight );
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef WEIGHTED_OIT_H
+#define WEIGHTED_OIT_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <iostream>
+#include <memory>
+
+// Weighted blended order independent transparency (McGuire and Bavoil 2013), the
+// TRANSPARENCY_WEIGHTED mode of effectRender.h: the particles are drawn unsorted
+// and the blend equation no longer depends on their order.
+//
+// weightedOit.frag writes two targets with a single blend state (GL 3.3 has no
+// per-target blend functions):
+//   accum      RGBA16F  rgb adds up color * alpha * weight, alpha multiplies the
+//                       revealage (1 - alpha) of every fragment
+//   weightSum  R16F     adds up alpha * weight
+// composite() draws the weighted average color accum.rgb / weightSum over the
+// framebuffer that was bound at begin(), with the coverage 1 - revealage. Its alpha
+// is multiplied by the revealage, so into the target of LowResParticlePass
+// (lowResParticles.h) it composites like any other particle.
+//
+// The depth weight favors the nearer fragments; it is what the exact order is
+// traded for, so sparse effects whose overlaps are visible keep the sorted draw.
+//
+//   oit.begin();      // after the frame's clear
+//   draw the particles with weightedOit.frag
+//   oit.composite();
+class WeightedOitPass
+{
+public:
+    bool init(int w, int h)
+    {
+        release();
+        width = w;
+        height = h;
+
+        glGenTextures(1, &accumTexture);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenTextures(1, &weightTexture);
+        glBindTexture(GL_TEXTURE_2D, weightTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+        const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            std::cout << "Weighted OIT framebuffer is incomplete" << std::endl;
+            release();
+            return false;
+        }
+
+        // composite draws a full screen triangle without attributes, core profiles
+        // still want a vertex array bound
+        glGenVertexArrays(1, &emptyVao);
+        shader.reset(new Shader("fullScreen.vert", "oitComposite.frag"));
+        return true;
+    }
+
+    bool isReady() const { return fbo != 0; }
+
+    // binds and clears the targets, sets the blend state of weightedOit.frag
+    void begin()
+    {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        const GLfloat clearAccum[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        const GLfloat clearWeight[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, clearAccum);
+        glClearBufferfv(GL_COLOR, 1, clearWeight);
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // resolves the targets over the framebuffer bound at begin() and leaves it bound
+    void composite()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+        glViewport(0, 0, width, height);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+        shader->use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        shader->setInt("s_accum", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, weightTexture);
+        shader->setInt("s_weightSum", 1);
+        glBindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        glUseProgram(0);
+    }
+
+    void release()
+    {
+        if (fbo)
+            glDeleteFramebuffers(1, &fbo);
+        GLuint textures[] = { accumTexture, weightTexture };
+        for (GLuint t : textures) {
+            if (t)
+                glDeleteTextures(1, &t);
+        }
+        if (emptyVao)
+            glDeleteVertexArrays(1, &emptyVao);
+        if (shader)
+            glDeleteProgram(shader->ID);
+        shader.reset();
+        fbo = accumTexture = weightTexture = emptyVao = 0;
+    }
+
+private:
+    int width = 0, height = 0;
+    GLuint fbo = 0, accumTexture = 0, weightTexture = 0, emptyVao = 0;
+    GLint target = 0;
+    std::unique_ptr<Shader> shader;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Profile-guided build of the CPU side, and its speedup over a plain build.
+#
+#   scripts/pgo.sh [extra cmake arguments, e.g. -DPARTICLE_NATIVE=ON]
+#
+# build-nopgo/  plain Release build, its bench results are the baseline
+# build-pgo/    PARTICLE_PGO=GENERATE, pgo-train, then reconfigured to USE in place
+#               (GCC looks the profiles up by object path, so it has to be the same tree)
+#
+# build-pgo/bench-pgo.json ends up with delta_percent against the baseline per case.
+# The app itself can be trained with: particleProj --replay build-pgo/train.journal
+set -e
+cd "$(dirname "$0")/.."
+JOBS=$(nproc 2>/dev/null || echo 4)
+
+cmake -S . -B build-nopgo -DCMAKE_BUILD_TYPE=Release "$@"
+cmake --build build-nopgo -j"$JOBS"
+(cd build-nopgo && ./bench --json bench-nopgo.json)
+
+rm -rf build-pgo/pgo
+cmake -S . -B build-pgo -DCMAKE_BUILD_TYPE=Release -DPARTICLE_PGO=GENERATE "$@"
+cmake --build build-pgo -j"$JOBS"
+cmake --build build-pgo --target pgo-train
+
+if cmake -LA -N build-pgo | grep -q 'CMAKE_CXX_COMPILER:.*clang'; then
+    llvm-profdata merge -output=build-pgo/pgo/default.profdata build-pgo/pgo/*.profraw
+fi
+cmake -S . -B build-pgo -DPARTICLE_PGO=USE
+cmake --build build-pgo -j"$JOBS"
+(cd build-pgo && ./bench --json bench-pgo.json --baseline ../build-nopgo/bench-nopgo.json)